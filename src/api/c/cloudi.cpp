@@ -45,12 +45,30 @@
 #include "realloc_ptr.hpp"
 #include "copy_ptr.hpp"
 #include "timer.hpp"
+#include "shm_ring.hpp"
+#include "protocol.hpp"
 #include <unistd.h>
 #include <errno.h>
 #include <poll.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <fcntl.h>
+#if defined(HAVE_SYS_EVENTFD_H)
+#include <sys/eventfd.h>
+#endif
+#include <signal.h>
+#include <limits.h>
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+#define DATAGRAM_SIZE_MAX 65536U
 #include <ei.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/exception/all.hpp>
 #define BACKTRACE_FRAMES 32
 #define BACKTRACE_FRAME_OFFSET 2
@@ -60,10 +78,13 @@
 #include <booster/backtrace.h>
 #endif
 #include <string>
-#include <list>
+#include <vector>
+#include <deque>
 #include <cstdlib>
 #include <cstring>
+#include <cstdio>
 #include <iostream>
+#include <sstream>
 #include "assert.hpp"
 
 extern "C" {
@@ -150,6 +171,8 @@ static std::string backtrace_string()
 
 namespace
 {
+    class batch_function;
+
     class callback_function
     {
         private:
@@ -194,13 +217,50 @@ namespace
                     cloudi_callback_t m_f;
             };
 
+            // used for a request that has no subscribed function,
+            // so the request receives a null response
+            class callback_function_null :
+                public CloudI::API::callback_function_generic
+            {
+                public:
+                    virtual ~callback_function_null() throw() {}
+
+                    virtual void operator () (int const,
+                                              char const * const,
+                                              char const * const,
+                                              void const * const,
+                                              uint32_t const,
+                                              void const * const,
+                                              uint32_t const,
+                                              uint32_t,
+                                              int8_t,
+                                              char const * const,
+                                              char const * const,
+                                              uint32_t const)
+                    {
+                    }
+            };
+
         public:
+            callback_function() :
+                m_function(new callback_function_null()),
+                m_batch(0) {}
+
             callback_function(CloudI::API::callback_function_generic * p) :
-                m_function(p) {}
+                m_function(p),
+                m_batch(0) {}
+
+            // the batch function is kept with its type so that
+            // a request is dispatched without a dynamic_cast
+            callback_function(CloudI::API::callback_function_generic * p,
+                              batch_function * batch) :
+                m_function(p),
+                m_batch(batch) {}
 
             callback_function(cloudi_instance_t * p,
                               cloudi_callback_t f) :
-                m_function(new callback_function_c(p, f)) {}
+                m_function(new callback_function_c(p, f)),
+                m_batch(0) {}
 
             void operator () (int const command,
                               char const * const name,
@@ -228,304 +288,2003 @@ namespace
                               pid,
                               pid_size);
             }
+
+            batch_function * batch() const
+            {
+                return m_batch;
+            }
                 
         private:
             boost::shared_ptr<CloudI::API::callback_function_generic>
                 m_function;
+            batch_function * m_batch;
     };
 
     class callback_function_lookup
     {
         private:
+            // the pattern hash is the same for std::string and char const *
+            // so an incoming pattern is found without a std::string
+            class pattern_hash
+            {
+                public:
+                    size_t operator () (std::string const & pattern) const
+                    {
+                        return boost::hash_range(pattern.begin(),
+                                                 pattern.end());
+                    }
+
+                    size_t operator () (char const * const pattern) const
+                    {
+                        return boost::hash_range(pattern,
+                                                 pattern + ::strlen(pattern));
+                    }
+            };
+
+            class pattern_equal
+            {
+                public:
+                    bool operator () (std::string const & pattern1,
+                                      std::string const & pattern2) const
+                    {
+                        return (pattern1 == pattern2);
+                    }
+
+                    bool operator () (char const * const pattern1,
+                                      std::string const & pattern2) const
+                    {
+                        return (pattern2.compare(pattern1) == 0);
+                    }
+            };
+
+            // round-robin selection among the functions subscribed
+            // with the same pattern (by index, no allocation occurs)
             class callback_function_queue
             {
                 private:
-                    typedef std::list<callback_function> queue_t;
+                    typedef std::vector<callback_function> queue_t;
                 public:
                     callback_function_queue(callback_function const & f) :
-                        m_queue(new queue_t()),
-                        m_size(1)
+                        m_queue(1, f),
+                        m_index(0),
+                        m_count(0)
                     {
-                        m_queue->push_back(f);
                     }
 
                     void push_back(callback_function const & f)
                     {
-                        m_queue->push_back(f);
-                        m_size++;
+                        m_queue.push_back(f);
                     }
 
                     void pop_front()
                     {
-                        m_queue->pop_front();
-                        assert(m_size > 0);
-                        m_size--;
+                        assert(m_queue.empty() == false);
+                        // the least recently used function is removed
+                        m_queue.erase(m_queue.begin() + m_index);
+                        if (m_index == m_queue.size())
+                            m_index = 0;
                     }
 
                     bool empty() const
                     {
-                        return (m_size == 0);
+                        return m_queue.empty();
                     }
 
                     callback_function const & cycle()
                     {
-                        queue_t & queue = *m_queue;
-                        if (m_size == 1)
-                            return queue.front();
-                        queue.push_back(queue.front());
-                        queue.pop_front();
-                        return queue.back();
+                        callback_function const & f = m_queue[m_index];
+                        if (++m_index == m_queue.size())
+                            m_index = 0;
+                        ++m_count;
+                        return f;
+                    }
+
+                    uint64_t count() const
+                    {
+                        return m_count;
                     }
                 private:
-                    boost::shared_ptr<queue_t> m_queue;
-                    size_t m_size;
+                    queue_t m_queue;
+                    size_t m_index;
+                    uint64_t m_count;
             };
 
-            typedef boost::unordered_map<std::string, callback_function_queue>
-                lookup_queue_t;
-            typedef std::pair<std::string, callback_function_queue>
-                lookup_queue_pair_t;
+            // each pattern is assigned an index (the callback id)
+            // when it is first subscribed, and the index is never reused,
+            // so a request that provides the callback id is dispatched
+            // without hashing the pattern
+            typedef boost::unordered_map<std::string,
+                                         uint32_t,
+                                         pattern_hash,
+                                         pattern_equal> lookup_index_t;
+            typedef std::vector<callback_function_queue> lookup_queue_t;
         public:
-            void insert(std::string const & pattern,
-                        callback_function const & f)
+            uint32_t insert(std::string const & pattern,
+                            callback_function const & f)
             {
-                lookup_queue_t::iterator itr = m_lookup.find(pattern);
+                lookup_index_t::iterator itr = m_lookup.find(pattern);
                 if (itr == m_lookup.end())
                 {
-                    m_lookup.insert(lookup_queue_pair_t(pattern, f));
+                    uint32_t const callback_id = m_queues.size();
+                    m_lookup.insert(std::make_pair(pattern, callback_id));
+                    m_queues.push_back(callback_function_queue(f));
+                    return callback_id;
                 }
                 else
                 {
-                    itr->second.push_back(f);
+                    m_queues[itr->second].push_back(f);
+                    return itr->second;
                 }
             }
 
             bool remove(std::string const & pattern)
             {
-                lookup_queue_t::iterator itr = m_lookup.find(pattern);
+                lookup_index_t::iterator itr = m_lookup.find(pattern);
+                if (itr == m_lookup.end() || m_queues[itr->second].empty())
+                    return false;
+                m_queues[itr->second].pop_front();
+                return true;
+            }
+
+            callback_function find(char const * const pattern)
+            {
+                lookup_index_t::iterator itr =
+                    m_lookup.find(pattern, pattern_hash(), pattern_equal());
                 if (itr == m_lookup.end())
+                    return m_null;
+                return find(itr->second);
+            }
+
+            // the callback id is provided by the incoming request,
+            // so it may refer to a pattern that is no longer subscribed
+            callback_function find(uint32_t const callback_id)
+            {
+                if (callback_id >= m_queues.size())
+                    return m_null;
+                callback_function_queue & queue = m_queues[callback_id];
+                if (queue.empty())
+                    return m_null;
+                return queue.cycle();
+            }
+
+            // requests received for the pattern
+            bool count(std::string const & pattern, uint64_t & count) const
+            {
+                lookup_index_t::const_iterator itr = m_lookup.find(pattern);
+                if (itr == m_lookup.end() || m_queues[itr->second].empty())
                     return false;
-                itr->second.pop_front();
-                if (itr->second.empty())
-                    m_lookup.erase(itr);
+                count = m_queues[itr->second].count();
                 return true;
             }
 
-            callback_function find(std::string const & pattern)
+            void print_counts(std::ostream & out) const
             {
-                lookup_queue_t::iterator itr = m_lookup.find(pattern);
-                assert(itr != m_lookup.end());
-                return itr->second.cycle();
+                for (lookup_index_t::const_iterator itr = m_lookup.begin();
+                     itr != m_lookup.end(); ++itr)
+                {
+                    callback_function_queue const & queue =
+                        m_queues[itr->second];
+                    if (queue.empty())
+                        continue;
+                    out << "  pattern " << itr->first << ": " <<
+                        queue.count() << " requests\n";
+                }
             }
 
         private:
-            lookup_queue_t m_lookup;
+            lookup_index_t m_lookup;
+            lookup_queue_t m_queues;
+            callback_function const m_null;
             
     };
     typedef callback_function_lookup lookup_t;
     typedef realloc_ptr<char> buffer_t;
 
-    int errno_read()
+    // trim policy and memory statistics of the send, receive and
+    // call buffers (which may grow to CLOUDI_MAX_BUFFERSIZE),
+    // only used between requests when the buffer contents are not needed
+    class buffer_trim
     {
-        switch (errno)
-        {
-            case EAGAIN:
-                return cloudi_error_read_EAGAIN;
-            case EBADF:
-                return cloudi_error_read_EBADF;
-            case EFAULT:
-                return cloudi_error_read_EFAULT;
-            case EINTR:
-                return cloudi_error_read_EINTR;
-            case EINVAL:
-                return cloudi_error_read_EINVAL;
-            case EIO:
-                return cloudi_error_read_EIO;
-            case EISDIR:
-                return cloudi_error_read_EISDIR;
-            default:
-                return cloudi_error_read_unknown;
-        }
-    }
+        public:
+            buffer_trim() :
+                m_trim_count(0),
+                m_idle_release(false),
+                m_count(0),
+                m_used_max(0),
+                m_used_time(0),
+                m_released(true),
+                m_allocated(0),
+                m_allocated_max(0),
+                m_trimmed(0),
+                m_released_total(0),
+                m_trims(0)
+            {
+                m_hugepage[0] = m_hugepage[1] = m_hugepage[2] = 0;
+            }
 
-    int errno_write()
-    {
-        switch (errno)
-        {
-            case EAGAIN:
-                return cloudi_error_write_EAGAIN;
-            case EBADF:
-                return cloudi_error_write_EBADF;
-            case EFAULT:
-                return cloudi_error_write_EFAULT;
-            case EFBIG:
-                return cloudi_error_write_EFBIG;
-            case EINTR:
-                return cloudi_error_write_EINTR;
-            case EINVAL:
-                return cloudi_error_write_EINVAL;
-            case EIO:
-                return cloudi_error_write_EIO;
-            case ENOSPC:
-                return cloudi_error_write_ENOSPC;
-            case EPIPE:
-                return cloudi_error_write_EPIPE;
-            default:
-                return cloudi_error_write_unknown;
-        }
-    }
+            void set(uint32_t const trim_count, bool const idle_release)
+            {
+                m_trim_count = trim_count;
+                m_idle_release = idle_release;
+                m_count = 0;
+                m_used_max = 0;
+            }
 
-    int errno_poll()
-    {
-        switch (errno)
-        {
-            case EBADF:
-                return cloudi_error_poll_EBADF;
-            case EFAULT:
-                return cloudi_error_poll_EFAULT;
-            case EINTR:
-                return cloudi_error_poll_EINTR;
-            case EINVAL:
-                return cloudi_error_poll_EINVAL;
-            case ENOMEM:
-                return cloudi_error_poll_ENOMEM;
-            default:
-                return cloudi_error_poll_unknown;
-        }
-    }
+            // a message was received
+            void used(size_t const size, size_t const initial_size,
+                      uint64_t const time)
+            {
+                m_used_time = time;
+                if (size > m_used_max)
+                    m_used_max = size;
+                if (size > initial_size)
+                    m_released = false;
+                ++m_count;
+            }
 
-    int data_ready(int fd, bool & ready)
-    {
-        struct pollfd fds[1] = {{fd, POLLIN | POLLPRI, 0}};
-        int const count = poll(fds, 1, 0);
-        if (count == -1)
-            return errno_poll();
-        ready = (count == 1);
-        return cloudi_success;
-    }
+            // shrink the buffers to fit the largest message received
+            // within the last trim_count messages
+            void check(buffer_t & send, buffer_t & recv, buffer_t & call)
+            {
+                size_t const allocated = send.size() + recv.size() +
+                                         call.size();
+                if (allocated != m_allocated)
+                {
+                    if (allocated > m_allocated)
+                        m_released = false;
+                    m_allocated = allocated;
+                    if (allocated > m_allocated_max)
+                        m_allocated_max = allocated;
+                    hugepage(send);
+                    hugepage(recv);
+                    hugepage(call);
+                }
+                if (m_trim_count == 0 || m_count < m_trim_count)
+                    return;
+                shrink(send);
+                shrink(recv);
+                shrink(call);
+                m_allocated = send.size() + recv.size() + call.size();
+                m_count = 0;
+                m_used_max = 0;
+            }
 
-    int read_exact(int fd,
-                   unsigned char * const buffer,
-                   uint32_t const length)
-    {
-        uint32_t total = 0;
-        while (total < length)
-        {
-            ssize_t const i = ::read(fd, buffer + total, length - total);
-            if (i <= 0)
+            // milliseconds to wait without receiving a message before the
+            // memory of grown buffers is released (-1 if nothing to release)
+            int idle_wait(uint64_t const time) const
             {
-                if (i == -1)
-                    return errno_read();
-                else
-                    return cloudi_error_read_null;
+                if (! m_idle_release || m_released)
+                    return -1;
+                uint64_t const elapsed = time - m_used_time;
+                if (elapsed >= idle_interval)
+                    return 0;
+                return static_cast<int>(idle_interval - elapsed);
             }
-            total += i;
-        }
-        if (total > length)
-            return cloudi_error_read_overflow;
-        return cloudi_success;
-    }
 
-    int read_all(int fd, int const use_header,
-                 buffer_t & buffer, uint32_t & total,
-                 uint32_t const buffer_size)
-    {
-        total = 0;
-        if (use_header)
-        {
-            unsigned char header[4];
-            int const status = read_exact(fd, header, 4);
-            if (status)
-                return status;
-            uint32_t const length = (header[0] << 24) |
-                                    (header[1] << 16) |
-                                    (header[2] <<  8) |
-                                     header[3];
-            if (buffer.reserve(length) == false)
-                return cloudi_out_of_memory;
-            total = length;
-            return read_exact(fd, buffer.get<unsigned char>(), length);
-        }
-        else
-        {
-            bool ready = true;
-            while (ready)
+            // give the memory of grown buffers back to the operating system
+            // (the pages are provided again, zeroed, when used)
+            void idle(buffer_t & send, buffer_t & recv, buffer_t & call)
             {
-                if (buffer.reserve(total + buffer_size) == false)
-                    return cloudi_out_of_memory;
-                ssize_t i = ::read(fd, &buffer[total], buffer_size);
-                if (i < 0)
-                    return errno_read();
-                total += i;
-                ready = (i == static_cast<signed>(buffer_size)) ||
-                        (i == 0 && total == 0);
-                if (ready)
+                if (! m_idle_release || m_released)
+                    return;
+                release(send);
+                release(recv);
+                release(call);
+                m_released = true;
+            }
+
+            void stats(cloudi_memory_stats_t & stats,
+                       buffer_t const & send,
+                       buffer_t const & recv,
+                       buffer_t const & call) const
+            {
+                stats.allocated = send.size() + recv.size() + call.size();
+                stats.allocated_max = std::max(m_allocated_max,
+                                               stats.allocated);
+                stats.trimmed = m_trimmed;
+                stats.released = m_released_total;
+                stats.trim_count = m_trims;
+            }
+
+        private:
+            // only an instance that stays idle releases the memory
+            // (steady large messages would otherwise fault in the
+            //  released pages again for each request)
+            static uint64_t const idle_interval = 1000; // milliseconds
+
+            void shrink(buffer_t & buffer)
+            {
+                size_t const size = buffer.size();
+                if (buffer.shrink(m_used_max))
                 {
-                    int const status = data_ready(fd, ready);
-                    if (status)
-                        return status;
+                    m_trimmed += size - buffer.size();
+                    ++m_trims;
                 }
             }
-        }
 
-        return cloudi_success;
-    }
+            void release(buffer_t & buffer)
+            {
+                // only the page aligned memory beyond the initial size
+                uintptr_t const page = ::sysconf(_SC_PAGESIZE);
+                uintptr_t const p = reinterpret_cast<uintptr_t>(buffer.get());
+                uintptr_t const start = (p + buffer.initial_size() +
+                                         page - 1) & ~(page - 1);
+                uintptr_t const end = (p + buffer.size()) & ~(page - 1);
+                if (end <= start)
+                    return;
+                if (::madvise(reinterpret_cast<void *>(start),
+                              end - start, MADV_DONTNEED) == 0)
+                    m_released_total += end - start;
+            }
 
-    int write_exact(int fd, int const use_header,
-                    char * const buffer, uint32_t const length)
+            void hugepage(buffer_t & buffer)
+            {
+#if defined(MADV_HUGEPAGE)
+                size_t const hugepage_size = 2097152; // 2MB
+                if (buffer.size() < hugepage_size)
+                    return;
+                void * const p = buffer.get();
+                if (p == m_hugepage[0] || p == m_hugepage[1] ||
+                    p == m_hugepage[2])
+                    return;
+                m_hugepage[2] = m_hugepage[1];
+                m_hugepage[1] = m_hugepage[0];
+                m_hugepage[0] = p;
+                uintptr_t const start =
+                    (reinterpret_cast<uintptr_t>(p) +
+                     hugepage_size - 1) & ~(hugepage_size - 1);
+                uintptr_t const end =
+                    (reinterpret_cast<uintptr_t>(p) +
+                     buffer.size()) & ~(hugepage_size - 1);
+                if (end > start)
+                    ::madvise(reinterpret_cast<void *>(start),
+                              end - start, MADV_HUGEPAGE);
+#else
+                static_cast<void>(buffer);
+#endif
+            }
+
+            uint32_t m_trim_count;
+            bool m_idle_release;
+            uint32_t m_count;
+            size_t m_used_max;
+            uint64_t m_used_time;
+            bool m_released;
+            uint64_t m_allocated;
+            uint64_t m_allocated_max;
+            uint64_t m_trimmed;
+            uint64_t m_released_total;
+            uint64_t m_trims;
+            void * m_hugepage[3];
+    };
+
+    // log-linear buckets (as used by HdrHistogram) with 16 sub-buckets
+    // for each power of 2, so a value is recorded within 6.25%
+    // with a constant time record (the instance is only used by
+    // a single thread at a time, so no locking is necessary)
+    class histogram
     {
-        if (use_header)
-        {
-            uint32_t const length_body = length - 4;
-            buffer[0] = (length_body & 0xff000000) >> 24;
-            buffer[1] = (length_body & 0x00ff0000) >> 16;
-            buffer[2] = (length_body & 0x0000ff00) >> 8;
-            buffer[3] =  length_body & 0x000000ff;
-        }
+        private:
+            enum
+            {
+                sub_bucket_bits = 4,
+                sub_bucket_count = 1 << sub_bucket_bits,
+                bucket_count = (64 - sub_bucket_bits + 1) * sub_bucket_count
+            };
+        public:
+            histogram()
+            {
+                reset();
+            }
 
-        uint32_t total = 0;
-        while (total < length)
-        {
-            ssize_t const i = ::write(fd, buffer + total, length - total);
-            if (i <= 0)
+            void reset()
             {
-                if (i == -1)
-                    return errno_write();
-                else
-                    return cloudi_error_write_null;
+                ::memset(m_counts, 0, sizeof(m_counts));
+                m_count = 0;
+                m_sum = 0;
+                m_min = 0;
+                m_max = 0;
             }
-            total += i;
-        }
-        if (total > length)
-            return cloudi_error_write_overflow;
-        return cloudi_success;
-    }
 
-} // anonymous namespace
+            void record(uint64_t const value)
+            {
+                ++m_counts[index(value)];
+                if (m_count == 0 || value < m_min)
+                    m_min = value;
+                if (value > m_max)
+                    m_max = value;
+                ++m_count;
+                m_sum += value;
+            }
 
-extern "C" {
+            void get(cloudi_stats_histogram_t & stats) const
+            {
+                stats.count = m_count;
+                stats.min = m_min;
+                stats.max = m_max;
+                stats.mean = (m_count == 0) ? 0 : m_sum / m_count;
+                stats.p50 = percentile(50.0);
+                stats.p90 = percentile(90.0);
+                stats.p99 = percentile(99.0);
+                stats.p999 = percentile(99.9);
+            }
 
-static void exit_handler()
-{
-    ::fflush(stdout);
-    ::fflush(stderr);
-    std::cout.flush();
-    std::cerr.flush();
-    std::clog.flush();
-}
+        private:
+            static size_t index(uint64_t const value)
+            {
+                if (value < sub_bucket_count)
+                    return static_cast<size_t>(value);
+                unsigned int msb;
+#if defined(__GNUC__)
+                msb = 63 - __builtin_clzll(value);
+#else
+                msb = 0;
+                for (uint64_t v = value; v >>= 1;)
+                    ++msb;
+#endif
+                unsigned int const shift = msb - sub_bucket_bits;
+                return (shift + 1) * sub_bucket_count +
+                       static_cast<size_t>((value >> shift) -
+                                           sub_bucket_count);
+            }
 
-static void exception_unknown()
-{
-    std::cerr << backtrace_string();
-    ::abort();
-}
+            // the highest value that is recorded in the bucket
+            static uint64_t value(size_t const index)
+            {
+                if (index < sub_bucket_count)
+                    return index;
+                unsigned int const shift = index / sub_bucket_count - 1;
+                uint64_t const sub_bucket = index % sub_bucket_count +
+                                            sub_bucket_count;
+                return ((sub_bucket + 1) << shift) - 1;
+            }
 
-static int poll_request(cloudi_instance_t * p,
-                        int timeout,
-                        int external);
+            uint64_t percentile(double const percent) const
+            {
+                if (m_count == 0)
+                    return 0;
+                uint64_t const target = std::max(static_cast<uint64_t>(1),
+                    static_cast<uint64_t>(percent * m_count / 100.0 + 0.5));
+                uint64_t total = 0;
+                for (size_t i = 0; i < bucket_count; ++i)
+                {
+                    total += m_counts[i];
+                    if (total >= target)
+                        return std::min(value(i), m_max);
+                }
+                return m_max;
+            }
 
-int cloudi_initialize(cloudi_instance_t * p,
-                      unsigned int const thread_index)
+            uint64_t m_counts[bucket_count];
+            uint64_t m_count;
+            uint64_t m_sum;
+            uint64_t m_min;
+            uint64_t m_max;
+    };
+
+    // incremented by SIGUSR1 after cloudi_stats_dump_signal
+    volatile sig_atomic_t stats_signal_count = 0;
+
+    void stats_signal(int)
+    {
+        stats_signal_count = stats_signal_count + 1;
+    }
+
+    class request_stats
+    {
+        public:
+            request_stats() :
+                m_dump_signal(false),
+                m_dump_count(0)
+            {
+                reset();
+            }
+
+            void reset()
+            {
+                m_requests = 0;
+                m_expired = 0;
+                m_messages_in = 0;
+                m_bytes_in = 0;
+                m_messages_out = 0;
+                m_bytes_out = 0;
+                m_callback.reset();
+                m_send_sync.reset();
+                m_write.reset();
+            }
+
+            void received(uint32_t const size)
+            {
+                ++m_messages_in;
+                m_bytes_in += size;
+            }
+
+            void callback(uint64_t const elapsed)
+            {
+                ++m_requests;
+                m_callback.record(elapsed);
+            }
+
+            // the batch function execution time is recorded once
+            void batch(uint64_t const elapsed, uint32_t const count)
+            {
+                m_requests += count;
+                m_callback.record(elapsed);
+            }
+
+            void expired()
+            {
+                ++m_expired;
+            }
+
+            void send_sync(uint64_t const elapsed)
+            {
+                m_send_sync.record(elapsed);
+            }
+
+            void write(uint64_t const elapsed, uint32_t const size)
+            {
+                ++m_messages_out;
+                m_bytes_out += size;
+                m_write.record(elapsed);
+            }
+
+            void get(cloudi_stats_t & stats) const
+            {
+                stats.requests = m_requests;
+                stats.expired = m_expired;
+                stats.messages_in = m_messages_in;
+                stats.bytes_in = m_bytes_in;
+                stats.messages_out = m_messages_out;
+                stats.bytes_out = m_bytes_out;
+                m_callback.get(stats.callback);
+                m_send_sync.get(stats.send_sync);
+                m_write.get(stats.write);
+            }
+
+            void dump_signal(bool const enable)
+            {
+                m_dump_signal = enable;
+                m_dump_count = stats_signal_count;
+            }
+
+            bool dump_pending() const
+            {
+                return (m_dump_signal && m_dump_count != stats_signal_count);
+            }
+
+            void dump_done()
+            {
+                m_dump_count = stats_signal_count;
+            }
+
+        private:
+            uint64_t m_requests;
+            uint64_t m_expired;
+            uint64_t m_messages_in;
+            uint64_t m_bytes_in;
+            uint64_t m_messages_out;
+            uint64_t m_bytes_out;
+            histogram m_callback;
+            histogram m_send_sync;
+            histogram m_write;
+            bool m_dump_signal;
+            sig_atomic_t m_dump_count;
+    };
+
+    // the callback execution time includes the return (or forward)
+    class request_stats_scope
+    {
+        public:
+            request_stats_scope(request_stats & stats) :
+                m_stats(stats)
+            {
+            }
+
+            ~request_stats_scope()
+            {
+                m_stats.callback(m_timer.elapsed_nanoseconds());
+            }
+        private:
+            request_stats & m_stats;
+            timer m_timer;
+    };
+
+    class future_function
+    {
+        private:
+            class future_function_c :
+                public CloudI::API::future_function_generic
+            {
+                public:
+                    future_function_c(cloudi_instance_t * p,
+                                      cloudi_future_t f,
+                                      void * context) :
+                        m_p(p), m_f(f), m_context(context) {}
+                    virtual ~future_function_c() throw() {}
+
+                    virtual void operator () (void const * const response_info,
+                                              uint32_t const
+                                                  response_info_size,
+                                              void const * const response,
+                                              uint32_t const response_size,
+                                              char const * const trans_id)
+                    {
+                        m_f(m_p,
+                            response_info,
+                            response_info_size,
+                            response,
+                            response_size,
+                            trans_id,
+                            m_context);
+                    }
+                private:
+                    cloudi_instance_t * m_p;
+                    cloudi_future_t m_f;
+                    void * m_context;
+            };
+
+        public:
+            future_function(CloudI::API::future_function_generic * p) :
+                m_function(p) {}
+
+            future_function(cloudi_instance_t * p,
+                            cloudi_future_t f,
+                            void * context) :
+                m_function(new future_function_c(p, f, context)) {}
+
+            void operator () (void const * const response_info,
+                              uint32_t const response_info_size,
+                              void const * const response,
+                              uint32_t const response_size,
+                              char const * const trans_id) const
+            {
+                (*m_function)(response_info,
+                              response_info_size,
+                              response,
+                              response_size,
+                              trans_id);
+            }
+
+        private:
+            boost::shared_ptr<CloudI::API::future_function_generic>
+                m_function;
+    };
+
+    // futures waiting for an async response and the async responses
+    // received that still need to be provided to the future function
+    class future_lookup
+    {
+        private:
+            class future_response
+            {
+                public:
+                    future_response(future_function const & f,
+                                    char const * const response_info,
+                                    uint32_t const response_info_size,
+                                    char const * const response,
+                                    uint32_t const response_size,
+                                    std::string const & trans_id) :
+                        m_f(f),
+                        m_response_info(response_info, response_info_size),
+                        m_response(response, response_size),
+                        m_trans_id(trans_id)
+                    {
+                    }
+
+                    void operator () () const
+                    {
+                        m_f(m_response_info.data(), m_response_info.size(),
+                            m_response.data(), m_response.size(),
+                            m_trans_id.data());
+                    }
+                private:
+                    future_function m_f;
+                    std::string m_response_info;
+                    std::string m_response;
+                    std::string m_trans_id;
+            };
+
+            typedef boost::unordered_map<std::string,
+                                         future_function> pending_t;
+        public:
+            void insert(char const * const trans_id,
+                        future_function const & f)
+            {
+                m_pending.insert(std::make_pair(std::string(trans_id, 16),
+                                                f));
+            }
+
+            // store the async response until the future function is called
+            void complete(char const * const response_info,
+                          uint32_t const response_info_size,
+                          char const * const response,
+                          uint32_t const response_size,
+                          char const * const trans_id)
+            {
+                pending_t::iterator itr =
+                    m_pending.find(std::string(trans_id, 16));
+                if (itr == m_pending.end())
+                    return;
+                m_complete.push_back(future_response(itr->second,
+                                                     response_info,
+                                                     response_info_size,
+                                                     response,
+                                                     response_size,
+                                                     itr->first));
+                m_pending.erase(itr);
+            }
+
+            // call the future functions that have an async response
+            void call()
+            {
+                while (! m_complete.empty())
+                {
+                    future_response const f = m_complete.front();
+                    m_complete.pop_front();
+                    try
+                    {
+                        f();
+                    }
+                    catch (boost::exception const & e)
+                    {
+                        std::cerr << boost::diagnostic_information(e);
+                    }
+                    catch (std::exception const & e)
+                    {
+                        std::cerr << boost::diagnostic_information(e);
+                    }
+                }
+            }
+
+        private:
+            pending_t m_pending;
+            std::deque<future_response> m_complete;
+    };
+
+    // a stream is a sequence of send_sync requests (chunks), so only
+    // a single chunk is buffered at a time and the sender waits for each
+    // chunk to be acknowledged by the receiver.  the stream key/value pairs
+    // precede any request_info of the sender (provided with the last chunk)
+    class stream_info
+    {
+        public:
+            stream_info(void const * const info,
+                        uint32_t const info_size) :
+                chunk(0),
+                end(false),
+                unknown(false),
+                size(0)
+            {
+                char const * const data = reinterpret_cast<char const *>(info);
+                uint32_t i = 0;
+                while (i < info_size)
+                {
+                    char const * const key = &data[i];
+                    size_t const key_size = ::strnlen(key, info_size - i);
+                    if (i + key_size + 1 >= info_size ||
+                        ::strncmp(key, "stream_", 7) != 0)
+                        break;
+                    char const * const value = &key[key_size + 1];
+                    size_t const value_size =
+                        ::strnlen(value, info_size - (i + key_size + 1));
+                    if (i + key_size + 1 + value_size == info_size)
+                        break;
+                    if (::strcmp(key, "stream_id") == 0)
+                        id.assign(value, value_size);
+                    else if (::strcmp(key, "stream_name") == 0)
+                        name.assign(value, value_size);
+                    else if (::strcmp(key, "stream_chunk") == 0)
+                        chunk = ::strtoul(value, 0, 10);
+                    else if (::strcmp(key, "stream_end") == 0)
+                        end = true;
+                    else if (::strcmp(key, "stream_unknown") == 0)
+                        unknown = true;
+                    i += key_size + 1 + value_size + 1;
+                }
+                size = i;
+            }
+
+            static void append(std::string & info,
+                               char const * const key,
+                               std::string const & value)
+            {
+                info.append(key, ::strlen(key) + 1);
+                info.append(value.c_str(), value.size() + 1);
+            }
+
+            std::string id;
+            std::string name;
+            uint32_t chunk;
+            bool end;
+            bool unknown;      // the chunk was not accepted by the receiver
+            uint32_t size;     // size of the stream key/value pairs
+    };
+
+    // the outgoing stream of cloudi_stream_begin
+    class stream_send
+    {
+        public:
+            stream_send() :
+                active(false),
+                timeout(0),
+                priority(0),
+                chunk(0)
+            {
+            }
+
+            bool active;
+            std::string name;  // the receiving process after the first chunk
+            std::string id;
+            uint32_t timeout;
+            int8_t priority;
+            uint32_t chunk;
+    };
+
+    // the incoming streams of cloudi_stream_subscribe
+    class stream_lookup
+    {
+        private:
+            class stream_state
+            {
+                public:
+                    stream_state(callback_function const & f,
+                                 char const * const pattern,
+                                 uint32_t const timeout) :
+                        m_f(f),
+                        m_pattern(pattern),
+                        m_chunk(0),
+                        m_timeout(timeout)
+                    {
+                    }
+
+                    callback_function m_f;
+                    std::string m_pattern;
+                    uint32_t m_chunk;
+                    uint32_t m_timeout;
+                    timer m_last;
+            };
+            typedef boost::unordered_map<std::string, stream_state> lookup_t;
+
+        public:
+            typedef lookup_t::iterator iterator;
+
+            // name subscribed by this process for all the chunks after
+            // the first chunk (a stream must remain with the same process)
+            std::string const & name() const
+            {
+                return m_name;
+            }
+
+            void name(std::string const & name)
+            {
+                m_name = name;
+            }
+
+            stream_send & send()
+            {
+                return m_send;
+            }
+
+            void insert(std::string const & id,
+                        callback_function const & f,
+                        char const * const pattern,
+                        uint32_t const timeout)
+            {
+                // a stream is abandoned if the next chunk is not received
+                // within the timeout of the last chunk
+                for (lookup_t::iterator itr = m_lookup.begin();
+                     itr != m_lookup.end();)
+                {
+                    stream_state const & state = itr->second;
+                    if (state.m_last.elapsed() * 1000.0 > state.m_timeout)
+                        itr = m_lookup.erase(itr);
+                    else
+                        ++itr;
+                }
+                m_lookup.insert(std::make_pair(id,
+                                               stream_state(f, pattern,
+                                                            timeout)));
+            }
+
+            iterator find(std::string const & id)
+            {
+                return m_lookup.find(id);
+            }
+
+            iterator end()
+            {
+                return m_lookup.end();
+            }
+
+            void erase(iterator itr)
+            {
+                m_lookup.erase(itr);
+            }
+
+        private:
+            std::string m_name;
+            stream_send m_send;
+            lookup_t m_lookup;
+    };
+
+    // the chunk information is only provided during the callback
+    class stream_chunk_scope
+    {
+        public:
+            stream_chunk_scope(cloudi_instance_t * p,
+                               char const * const id,
+                               uint32_t const chunk,
+                               bool const end) :
+                m_p(p)
+            {
+                p->stream_id = id;
+                p->stream_chunk = chunk;
+                p->stream_chunk_last = end;
+            }
+
+            ~stream_chunk_scope()
+            {
+                m_p->stream_id = 0;
+                m_p->stream_chunk = 0;
+                m_p->stream_chunk_last = 0;
+            }
+        private:
+            cloudi_instance_t * m_p;
+    };
+
+    class stream_function : public CloudI::API::callback_function_generic
+    {
+        public:
+            // f == 0 for the chunks after the first chunk
+            stream_function(cloudi_instance_t * p,
+                            callback_function const * const f = 0) :
+                m_p(p),
+                m_first(f != 0),
+                m_f(f ? *f : callback_function(0))
+            {
+            }
+            virtual ~stream_function() throw() {}
+
+            virtual void operator () (int const command,
+                                      char const * const name,
+                                      char const * const pattern,
+                                      void const * const request_info,
+                                      uint32_t const request_info_size,
+                                      void const * const request,
+                                      uint32_t const request_size,
+                                      uint32_t timeout,
+                                      int8_t priority,
+                                      char const * const trans_id,
+                                      char const * const pid,
+                                      uint32_t const pid_size)
+            {
+                stream_lookup & streams =
+                    *reinterpret_cast<stream_lookup *>(m_p->streams);
+                stream_info const info(request_info, request_info_size);
+                char const * const info_sender =
+                    &reinterpret_cast<char const *>(request_info)[info.size];
+                uint32_t const info_sender_size =
+                    request_info_size - info.size;
+                if (m_first)
+                {
+                    // the stream id is the trans_id of the first chunk
+                    char id[33];
+                    for (size_t i = 0; i < 16; ++i)
+                        ::sprintf(&id[i * 2], "%02x",
+                                  static_cast<unsigned char>(trans_id[i]));
+                    if (info.end == false)
+                        streams.insert(id, m_f, pattern, timeout);
+                    stream_chunk_scope const scope(m_p, id, 0, info.end);
+                    call(m_f, command, name, pattern, pattern,
+                         info_sender, info_sender_size,
+                         request, request_size,
+                         timeout, priority, trans_id, pid, pid_size,
+                         id, info.end);
+                }
+                else
+                {
+                    stream_lookup::iterator itr = streams.find(info.id);
+                    if (itr == streams.end() ||
+                        itr->second.m_chunk + 1 != info.chunk)
+                    {
+                        // unknown stream, the sender gets a response
+                        // that ends the stream without the chunk
+                        if (itr != streams.end())
+                            streams.erase(itr);
+                        std::string response_info;
+                        stream_info::append(response_info,
+                                            "stream_unknown", info.id);
+                        cloudi_return(m_p, command, name, pattern,
+                                      response_info.data(),
+                                      response_info.size(), "", 0,
+                                      timeout, trans_id, pid, pid_size);
+                        return;
+                    }
+                    callback_function const f = itr->second.m_f;
+                    std::string const pattern_stream = itr->second.m_pattern;
+                    if (info.end)
+                    {
+                        streams.erase(itr);
+                    }
+                    else
+                    {
+                        itr->second.m_chunk = info.chunk;
+                        itr->second.m_timeout = timeout;
+                        itr->second.m_last.restart();
+                    }
+                    stream_chunk_scope const scope(m_p, info.id.c_str(),
+                                                   info.chunk, info.end);
+                    call(f, command, name, pattern_stream.c_str(), pattern,
+                         info_sender, info_sender_size,
+                         request, request_size,
+                         timeout, priority, trans_id, pid, pid_size,
+                         info.id, info.end);
+                }
+            }
+
+        private:
+            void call(callback_function const & f,
+                      int const command,
+                      char const * const name,
+                      char const * const pattern,
+                      char const * const pattern_request,
+                      void const * const request_info,
+                      uint32_t const request_info_size,
+                      void const * const request,
+                      uint32_t const request_size,
+                      uint32_t timeout,
+                      int8_t priority,
+                      char const * const trans_id,
+                      char const * const pid,
+                      uint32_t const pid_size,
+                      std::string const & id,
+                      bool const end)
+            {
+                stream_lookup & streams =
+                    *reinterpret_cast<stream_lookup *>(m_p->streams);
+                try
+                {
+                    f(command, name, pattern,
+                      request_info, request_info_size,
+                      request, request_size,
+                      timeout, priority, trans_id, pid, pid_size);
+                }
+                catch (...)
+                {
+                    // a response (or an error) ends the stream early
+                    if (end == false)
+                    {
+                        stream_lookup::iterator itr = streams.find(id);
+                        if (itr != streams.end())
+                            streams.erase(itr);
+                    }
+                    throw;
+                }
+                if (end)
+                    return;
+                if (m_p->callback_returned)
+                {
+                    // a response provided with cloudi_return_nothrow
+                    stream_lookup::iterator itr = streams.find(id);
+                    if (itr != streams.end())
+                        streams.erase(itr);
+                    return;
+                }
+                // acknowledge the chunk
+                std::string response_info;
+                stream_info::append(response_info, "stream_id", id);
+                stream_info::append(response_info, "stream_name",
+                                    streams.name());
+                cloudi_return(m_p, command, name, pattern_request,
+                              response_info.data(), response_info.size(),
+                              "", 0,
+                              timeout, trans_id, pid, pid_size);
+            }
+
+            cloudi_instance_t * m_p;
+            bool const m_first;
+            callback_function const m_f;
+    };
+
+    class batch_function_c : public CloudI::API::batch_function_generic
+    {
+        public:
+            batch_function_c(cloudi_instance_t * p,
+                             cloudi_batch_t f) :
+                m_p(p), m_f(f) {}
+            virtual ~batch_function_c() throw() {}
+
+            virtual void operator () (cloudi_batch_request_t const * const
+                                          requests,
+                                      uint32_t const requests_count)
+            {
+                m_f(m_p, requests, requests_count);
+            }
+        private:
+            cloudi_instance_t * m_p;
+            cloudi_batch_t m_f;
+    };
+
+    // a batch subscription is stored with the callback functions
+    // but poll_request provides all the requests that were already
+    // received for the pattern (the receive buffers of the requests are
+    // exchanged with the batch buffers, so the request data is not copied)
+    class batch_function : public CloudI::API::callback_function_generic
+    {
+        public:
+            batch_function(CloudI::API::batch_function_generic * f,
+                           uint32_t const batch_max) :
+                m_f(f),
+                m_batch_max(batch_max)
+            {
+            }
+            virtual ~batch_function() throw()
+            {
+                for (size_t i = 0; i < m_buffers.size(); ++i)
+                    delete m_buffers[i];
+            }
+
+            virtual void operator () (int const,
+                                      char const * const,
+                                      char const * const,
+                                      void const * const,
+                                      uint32_t const,
+                                      void const * const,
+                                      uint32_t const,
+                                      uint32_t,
+                                      int8_t,
+                                      char const * const,
+                                      char const * const,
+                                      uint32_t const)
+            {
+                // poll_request uses callback_batch instead
+                assert(false);
+            }
+
+            void operator () (cloudi_batch_request_t const * const requests,
+                              uint32_t const requests_count)
+            {
+                (*m_f)(requests, requests_count);
+            }
+
+            uint32_t batch_max() const
+            {
+                return m_batch_max;
+            }
+
+            buffer_t * buffer_get()
+            {
+                if (m_buffers.empty())
+                    return new buffer_t(32768, CLOUDI_MAX_BUFFERSIZE);
+                buffer_t * const buffer = m_buffers.back();
+                m_buffers.pop_back();
+                return buffer;
+            }
+
+            void buffer_put(buffer_t * const buffer)
+            {
+                m_buffers.push_back(buffer);
+            }
+
+        private:
+            boost::shared_ptr<CloudI::API::batch_function_generic> m_f;
+            uint32_t const m_batch_max;
+            std::vector<buffer_t *> m_buffers;
+    };
+
+    // the requests of a batch function call
+    // (p->batch refers to the batch during the call)
+    class batch_state
+    {
+        public:
+            batch_state(cloudi_instance_t * p, batch_function & f) :
+                m_p(p),
+                m_f(f),
+                m_outer(p->batch),
+                m_received(p->receive_time),
+                m_returned(false),
+                m_pending(0),
+                m_pending_index(0)
+            {
+                p->batch = this;
+            }
+
+            ~batch_state()
+            {
+                if (m_pending)
+                {
+                    buffer_t & buffer_recv =
+                        *reinterpret_cast<buffer_t *>(m_p->buffer_recv);
+                    buffer_recv.swap(*m_pending);
+                    m_p->buffer_recv_index = m_pending_index;
+                    m_f.buffer_put(m_pending);
+                }
+                for (size_t i = 0; i < m_buffers.size(); ++i)
+                    m_f.buffer_put(m_buffers[i]);
+                m_p->batch = m_outer;
+            }
+
+            // a received message that is not part of the batch is
+            // kept separate until the batch is done (so any
+            // nested poll_request reads into a separate buffer)
+            void pending(buffer_t & buffer_recv)
+            {
+                m_pending = m_f.buffer_get();
+                m_pending->swap(buffer_recv);
+                m_pending_index = m_p->buffer_recv_index;
+                m_p->buffer_recv_index = 0;
+            }
+
+            // the request data remains in buffer_recv
+            // (which is exchanged with a batch buffer)
+            void push(uint32_t const command,
+                      protocol_send const & message,
+                      buffer_t & buffer_recv)
+            {
+                buffer_t * const buffer = m_f.buffer_get();
+                buffer->swap(buffer_recv);
+                m_buffers.push_back(buffer);
+                cloudi_batch_request_t const request = {
+                    (command == MESSAGE_SEND_ASYNC) ?
+                    CLOUDI_ASYNC : CLOUDI_SYNC,
+                    message.name.data,
+                    message.pattern.data,
+                    message.request_info.data,
+                    message.request_info.size,
+                    message.request.data,
+                    message.request.size,
+                    message.timeout,
+                    message.priority,
+                    message.trans_id,
+                    message.pid.data,
+                    message.pid.size};
+                m_requests.push_back(request);
+            }
+
+            cloudi_batch_request_t const * requests() const
+            {
+                return &m_requests[0];
+            }
+
+            uint32_t size() const
+            {
+                return m_requests.size();
+            }
+
+            // the receive time of the first request
+            uint64_t received() const
+            {
+                return m_received;
+            }
+
+            bool returned() const
+            {
+                return m_returned;
+            }
+
+            void returned(bool const value)
+            {
+                m_returned = value;
+            }
+
+        private:
+            cloudi_instance_t * m_p;
+            batch_function & m_f;
+            void * const m_outer;
+            uint64_t const m_received;
+            bool m_returned;
+            buffer_t * m_pending;
+            uint32_t m_pending_index;
+            std::vector<cloudi_batch_request_t> m_requests;
+            std::vector<buffer_t *> m_buffers;
+    };
+
+    // shm protocol shared memory provided by cloudi_core
+    class shm_t
+    {
+        public:
+            shm_t(void * mapping, size_t mapping_size) :
+                incoming(mapping, shm_ring::ring_size(mapping_size),
+                         shm_ring::incoming),
+                outgoing(mapping, shm_ring::ring_size(mapping_size),
+                         shm_ring::outgoing),
+                m_mapping(mapping),
+                m_mapping_size(mapping_size)
+            {
+            }
+
+            ~shm_t()
+            {
+                ::munmap(m_mapping, m_mapping_size);
+            }
+
+            shm_ring incoming;
+            shm_ring outgoing;
+
+        private:
+            void * m_mapping;
+            size_t m_mapping_size;
+    };
+
+    int errno_read()
+    {
+        switch (errno)
+        {
+            case EAGAIN:
+                return cloudi_error_read_EAGAIN;
+            case EBADF:
+                return cloudi_error_read_EBADF;
+            case EFAULT:
+                return cloudi_error_read_EFAULT;
+            case EINTR:
+                return cloudi_error_read_EINTR;
+            case EINVAL:
+                return cloudi_error_read_EINVAL;
+            case EIO:
+                return cloudi_error_read_EIO;
+            case EISDIR:
+                return cloudi_error_read_EISDIR;
+            default:
+                return cloudi_error_read_unknown;
+        }
+    }
+
+    int errno_write()
+    {
+        switch (errno)
+        {
+            case EAGAIN:
+                return cloudi_error_write_EAGAIN;
+            case EBADF:
+                return cloudi_error_write_EBADF;
+            case EFAULT:
+                return cloudi_error_write_EFAULT;
+            case EFBIG:
+                return cloudi_error_write_EFBIG;
+            case EINTR:
+                return cloudi_error_write_EINTR;
+            case EINVAL:
+                return cloudi_error_write_EINVAL;
+            case EIO:
+                return cloudi_error_write_EIO;
+            case ENOSPC:
+                return cloudi_error_write_ENOSPC;
+            case EPIPE:
+                return cloudi_error_write_EPIPE;
+            default:
+                return cloudi_error_write_unknown;
+        }
+    }
+
+    int errno_poll()
+    {
+        switch (errno)
+        {
+            case EBADF:
+                return cloudi_error_poll_EBADF;
+            case EFAULT:
+                return cloudi_error_poll_EFAULT;
+            case EINTR:
+                return cloudi_error_poll_EINTR;
+            case EINVAL:
+                return cloudi_error_poll_EINVAL;
+            case ENOMEM:
+                return cloudi_error_poll_ENOMEM;
+            default:
+                return cloudi_error_poll_unknown;
+        }
+    }
+
+    int read_exact(int fd,
+                   unsigned char * const buffer,
+                   uint32_t const length)
+    {
+        uint32_t total = 0;
+        while (total < length)
+        {
+            ssize_t const i = ::read(fd, buffer + total, length - total);
+            if (i <= 0)
+            {
+                if (i == -1)
+                    return errno_read();
+                else
+                    return cloudi_error_read_null;
+            }
+            total += i;
+        }
+        if (total > length)
+            return cloudi_error_read_overflow;
+        return cloudi_success;
+    }
+
+    int read_all(int fd, int const use_header, shm_t * const shm,
+                 buffer_t & buffer, uint32_t & total,
+                 uint32_t const buffer_size)
+    {
+        total = 0;
+        if (use_header)
+        {
+            unsigned char header[4];
+            int const status = read_exact(fd, header, 4);
+            if (status)
+                return status;
+            uint32_t length = (header[0] << 24) |
+                              (header[1] << 16) |
+                              (header[2] <<  8) |
+                               header[3];
+            if (length == 0 && shm)
+            {
+                // the frame was stored in the shared memory ring
+                if (shm->incoming.next(length) == false)
+                    return cloudi_error_read_underflow;
+                if (buffer.reserve(length) == false)
+                    return cloudi_out_of_memory;
+                shm->incoming.read(buffer.get<char>(), length);
+                total = length;
+                return cloudi_success;
+            }
+            if (buffer.reserve(length) == false)
+                return cloudi_out_of_memory;
+            total = length;
+            return read_exact(fd, buffer.get<unsigned char>(), length);
+        }
+        else
+        {
+            // each datagram is read completely by a single recv call
+            // and a datagram of buffer_size may be continued by the
+            // datagrams already received (MSG_DONTWAIT stops the
+            // reading when none remain, instead of a separate poll call)
+            uint32_t const size = std::max(buffer_size, DATAGRAM_SIZE_MAX);
+            int flags = MSG_TRUNC;
+            while (true)
+            {
+                if (buffer.reserve(total + size) == false)
+                    return cloudi_out_of_memory;
+                ssize_t const i = ::recv(fd, &buffer[total], size, flags);
+                if (i < 0)
+                {
+                    if ((flags & MSG_DONTWAIT) &&
+                        (errno == EAGAIN || errno == EWOULDBLOCK))
+                        break;
+                    return errno_read();
+                }
+                if (static_cast<size_t>(i) > size)
+                    return cloudi_error_read_overflow;
+                total += i;
+                if (! ((i == static_cast<signed>(buffer_size)) ||
+                       (i == 0 && total == 0)))
+                    break;
+                flags = MSG_TRUNC | MSG_DONTWAIT;
+            }
+        }
+
+        return cloudi_success;
+    }
+
+    int write_exact(int fd, int const use_header,
+                    char * const buffer, uint32_t const length)
+    {
+        if (use_header)
+        {
+            uint32_t const length_body = length - 4;
+            buffer[0] = (length_body & 0xff000000) >> 24;
+            buffer[1] = (length_body & 0x00ff0000) >> 16;
+            buffer[2] = (length_body & 0x0000ff00) >> 8;
+            buffer[3] =  length_body & 0x000000ff;
+        }
+
+        uint32_t total = 0;
+        while (total < length)
+        {
+            ssize_t const i = ::write(fd, buffer + total, length - total);
+            if (i <= 0)
+            {
+                if (i == -1)
+                    return errno_write();
+                else
+                    return cloudi_error_write_null;
+            }
+            total += i;
+        }
+        if (total > length)
+            return cloudi_error_write_overflow;
+        return cloudi_success;
+    }
+
+    // write the buffer segments and payload pointers as a single frame
+    // (the payload data is provided directly to writev without a copy)
+    int write_exact(int fd, int const use_header, shm_t * const shm,
+                    struct iovec * iov, int iovcnt, uint32_t const length)
+    {
+        if (shm && length - 4 >= shm_ring::frame_size_min)
+        {
+            // store the frame without the header in the shared memory ring
+            // and only write a 0 length header to the socket
+            assert(iov[0].iov_len >= 4);
+            iov[0].iov_base = reinterpret_cast<char *>(iov[0].iov_base) + 4;
+            iov[0].iov_len -= 4;
+            bool const stored = shm->outgoing.write(iov, iovcnt, length - 4);
+            iov[0].iov_base = reinterpret_cast<char *>(iov[0].iov_base) - 4;
+            iov[0].iov_len += 4;
+            if (stored)
+            {
+                char header[4] = {0, 0, 0, 0};
+                return write_exact(fd, 0, header, 4);
+            }
+        }
+        if (use_header)
+        {
+            assert(iov[0].iov_len >= 4);
+            char * const buffer = reinterpret_cast<char *>(iov[0].iov_base);
+            uint32_t const length_body = length - 4;
+            buffer[0] = (length_body & 0xff000000) >> 24;
+            buffer[1] = (length_body & 0x00ff0000) >> 16;
+            buffer[2] = (length_body & 0x0000ff00) >> 8;
+            buffer[3] =  length_body & 0x000000ff;
+        }
+
+        // a datagram must be provided to a single writev call
+        if (! use_header && iovcnt > IOV_MAX)
+            return cloudi_error_write_overflow;
+
+        uint32_t total = 0;
+        while (total < length)
+        {
+            ssize_t const i = ::writev(fd, iov, std::min(iovcnt, IOV_MAX));
+            if (i <= 0)
+            {
+                if (i == -1)
+                    return errno_write();
+                else
+                    return cloudi_error_write_null;
+            }
+            total += i;
+            size_t written = i;
+            while (iovcnt > 0 && written >= iov->iov_len)
+            {
+                written -= iov->iov_len;
+                ++iov;
+                --iovcnt;
+            }
+            if (iovcnt > 0)
+            {
+                iov->iov_base = reinterpret_cast<char *>(iov->iov_base) +
+                                written;
+                iov->iov_len -= written;
+            }
+        }
+        if (total > length)
+            return cloudi_error_write_overflow;
+        return cloudi_success;
+    }
+
+    // receive the shm protocol shared memory from cloudi_core
+    int shm_attach(int fd, void * & shm)
+    {
+        char c;
+        struct iovec iov = {&c, 1};
+        char control[CMSG_SPACE(sizeof(int))];
+        struct msghdr message;
+        ::memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        ssize_t result;
+        do
+        {
+            result = ::recvmsg(fd, &message, 0);
+        } while (result == -1 && errno == EINTR);
+        if (result == -1)
+            return errno_read();
+        if (result == 0)
+            return cloudi_error_read_null;
+        struct cmsghdr * const header = CMSG_FIRSTHDR(&message);
+        if (header == 0 ||
+            header->cmsg_level != SOL_SOCKET ||
+            header->cmsg_type != SCM_RIGHTS)
+            return cloudi_error_read_underflow;
+        int fd_shm;
+        ::memcpy(&fd_shm, CMSG_DATA(header), sizeof(int));
+        struct stat status;
+        if (::fstat(fd_shm, &status) == -1)
+        {
+            ::close(fd_shm);
+            return cloudi_invalid_input;
+        }
+        size_t const mapping_size = status.st_size;
+        void * const mapping = ::mmap(0, mapping_size,
+                                      PROT_READ | PROT_WRITE, MAP_SHARED,
+                                      fd_shm, 0);
+        ::close(fd_shm);
+        if (mapping == MAP_FAILED)
+            return cloudi_out_of_memory;
+        shm = new shm_t(mapping, mapping_size);
+        return cloudi_success;
+    }
+
+    // encode only the external term format binary header,
+    // the binary data is provided separately with an iovec
+    void encode_binary_header(char * const buffer, int & index,
+                              uint32_t const size)
+    {
+        char * const s = &buffer[index];
+        s[0] = ERL_BINARY_EXT;
+        s[1] = (size & 0xff000000) >> 24;
+        s[2] = (size & 0x00ff0000) >> 16;
+        s[3] = (size & 0x0000ff00) >> 8;
+        s[4] =  size & 0x000000ff;
+        index += 5;
+    }
+
+    // create the frame iovec array with the 2 payloads
+    // placed at offsets within the encoded buffer data
+    // (0 is returned if the frame is too large)
+    int frame_iovec(struct iovec * iov, char * const buffer,
+                    int const index_payload1,
+                    void const * const payload1, uint32_t const payload1_size,
+                    int const index_payload2,
+                    void const * const payload2, uint32_t const payload2_size,
+                    int const index, uint32_t & length)
+    {
+        if (static_cast<uint64_t>(index) + payload1_size + payload2_size >
+            CLOUDI_MAX_BUFFERSIZE)
+            return 0;
+        iov[0].iov_base = buffer;
+        iov[0].iov_len = index_payload1;
+        iov[1].iov_base = const_cast<void *>(payload1);
+        iov[1].iov_len = payload1_size;
+        iov[2].iov_base = &buffer[index_payload1];
+        iov[2].iov_len = index_payload2 - index_payload1;
+        iov[3].iov_base = const_cast<void *>(payload2);
+        iov[3].iov_len = payload2_size;
+        iov[4].iov_base = &buffer[index_payload2];
+        iov[4].iov_len = index - index_payload2;
+        length = index + payload1_size + payload2_size;
+        return 5;
+    }
+
+    // the return and forward functions end the callback function
+    // with an exception, unless cloudi_return_nothrow was used
+    // (then the callback function must return after the function succeeds)
+    template <typename E>
+    int callback_returned(cloudi_instance_t * p, int const result)
+    {
+        if (result == cloudi_success)
+        {
+            p->callback_returned = 1;
+            if (! p->return_nothrow)
+                throw E();
+        }
+        return result;
+    }
+
+    uint32_t timeout_remaining(uint64_t const deadline)
+    {
+        uint64_t const now = clock_milliseconds();
+        if (now >= deadline)
+            return 0;
+        return static_cast<uint32_t>(
+            std::min(deadline - now, static_cast<uint64_t>(0xffffffff)));
+    }
+
+    // the timeout of a response (or a forward) that uses the timeout
+    // of the callback function request is the remaining timeout
+    bool timeout_adjust(cloudi_instance_t * p, uint32_t & timeout)
+    {
+        if (p->request_timeout_adjustment &&
+            p->request_deadline != 0 &&
+            timeout == p->request_timeout)
+        {
+            timeout = timeout_remaining(p->request_deadline);
+            return true;
+        }
+        return false;
+    }
+
+    // a request sent by a callback function does not wait longer than
+    // the remaining timeout of the callback function request
+    uint32_t timeout_limit(cloudi_instance_t * p, uint32_t const timeout)
+    {
+        if (p->request_timeout_adjustment &&
+            p->request_deadline != 0)
+        {
+            return std::min(timeout, timeout_remaining(p->request_deadline));
+        }
+        return timeout;
+    }
+
+    // the deadline of the callback function request
+    // (a nested callback function restores the outer deadline)
+    class request_deadline_scope
+    {
+        public:
+            request_deadline_scope(cloudi_instance_t * p,
+                                   uint64_t const deadline,
+                                   uint32_t const timeout) :
+                m_p(p),
+                m_outer_deadline(p->request_deadline),
+                m_outer_timeout(p->request_timeout)
+            {
+                p->request_deadline = deadline;
+                p->request_timeout = timeout;
+            }
+
+            ~request_deadline_scope()
+            {
+                m_p->request_deadline = m_outer_deadline;
+                m_p->request_timeout = m_outer_timeout;
+            }
+        private:
+            cloudi_instance_t * m_p;
+            uint64_t const m_outer_deadline;
+            uint32_t const m_outer_timeout;
+    };
+
+    // the callback_returned value of a callback function
+    // (nested within send_sync, recv_async, etc. of another callback)
+    class callback_returned_scope
+    {
+        public:
+            callback_returned_scope(cloudi_instance_t * p) :
+                m_p(p),
+                m_outer(p->callback_returned)
+            {
+                p->callback_returned = 0;
+            }
+
+            ~callback_returned_scope()
+            {
+                m_p->callback_returned = m_outer;
+            }
+        private:
+            cloudi_instance_t * m_p;
+            int const m_outer;
+    };
+
+    // sends and returns submitted by other threads which are written
+    // by the thread that polls the instance (a lock-free list with
+    // multiple producers and a single consumer that takes all the
+    // submissions at once, the wake file descriptor is only written when
+    // the list becomes non-empty)
+    class submit_queue
+    {
+        public:
+            class submission
+            {
+                public:
+                    submission(uint8_t const command,
+                               char const * const name,
+                               char const * const pattern,
+                               void const * const info,
+                               uint32_t const info_size,
+                               void const * const data,
+                               uint32_t const data_size,
+                               uint32_t const timeout,
+                               int8_t const priority,
+                               char const * const trans_id,
+                               char const * const pid,
+                               uint32_t const pid_size) :
+                        m_command(command),
+                        m_name(name),
+                        m_pattern(pattern ? pattern : ""),
+                        m_info(reinterpret_cast<char const *>(info),
+                               info_size),
+                        m_data(reinterpret_cast<char const *>(data),
+                               data_size),
+                        m_timeout(timeout),
+                        m_priority(priority),
+                        m_trans_id(trans_id ? trans_id : "", trans_id ? 16 : 0),
+                        m_pid(pid ? pid : "", pid ? pid_size : 0),
+                        m_next(0)
+                    {
+                    }
+
+                    uint8_t command() const { return m_command; }
+                    char const * name() const { return m_name.c_str(); }
+                    char const * pattern() const { return m_pattern.c_str(); }
+                    std::string const & info() const { return m_info; }
+                    std::string const & data() const { return m_data; }
+                    uint32_t timeout() const { return m_timeout; }
+                    int8_t priority() const { return m_priority; }
+                    char const * trans_id() const { return m_trans_id.data(); }
+                    std::string const & pid() const { return m_pid; }
+
+                private:
+                    friend class submit_queue;
+                    uint8_t const m_command;
+                    std::string const m_name;
+                    std::string const m_pattern;
+                    std::string const m_info;
+                    std::string const m_data;
+                    uint32_t const m_timeout;
+                    int8_t const m_priority;
+                    std::string const m_trans_id;
+                    std::string const m_pid;
+                    submission * m_next;
+            };
+
+            submit_queue() :
+                m_head(0)
+            {
+                m_fd[0] = m_fd[1] = -1;
+            }
+
+            ~submit_queue()
+            {
+                submission * s = take();
+                while (s)
+                {
+                    submission * const next = s->m_next;
+                    delete s;
+                    s = next;
+                }
+                if (m_fd[0] != -1)
+                    ::close(m_fd[0]);
+                if (m_fd[1] != -1 && m_fd[1] != m_fd[0])
+                    ::close(m_fd[1]);
+            }
+
+            bool open()
+            {
+#if defined(HAVE_SYS_EVENTFD_H)
+                m_fd[0] = m_fd[1] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                return (m_fd[0] != -1);
+#else
+                if (::pipe(m_fd) != 0)
+                {
+                    m_fd[0] = m_fd[1] = -1;
+                    return false;
+                }
+                ::fcntl(m_fd[0], F_SETFL, O_NONBLOCK);
+                ::fcntl(m_fd[1], F_SETFL, O_NONBLOCK);
+                ::fcntl(m_fd[0], F_SETFD, FD_CLOEXEC);
+                ::fcntl(m_fd[1], F_SETFD, FD_CLOEXEC);
+                return true;
+#endif
+            }
+
+            int fd() const
+            {
+                return m_fd[0];
+            }
+
+            bool pending() const
+            {
+                return (m_head != 0);
+            }
+
+            // called by any thread
+            void push(submission * const s)
+            {
+                submission * head;
+                do
+                {
+                    head = m_head;
+                    s->m_next = head;
+                } while (! __sync_bool_compare_and_swap(&m_head, head, s));
+                if (head == 0)
+                {
+#if defined(HAVE_SYS_EVENTFD_H)
+                    uint64_t const value = 1;
+#else
+                    char const value = 0;
+#endif
+                    ssize_t const i = ::write(m_fd[1], &value, sizeof(value));
+                    (void) i; // EAGAIN means a wake is already pending
+                }
+            }
+
+            // called by the polling thread, provides the submissions
+            // in the order they were pushed
+            submission * take()
+            {
+                // the wake is consumed before the list is taken so a push
+                // after the list is taken always writes a new wake
+                if (m_fd[0] != -1)
+                {
+#if defined(HAVE_SYS_EVENTFD_H)
+                    uint64_t value;
+#else
+                    char value[64];
+#endif
+                    while (::read(m_fd[0], &value, sizeof(value)) > 0)
+                    {
+                    }
+                }
+                submission * s = __sync_lock_test_and_set(&m_head,
+                    static_cast<submission *>(0));
+                submission * ordered = 0;
+                while (s)
+                {
+                    submission * const next = s->m_next;
+                    s->m_next = ordered;
+                    ordered = s;
+                    s = next;
+                }
+                return ordered;
+            }
+
+            static submission * next(submission * const s)
+            {
+                submission * const result = s->m_next;
+                delete s;
+                return result;
+            }
+
+        private:
+            submission * volatile m_head;
+            int m_fd[2];
+    };
+
+} // anonymous namespace
+
+extern "C" {
+
+static void exit_handler()
+{
+    ::fflush(stdout);
+    ::fflush(stderr);
+    std::cout.flush();
+    std::cerr.flush();
+    std::clog.flush();
+}
+
+static void exception_unknown()
+{
+    std::cerr << backtrace_string();
+    ::abort();
+}
+
+static int poll_request(cloudi_instance_t * p,
+                        int timeout,
+                        int external);
+
+// the logical processor planned for the thread_index by the
+// CLOUDI_API_INIT_AFFINITY comma separated list (set by the
+// affinity service configuration option)
+static int thread_affinity_cpu(unsigned int const thread_index)
+{
+    char const * p = ::getenv("CLOUDI_API_INIT_AFFINITY");
+    if (p == 0)
+        return -1;
+    for (unsigned int i = 0; i < thread_index; ++i)
+    {
+        p = ::strchr(p, ',');
+        if (p == 0)
+            return -1;
+        ++p;
+    }
+    char * end;
+    long const cpu = ::strtol(p, &end, 10);
+    if (end == p || cpu < 0 || cpu > INT_MAX)
+        return -1;
+    return static_cast<int>(cpu);
+}
+
+// a negative cpu (no logical processor planned) leaves the thread unpinned
+static int thread_affinity_set(int const cpu)
+{
+    if (cpu < 0)
+        return cloudi_success;
+#if defined(CPU_SETSIZE)
+    if (cpu >= CPU_SETSIZE)
+        return cloudi_invalid_input;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // e.g., cpu is not available within the current cpuset
+    if (::sched_setaffinity(0, sizeof(set), &set) == -1)
+        return cloudi_invalid_input;
+    return cloudi_success;
+#else
+    return cloudi_invalid_input;
+#endif
+}
+
+int cloudi_initialize(cloudi_instance_t * p,
+                      unsigned int const thread_index)
 {
     if (p == 0)
         return cloudi_out_of_memory;
@@ -552,6 +2311,14 @@ int cloudi_initialize(cloudi_instance_t * p,
         p->fd_in = p->fd_out = thread_index + 3;
         p->use_header = 1;
     }
+    else if (::strcmp(protocol, "shm") == 0)
+    {
+        p->fd_in = p->fd_out = thread_index + 3;
+        p->use_header = 1;
+        int const result = shm_attach(p->fd_in, p->shm);
+        if (result)
+            return result;
+    }
     else
     {
         //p->fd_in = p->fd_out = 0; // uninitialized
@@ -561,12 +2328,15 @@ int cloudi_initialize(cloudi_instance_t * p,
     //p->terminate = 0;
     p->buffer_size = buffer_size;
     p->lookup = new lookup_t();
+    p->futures = new future_lookup();
+    p->buffer_trim = new buffer_trim();
+    p->streams = new stream_lookup();
+    p->stats = new request_stats();
     p->buffer_send = new buffer_t(32768, CLOUDI_MAX_BUFFERSIZE);
     p->buffer_recv = new buffer_t(32768, CLOUDI_MAX_BUFFERSIZE);
     //p->buffer_recv_index = 0;
     p->buffer_call = new buffer_t(32768, CLOUDI_MAX_BUFFERSIZE);
     p->poll_timer = new timer();
-    p->request_timer = new timer();
     //p->prefix = 0;
     p->timeout_terminate = 1000; // TIMEOUT_TERMINATE_MIN
 
@@ -578,9 +2348,9 @@ int cloudi_initialize(cloudi_instance_t * p,
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, "init"))
+    // request the binary framing of the send, forward and return commands
+    protocol_encode_command(buffer.get<char>(), index, "init", 2);
+    if (ei_encode_atom(buffer.get<char>(), &index, "binary"))
         return cloudi_error_ei_encode;
     int result = write_exact(p->fd_out, p->use_header,
                              buffer.get<char>(), index);
@@ -604,11 +2374,16 @@ void cloudi_destroy(cloudi_instance_t * p)
         if (p->fd_in != p->fd_out)
             ::close(p->fd_out);
         delete reinterpret_cast<lookup_t *>(p->lookup);
+        delete reinterpret_cast<future_lookup *>(p->futures);
+        delete reinterpret_cast<buffer_trim *>(p->buffer_trim);
+        delete reinterpret_cast<stream_lookup *>(p->streams);
+        delete reinterpret_cast<request_stats *>(p->stats);
+        delete reinterpret_cast<submit_queue *>(p->submit);
         delete reinterpret_cast<buffer_t *>(p->buffer_send);
         delete reinterpret_cast<buffer_t *>(p->buffer_recv);
         delete reinterpret_cast<buffer_t *>(p->buffer_call);
         delete reinterpret_cast<timer *>(p->poll_timer);
-        delete reinterpret_cast<timer *>(p->request_timer);
+        delete reinterpret_cast<shm_t *>(p->shm);
         if (p->prefix)
             delete [] p->prefix;
     }
@@ -626,27 +2401,61 @@ int cloudi_initialize_thread_count(unsigned int * const thread_count)
     return cloudi_success;
 }
 
+int cloudi_initialize_thread_affinity(unsigned int const thread_index,
+                                      int * const cpu)
+{
+    if (cpu == 0)
+        return cloudi_invalid_input;
+    *cpu = thread_affinity_cpu(thread_index);
+    return cloudi_success;
+}
+
+// pin the calling thread (called by the thread that uses the instance,
+// before cloudi_initialize allocates the buffers, so the first touch of
+// the buffer memory occurs on the local NUMA node), cloudi_invalid_input
+// is returned if the thread could not be pinned
+int cloudi_initialize_thread_affinity_set(unsigned int const thread_index)
+{
+    return thread_affinity_set(thread_affinity_cpu(thread_index));
+}
+
+// write an outgoing request or response (with the payload iovec data)
+static int write_payload(cloudi_instance_t * p,
+                         timer const & write_timer,
+                         struct iovec * iov, int iovcnt,
+                         uint32_t const length)
+{
+    int const result = write_exact(p->fd_out, p->use_header,
+                                   reinterpret_cast<shm_t *>(p->shm),
+                                   iov, iovcnt, length);
+    if (result == cloudi_success)
+    {
+        request_stats & stats = *reinterpret_cast<request_stats *>(p->stats);
+        stats.write(write_timer.elapsed_nanoseconds(), length);
+    }
+    return result;
+}
+
 static int cloudi_subscribe_(cloudi_instance_t * p,
                              char const * const pattern,
                              callback_function const & f)
 {
     lookup_t & lookup = *reinterpret_cast<lookup_t *>(p->lookup);
-    lookup.insert(std::string(p->prefix) + pattern, f);
+    uint32_t const callback_id =
+        lookup.insert(std::string(p->prefix) + pattern, f);
 
     buffer_t & buffer = *reinterpret_cast<buffer_t *>(p->buffer_send);
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_tuple_header(buffer.get<char>(), &index, 2))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, "subscribe"))
-        return cloudi_error_ei_encode;
+    // cloudi_core provides the callback id with each service request
+    protocol_encode_command(buffer.get<char>(), index, "subscribe", 3);
     if (buffer.reserve(index + strlen(pattern) + 128) == false)
         return cloudi_error_write_overflow;
     if (ei_encode_string(buffer.get<char>(), &index, pattern))
         return cloudi_error_ei_encode;
+    if (ei_encode_ulong(buffer.get<char>(), &index, callback_id))
+        return cloudi_error_ei_encode;
     int result = write_exact(p->fd_out, p->use_header,
                              buffer.get<char>(), index);
     if (result)
@@ -663,6 +2472,32 @@ int cloudi_subscribe(cloudi_instance_t * p,
                              callback_function(p, f));
 }
 
+static int cloudi_subscribe_batch_(cloudi_instance_t * p,
+                                   char const * const pattern,
+                                   CloudI::API::batch_function_generic * f,
+                                   uint32_t const batch_max)
+{
+    if (batch_max == 0)
+    {
+        delete f;
+        return cloudi_error_function_parameter;
+    }
+    batch_function * const batch = new batch_function(f, batch_max);
+    return cloudi_subscribe_(p, pattern,
+                             callback_function(batch, batch));
+}
+
+int cloudi_subscribe_batch(cloudi_instance_t * p,
+                           char const * const pattern,
+                           cloudi_batch_t f,
+                           uint32_t const batch_max)
+{
+    return cloudi_subscribe_batch_(p,
+                                   pattern,
+                                   new batch_function_c(p, f),
+                                   batch_max);
+}
+
 int cloudi_subscribe_count(cloudi_instance_t * p,
                            char const * const pattern)
 {
@@ -670,12 +2505,7 @@ int cloudi_subscribe_count(cloudi_instance_t * p,
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_tuple_header(buffer.get<char>(), &index, 2))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, "subscribe_count"))
-        return cloudi_error_ei_encode;
+    protocol_encode_command(buffer.get<char>(), index, "subscribe_count", 2);
     if (buffer.reserve(index + strlen(pattern) + 128) == false)
         return cloudi_error_write_overflow;
     if (ei_encode_string(buffer.get<char>(), &index, pattern))
@@ -702,12 +2532,7 @@ int cloudi_unsubscribe(cloudi_instance_t * p,
         int index = 0;
         if (p->use_header)
             index = 4;
-        if (ei_encode_version(buffer.get<char>(), &index))
-            return cloudi_error_ei_encode;
-        if (ei_encode_tuple_header(buffer.get<char>(), &index, 2))
-            return cloudi_error_ei_encode;
-        if (ei_encode_atom(buffer.get<char>(), &index, "unsubscribe"))
-            return cloudi_error_ei_encode;
+        protocol_encode_command(buffer.get<char>(), index, "unsubscribe", 2);
         if (buffer.reserve(index + strlen(pattern) + 128) == false)
             return cloudi_error_write_overflow;
         if (ei_encode_string(buffer.get<char>(), &index, pattern))
@@ -725,7 +2550,7 @@ int cloudi_unsubscribe(cloudi_instance_t * p,
 }
 
 static int cloudi_send_(cloudi_instance_t * p,
-                        char const * const command_name,
+                        uint8_t const command,
                         char const * const name,
                         void const * const request_info,
                         uint32_t const request_info_size,
@@ -734,37 +2559,47 @@ static int cloudi_send_(cloudi_instance_t * p,
                         uint32_t timeout,
                         int8_t const priority)
 {
+    timer write_timer;
     buffer_t & buffer = *reinterpret_cast<buffer_t *>(p->buffer_send);
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_tuple_header(buffer.get<char>(), &index, 6))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, command_name))
-        return cloudi_error_ei_encode;
-    if (buffer.reserve(index + strlen(name) +
-                       request_info_size + request_size + 128) == false)
+    timeout = timeout_limit(p, timeout);
+    uint32_t const name_size = strlen(name);
+    if (buffer.reserve(index + name_size + 128) == false)
         return cloudi_error_write_overflow;
-    if (ei_encode_string(buffer.get<char>(), &index, name))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index,
-                         request_info, request_info_size))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index, request, request_size))
-        return cloudi_error_ei_encode;
-    if (ei_encode_ulong(buffer.get<char>(), &index, timeout))
-        return cloudi_error_ei_encode;
-    if (ei_encode_long(buffer.get<char>(), &index, priority))
-        return cloudi_error_ei_encode;
-    int result = write_exact(p->fd_out, p->use_header,
-                             buffer.get<char>(), index);
+    protocol_encoder encoder(buffer.get<char>(), index);
+    encoder.put(command);
+    encoder.put(timeout);
+    encoder.put(priority);
+    encoder.put(name_size);
+    encoder.put(request_info_size);
+    encoder.put(request_size);
+    encoder.put(name, name_size);
+    index = encoder.index();
+    int const index_request_info = index;
+    int const index_request = index;
+    struct iovec iov[5];
+    uint32_t length;
+    int const iovcnt = frame_iovec(iov, buffer.get<char>(),
+                                   index_request_info,
+                                   request_info, request_info_size,
+                                   index_request,
+                                   request, request_size,
+                                   index, length);
+    if (iovcnt == 0)
+        return cloudi_error_write_overflow;
+    int result = write_payload(p, write_timer, iov, iovcnt, length);
     if (result)
         return result;
     result = poll_request(p, -1, 0);
     if (result)
         return result;
+    if (command == COMMAND_SEND_SYNC)
+    {
+        request_stats & stats = *reinterpret_cast<request_stats *>(p->stats);
+        stats.send_sync(write_timer.elapsed_nanoseconds());
+    }
     return cloudi_success;
 }
 
@@ -773,7 +2608,7 @@ int cloudi_send_async(cloudi_instance_t * p,
                       void const * const request,
                       uint32_t const request_size)
 {
-    return cloudi_send_(p, "send_async", name, "", 0,
+    return cloudi_send_(p, COMMAND_SEND_ASYNC, name, "", 0,
                         request, request_size,
                         p->timeout_async, p->priority_default);
 }
@@ -789,17 +2624,90 @@ int cloudi_send_async_(cloudi_instance_t * p,
 {
     if (timeout == 0)
         timeout = p->timeout_async;
-    return cloudi_send_(p, "send_async", name,
+    return cloudi_send_(p, COMMAND_SEND_ASYNC, name,
                         request_info, request_info_size,
                         request, request_size, timeout, priority);
 }
 
+int cloudi_send_async_batch(cloudi_instance_t * p,
+                            cloudi_send_async_batch_t const * const requests,
+                            uint32_t const requests_count)
+{
+    if (requests == 0 && requests_count > 0)
+        return cloudi_error_function_parameter;
+    timer write_timer;
+    size_t names_size = 0;
+    for (uint32_t i = 0; i < requests_count; ++i)
+        names_size += strlen(requests[i].name);
+    buffer_t & buffer = *reinterpret_cast<buffer_t *>(p->buffer_send);
+    // the buffer must not be reallocated after the iovec data is stored
+    if (buffer.reserve(names_size + 64 * requests_count + 128) == false)
+        return cloudi_error_write_overflow;
+    realloc_ptr<struct iovec> iov(4 * requests_count + 1,
+                                  4 * requests_count + 1);
+    int iovcnt = 0;
+    uint64_t length = 0;
+    int index = 0;
+    if (p->use_header)
+        index = 4;
+    protocol_encode_command(buffer.get<char>(), index, "send_async_batch", 2);
+    if (ei_encode_list_header(buffer.get<char>(), &index, requests_count))
+        return cloudi_error_ei_encode;
+    int index_segment = 0;
+    for (uint32_t i = 0; i < requests_count; ++i)
+    {
+        cloudi_send_async_batch_t const & request = requests[i];
+        uint32_t timeout = request.timeout;
+        if (timeout == 0)
+            timeout = p->timeout_async;
+        timeout = timeout_limit(p, timeout);
+        if (ei_encode_tuple_header(buffer.get<char>(), &index, 5))
+            return cloudi_error_ei_encode;
+        if (ei_encode_string(buffer.get<char>(), &index, request.name))
+            return cloudi_error_ei_encode;
+        encode_binary_header(buffer.get<char>(), index,
+                             request.request_info_size);
+        iov[iovcnt].iov_base = &buffer[index_segment];
+        iov[iovcnt++].iov_len = index - index_segment;
+        iov[iovcnt].iov_base = const_cast<void *>(request.request_info);
+        iov[iovcnt++].iov_len = request.request_info_size;
+        index_segment = index;
+        encode_binary_header(buffer.get<char>(), index,
+                             request.request_size);
+        iov[iovcnt].iov_base = &buffer[index_segment];
+        iov[iovcnt++].iov_len = index - index_segment;
+        iov[iovcnt].iov_base = const_cast<void *>(request.request);
+        iov[iovcnt++].iov_len = request.request_size;
+        index_segment = index;
+        if (ei_encode_ulong(buffer.get<char>(), &index, timeout))
+            return cloudi_error_ei_encode;
+        if (ei_encode_long(buffer.get<char>(), &index, request.priority))
+            return cloudi_error_ei_encode;
+        length += request.request_info_size + request.request_size;
+    }
+    if (ei_encode_empty_list(buffer.get<char>(), &index))
+        return cloudi_error_ei_encode;
+    iov[iovcnt].iov_base = &buffer[index_segment];
+    iov[iovcnt++].iov_len = index - index_segment;
+    length += index;
+    if (length > CLOUDI_MAX_BUFFERSIZE)
+        return cloudi_error_write_overflow;
+    int result = write_payload(p, write_timer, iov.get(), iovcnt,
+                               static_cast<uint32_t>(length));
+    if (result)
+        return result;
+    result = poll_request(p, -1, 0);
+    if (result)
+        return result;
+    return cloudi_success;
+}
+
 int cloudi_send_sync(cloudi_instance_t * p,
                      char const * const name,
                      void const * const request,
                      uint32_t const request_size)
 {
-    return cloudi_send_(p, "send_sync", name, "", 0,
+    return cloudi_send_(p, COMMAND_SEND_SYNC, name, "", 0,
                         request, request_size,
                         p->timeout_sync, p->priority_default);
 }
@@ -815,7 +2723,7 @@ int cloudi_send_sync_(cloudi_instance_t * p,
 {
     if (timeout == 0)
         timeout = p->timeout_sync;
-    return cloudi_send_(p, "send_sync", name,
+    return cloudi_send_(p, COMMAND_SEND_SYNC, name,
                         request_info, request_info_size,
                         request, request_size, timeout, priority);
 }
@@ -825,7 +2733,7 @@ int cloudi_mcast_async(cloudi_instance_t * p,
                        void const * const request,
                        uint32_t const request_size)
 {
-    return cloudi_send_(p, "mcast_async", name, "", 0,
+    return cloudi_send_(p, COMMAND_MCAST_ASYNC, name, "", 0,
                         request, request_size,
                         p->timeout_async, p->priority_default);
 }
@@ -841,13 +2749,13 @@ int cloudi_mcast_async_(cloudi_instance_t * p,
 {
     if (timeout == 0)
         timeout = p->timeout_async;
-    return cloudi_send_(p, "mcast_async", name,
+    return cloudi_send_(p, COMMAND_MCAST_ASYNC, name,
                         request_info, request_info_size,
                         request, request_size, timeout, priority);
 }
 
 static int cloudi_forward_(cloudi_instance_t * p,
-                           char const * const command_name,
+                           uint8_t const command,
                            char const * const name,
                            void const * const request_info,
                            uint32_t const request_info_size,
@@ -859,56 +2767,40 @@ static int cloudi_forward_(cloudi_instance_t * p,
                            char const * const pid,
                            uint32_t const pid_size)
 {
+    timer write_timer;
     buffer_t & buffer = *reinterpret_cast<buffer_t *>(p->buffer_send);
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (p->request_timeout_adjustment &&
-        timeout == p->request_timeout)
-    {
-        timer & request_timer = *reinterpret_cast<timer *>(p->request_timer);
-        uint32_t const elapsed = static_cast<uint32_t>(
-            std::max(0, static_cast<int>(request_timer.elapsed() * 1000.0)));
-        if (elapsed > timeout)
-        {
-            timeout = 0;
-        }
-        else
-        {
-            timeout -= elapsed;
-        }
-    }
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_tuple_header(buffer.get<char>(), &index, 8))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, command_name))
-        return cloudi_error_ei_encode;
-    if (buffer.reserve(index + strlen(name) +
-                       request_info_size + request_size + 128) == false)
+    timeout_adjust(p, timeout);
+    uint32_t const name_size = strlen(name);
+    if (buffer.reserve(index + name_size + pid_size + 128) == false)
         return cloudi_error_write_overflow;
-    if (ei_encode_string(buffer.get<char>(), &index, name))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index,
-                         request_info, request_info_size))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index, request, request_size))
-        return cloudi_error_ei_encode;
-    if (ei_encode_ulong(buffer.get<char>(), &index, timeout))
-        return cloudi_error_ei_encode;
-    if (ei_encode_long(buffer.get<char>(), &index, priority))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index, trans_id, 16))
-        return cloudi_error_ei_encode;
-    int version;
-    int pid_index = 0;
-    if (ei_decode_version(pid, &pid_index, &version))
-        return cloudi_error_ei_decode;
-    int const pid_data_size = pid_size - pid_index;
-    ::memcpy(&(buffer[index]), &(pid[pid_index]), pid_data_size);
-    index += pid_data_size;
-    return write_exact(p->fd_out, p->use_header,
-                       buffer.get<char>(), index);
+    protocol_encoder encoder(buffer.get<char>(), index);
+    encoder.put(command);
+    encoder.put(timeout);
+    encoder.put(priority);
+    encoder.put(trans_id, 16);
+    encoder.put(name_size);
+    encoder.put(request_info_size);
+    encoder.put(request_size);
+    encoder.put(pid_size);
+    encoder.put(name, name_size);
+    int const index_request_info = encoder.index();
+    int const index_request = index_request_info;
+    encoder.put(pid, pid_size);
+    index = encoder.index();
+    struct iovec iov[5];
+    uint32_t length;
+    int const iovcnt = frame_iovec(iov, buffer.get<char>(),
+                                   index_request_info,
+                                   request_info, request_info_size,
+                                   index_request,
+                                   request, request_size,
+                                   index, length);
+    if (iovcnt == 0)
+        return cloudi_error_write_overflow;
+    return write_payload(p, write_timer, iov, iovcnt, length);
 }
 
 int cloudi_forward(cloudi_instance_t * p,
@@ -927,29 +2819,23 @@ int cloudi_forward(cloudi_instance_t * p,
     int result;
     if (command == CLOUDI_ASYNC)
     {
-        result = cloudi_forward_(p,
-                                 "forward_async", name,
-                                 request_info, request_info_size,
-                                 request, request_size,
-                                 timeout, priority,
-                                 trans_id, pid, pid_size);
-        if (result == cloudi_success)
-        {
-            throw CloudI::API::forward_async_exception();
-        }
+        result = callback_returned<CloudI::API::forward_async_exception>(p,
+            cloudi_forward_(p,
+                            COMMAND_FORWARD_ASYNC, name,
+                            request_info, request_info_size,
+                            request, request_size,
+                            timeout, priority,
+                            trans_id, pid, pid_size));
     }
     else if (command == CLOUDI_SYNC)
     {
-        result = cloudi_forward_(p,
-                                 "forward_sync", name,
-                                 request_info, request_info_size,
-                                 request, request_size,
-                                 timeout, priority,
-                                 trans_id, pid, pid_size);
-        if (result == cloudi_success)
-        {
-            throw CloudI::API::forward_sync_exception();
-        }
+        result = callback_returned<CloudI::API::forward_sync_exception>(p,
+            cloudi_forward_(p,
+                            COMMAND_FORWARD_SYNC, name,
+                            request_info, request_info_size,
+                            request, request_size,
+                            timeout, priority,
+                            trans_id, pid, pid_size));
     }
     else
     {
@@ -970,17 +2856,13 @@ int cloudi_forward_async(cloudi_instance_t * p,
                          char const * const pid,
                          uint32_t const pid_size)
 {
-    int result = cloudi_forward_(p,
-                                 "forward_async", name,
-                                 request_info, request_info_size,
-                                 request, request_size,
-                                 timeout, priority,
-                                 trans_id, pid, pid_size);
-    if (result == cloudi_success)
-    {
-        throw CloudI::API::forward_async_exception();
-    }
-    return result;
+    return callback_returned<CloudI::API::forward_async_exception>(p,
+        cloudi_forward_(p,
+                        COMMAND_FORWARD_ASYNC, name,
+                        request_info, request_info_size,
+                        request, request_size,
+                        timeout, priority,
+                        trans_id, pid, pid_size));
 }
 
 int cloudi_forward_sync(cloudi_instance_t * p,
@@ -995,21 +2877,54 @@ int cloudi_forward_sync(cloudi_instance_t * p,
                         char const * const pid,
                         uint32_t const pid_size)
 {
-    int result = cloudi_forward_(p,
-                                 "forward_sync", name,
-                                 request_info, request_info_size,
-                                 request, request_size,
-                                 timeout, priority,
-                                 trans_id, pid, pid_size);
-    if (result == cloudi_success)
-    {
-        throw CloudI::API::forward_sync_exception();
-    }
-    return result;
+    return callback_returned<CloudI::API::forward_sync_exception>(p,
+        cloudi_forward_(p,
+                        COMMAND_FORWARD_SYNC, name,
+                        request_info, request_info_size,
+                        request, request_size,
+                        timeout, priority,
+                        trans_id, pid, pid_size));
+}
+
+// encode a return frame at index (the response_info and response
+// payloads are provided separately with an iovec at index_response)
+static int return_encode(buffer_t & buffer,
+                         int & index,
+                         int & index_response,
+                         uint8_t const command,
+                         char const * const name,
+                         char const * const pattern,
+                         uint32_t const response_info_size,
+                         uint32_t const response_size,
+                         uint32_t const timeout,
+                         char const * const trans_id,
+                         char const * const pid,
+                         uint32_t const pid_size)
+{
+    uint32_t const name_size = strlen(name);
+    uint32_t const pattern_size = strlen(pattern);
+    if (buffer.reserve(index + name_size + pattern_size +
+                       pid_size + 128) == false)
+        return cloudi_error_write_overflow;
+    protocol_encoder encoder(buffer.get<char>(), index);
+    encoder.put(command);
+    encoder.put(timeout);
+    encoder.put(trans_id, 16);
+    encoder.put(name_size);
+    encoder.put(pattern_size);
+    encoder.put(response_info_size);
+    encoder.put(response_size);
+    encoder.put(pid_size);
+    encoder.put(name, name_size);
+    encoder.put(pattern, pattern_size);
+    index_response = encoder.index();
+    encoder.put(pid, pid_size);
+    index = encoder.index();
+    return cloudi_success;
 }
 
 static int cloudi_return_(cloudi_instance_t * p,
-                          char const * const command_name,
+                          uint8_t const command,
                           char const * const name,
                           char const * const pattern,
                           void const * const response_info,
@@ -1021,58 +2936,35 @@ static int cloudi_return_(cloudi_instance_t * p,
                           char const * const pid,
                           uint32_t const pid_size)
 {
+    timer write_timer;
     buffer_t & buffer = *reinterpret_cast<buffer_t *>(p->buffer_send);
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (p->request_timeout_adjustment &&
-        timeout == p->request_timeout)
+    if (timeout_adjust(p, timeout) && timeout == 0)
     {
-        timer & request_timer = *reinterpret_cast<timer *>(p->request_timer);
-        uint32_t const elapsed = static_cast<uint32_t>(
-            std::max(0, static_cast<int>(request_timer.elapsed() * 1000.0)));
-        if (elapsed > timeout)
-        {
-            response_info_size = 0;
-            response_size = 0;
-            timeout = 0;
-        }
-        else
-        {
-            timeout -= elapsed;
-        }
+        // the caller no longer waits for the response
+        response_info_size = 0;
+        response_size = 0;
     }
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_tuple_header(buffer.get<char>(), &index, 8))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, command_name))
-        return cloudi_error_ei_encode;
-    if (buffer.reserve(index + strlen(name) + strlen(pattern) +
-                       response_info_size + response_size + 128) == false)
+    int index_response;
+    int const result = return_encode(buffer, index, index_response,
+                                     command, name, pattern,
+                                     response_info_size, response_size,
+                                     timeout, trans_id, pid, pid_size);
+    if (result)
+        return result;
+    struct iovec iov[5];
+    uint32_t length;
+    int const iovcnt = frame_iovec(iov, buffer.get<char>(),
+                                   index_response,
+                                   response_info, response_info_size,
+                                   index_response,
+                                   response, response_size,
+                                   index, length);
+    if (iovcnt == 0)
         return cloudi_error_write_overflow;
-    if (ei_encode_string(buffer.get<char>(), &index, name))
-        return cloudi_error_ei_encode;
-    if (ei_encode_string(buffer.get<char>(), &index, pattern))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index,
-                         response_info, response_info_size))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index, response, response_size))
-        return cloudi_error_ei_encode;
-    if (ei_encode_ulong(buffer.get<char>(), &index, timeout))
-        return cloudi_error_ei_encode;
-    if (ei_encode_binary(buffer.get<char>(), &index, trans_id, 16))
-        return cloudi_error_ei_encode;
-    int version;
-    int pid_index = 0;
-    if (ei_decode_version(pid, &pid_index, &version))
-        return cloudi_error_ei_decode;
-    int const pid_data_size = pid_size - pid_index;
-    ::memcpy(&(buffer[index]), &(pid[pid_index]), pid_data_size);
-    index += pid_data_size;
-    return write_exact(p->fd_out, p->use_header,
-                       buffer.get<char>(), index);
+    return write_payload(p, write_timer, iov, iovcnt, length);
 }
 
 int cloudi_return(cloudi_instance_t * p,
@@ -1088,85 +2980,289 @@ int cloudi_return(cloudi_instance_t * p,
                   char const * const pid,
                   uint32_t const pid_size)
 {
-    int result;
+    int result;
+    if (command == CLOUDI_ASYNC)
+    {
+        result = callback_returned<CloudI::API::return_async_exception>(p,
+            cloudi_return_(p,
+                           COMMAND_RETURN_ASYNC, name, pattern,
+                           response_info, response_info_size,
+                           response, response_size,
+                           timeout, trans_id, pid, pid_size));
+    }
+    else if (command == CLOUDI_SYNC)
+    {
+        result = callback_returned<CloudI::API::return_sync_exception>(p,
+            cloudi_return_(p,
+                           COMMAND_RETURN_SYNC, name, pattern,
+                           response_info, response_info_size,
+                           response, response_size,
+                           timeout, trans_id, pid, pid_size));
+    }
+    else
+    {
+        result = cloudi_error_function_parameter;
+    }
+    return result;
+}
+
+int cloudi_return_async(cloudi_instance_t * p,
+                        char const * const name,
+                        char const * const pattern,
+                        void const * const response_info,
+                        uint32_t const response_info_size,
+                        void const * const response,
+                        uint32_t const response_size,
+                        uint32_t timeout,
+                        char const * const trans_id,
+                        char const * const pid,
+                        uint32_t const pid_size)
+{
+    return callback_returned<CloudI::API::return_async_exception>(p,
+        cloudi_return_(p,
+                       COMMAND_RETURN_ASYNC, name, pattern,
+                       response_info, response_info_size,
+                       response, response_size,
+                       timeout, trans_id, pid, pid_size));
+}
+
+int cloudi_return_sync(cloudi_instance_t * p,
+                       char const * const name,
+                       char const * const pattern,
+                       void const * const response_info,
+                       uint32_t const response_info_size,
+                       void const * const response,
+                       uint32_t const response_size,
+                       uint32_t timeout,
+                       char const * const trans_id,
+                       char const * const pid,
+                       uint32_t const pid_size)
+{
+    return callback_returned<CloudI::API::return_sync_exception>(p,
+        cloudi_return_(p,
+                       COMMAND_RETURN_SYNC,
+                       name, pattern,
+                       response_info, response_info_size,
+                       response, response_size,
+                       timeout, trans_id, pid, pid_size));
+}
+
+// write the return frames of a batch with a single writev call
+// (if the frames are not provided as separate datagrams or
+//  stored in the shm protocol shared memory)
+static int return_batch(cloudi_instance_t * p,
+                        batch_state & batch,
+                        cloudi_batch_response_t const * const responses)
+{
+    timer write_timer;
+    buffer_t & buffer = *reinterpret_cast<buffer_t *>(p->buffer_send);
+    cloudi_batch_request_t const * const requests = batch.requests();
+    uint32_t const count = batch.size();
+    uint32_t elapsed = 0;
+    if (p->request_timeout_adjustment)
+    {
+        elapsed = static_cast<uint32_t>(
+            std::min(clock_milliseconds() - batch.received(),
+                     static_cast<uint64_t>(0xffffffff)));
+    }
+    std::vector<int> frame_start(count);
+    std::vector<int> frame_response(count);
+    std::vector<int> frame_end(count);
+    std::vector<cloudi_batch_response_t> frame_payload(responses,
+                                                       responses + count);
+    int index = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        cloudi_batch_request_t const & request = requests[i];
+        cloudi_batch_response_t & payload = frame_payload[i];
+        uint32_t timeout = request.timeout;
+        if (p->request_timeout_adjustment)
+        {
+            if (elapsed > timeout)
+            {
+                payload.response_info_size = 0;
+                payload.response_size = 0;
+                timeout = 0;
+            }
+            else
+            {
+                timeout -= elapsed;
+            }
+        }
+        frame_start[i] = index;
+        if (p->use_header)
+            index += 4;
+        int const result = return_encode(buffer, index, frame_response[i],
+                                         (request.command == CLOUDI_ASYNC) ?
+                                         COMMAND_RETURN_ASYNC :
+                                         COMMAND_RETURN_SYNC,
+                                         request.name, request.pattern,
+                                         payload.response_info_size,
+                                         payload.response_size,
+                                         timeout, request.trans_id,
+                                         request.pid, request.pid_size);
+        if (result)
+            return result;
+        frame_end[i] = index;
+    }
+    // the buffer is not reallocated after the encoding
+    std::vector<struct iovec> iov(count * 5);
+    std::vector<uint32_t> length(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        cloudi_batch_response_t const & payload = frame_payload[i];
+        int const start = frame_start[i];
+        if (frame_iovec(&iov[i * 5], &(buffer.get<char>()[start]),
+                        frame_response[i] - start,
+                        payload.response_info, payload.response_info_size,
+                        frame_response[i] - start,
+                        payload.response, payload.response_size,
+                        frame_end[i] - start, length[i]) == 0)
+            return cloudi_error_write_overflow;
+    }
+    if (! p->use_header || p->shm)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            int const result = write_payload(p, write_timer,
+                                             &iov[i * 5], 5, length[i]);
+            if (result)
+                return result;
+        }
+        return cloudi_success;
+    }
+    request_stats & stats = *reinterpret_cast<request_stats *>(p->stats);
+    uint32_t const frames_max = IOV_MAX / 5;
+    for (uint32_t i = 0; i < count; i += frames_max)
+    {
+        uint32_t const frames = std::min(count - i, frames_max);
+        uint32_t total = 0;
+        for (uint32_t j = i; j < i + frames; ++j)
+        {
+            char * const header = &(buffer.get<char>()[frame_start[j]]);
+            uint32_t const length_body = length[j] - 4;
+            header[0] = (length_body & 0xff000000) >> 24;
+            header[1] = (length_body & 0x00ff0000) >> 16;
+            header[2] = (length_body & 0x0000ff00) >> 8;
+            header[3] =  length_body & 0x000000ff;
+            total += length[j];
+        }
+        // the frame headers are already set
+        int const result = write_exact(p->fd_out, 0, 0,
+                                       &iov[i * 5], frames * 5, total);
+        if (result)
+            return result;
+        uint64_t const write_elapsed = write_timer.elapsed_nanoseconds();
+        for (uint32_t j = i; j < i + frames; ++j)
+            stats.write(write_elapsed / frames, length[j]);
+        write_timer.restart();
+    }
+    return cloudi_success;
+}
+
+int cloudi_return_nothrow(cloudi_instance_t * p,
+                          int const enable)
+{
+    p->return_nothrow = enable ? 1 : 0;
+    return cloudi_success;
+}
+
+uint32_t cloudi_timeout_remaining(cloudi_instance_t * p)
+{
+    if (p->request_deadline == 0)
+        return 0;
+    return timeout_remaining(p->request_deadline);
+}
+
+int cloudi_submit_enable(cloudi_instance_t * p)
+{
+    if (p->submit)
+        return cloudi_success;
+    submit_queue * const submit = new submit_queue();
+    if (! submit->open())
+    {
+        delete submit;
+        return cloudi_error_function_parameter;
+    }
+    p->submit = submit;
+    return cloudi_success;
+}
+
+int cloudi_submit_send_async(cloudi_instance_t * p,
+                             char const * const name,
+                             void const * const request_info,
+                             uint32_t const request_info_size,
+                             void const * const request,
+                             uint32_t const request_size,
+                             uint32_t timeout,
+                             int8_t const priority)
+{
+    submit_queue * const submit = reinterpret_cast<submit_queue *>(p->submit);
+    if (submit == 0)
+        return cloudi_error_function_parameter;
+    if (timeout == 0)
+        timeout = p->timeout_async;
+    submit->push(new submit_queue::submission(COMMAND_SEND_ASYNC,
+                                              name, 0,
+                                              request_info,
+                                              request_info_size,
+                                              request, request_size,
+                                              timeout, priority,
+                                              0, 0, 0));
+    return cloudi_success;
+}
+
+int cloudi_submit_return(cloudi_instance_t * p,
+                         int const command,
+                         char const * const name,
+                         char const * const pattern,
+                         void const * const response_info,
+                         uint32_t const response_info_size,
+                         void const * const response,
+                         uint32_t const response_size,
+                         uint32_t timeout,
+                         char const * const trans_id,
+                         char const * const pid,
+                         uint32_t const pid_size)
+{
+    submit_queue * const submit = reinterpret_cast<submit_queue *>(p->submit);
+    if (submit == 0)
+        return cloudi_error_function_parameter;
+    uint8_t return_command;
     if (command == CLOUDI_ASYNC)
-    {
-        result = cloudi_return_(p,
-                                "return_async", name, pattern,
-                                response_info, response_info_size,
-                                response, response_size,
-                                timeout, trans_id, pid, pid_size);
-        if (result == cloudi_success)
-        {
-            throw CloudI::API::return_async_exception();
-        }
-    }
+        return_command = COMMAND_RETURN_ASYNC;
     else if (command == CLOUDI_SYNC)
-    {
-        result = cloudi_return_(p,
-                                "return_sync", name, pattern,
-                                response_info, response_info_size,
-                                response, response_size,
-                                timeout, trans_id, pid, pid_size);
-        if (result == cloudi_success)
-        {
-            throw CloudI::API::return_sync_exception();
-        }
-    }
+        return_command = COMMAND_RETURN_SYNC;
     else
-    {
-        result = cloudi_error_function_parameter;
-    }
-    return result;
+        return cloudi_error_function_parameter;
+    submit->push(new submit_queue::submission(return_command,
+                                              name, pattern,
+                                              response_info,
+                                              response_info_size,
+                                              response, response_size,
+                                              timeout, 0,
+                                              trans_id, pid, pid_size));
+    return cloudi_success;
 }
 
-int cloudi_return_async(cloudi_instance_t * p,
-                        char const * const name,
-                        char const * const pattern,
-                        void const * const response_info,
-                        uint32_t const response_info_size,
-                        void const * const response,
-                        uint32_t const response_size,
-                        uint32_t timeout,
-                        char const * const trans_id,
-                        char const * const pid,
-                        uint32_t const pid_size)
+int cloudi_submit_defer(cloudi_instance_t * p)
 {
-    int result = cloudi_return_(p,
-                                "return_async", name, pattern,
-                                response_info, response_info_size,
-                                response, response_size,
-                                timeout, trans_id, pid, pid_size);
-    if (result == cloudi_success)
-    {
-        throw CloudI::API::return_async_exception();
-    }
-    return result;
+    if (p->submit == 0)
+        return cloudi_error_function_parameter;
+    p->callback_returned = 1;
+    return cloudi_success;
 }
 
-int cloudi_return_sync(cloudi_instance_t * p,
-                       char const * const name,
-                       char const * const pattern,
-                       void const * const response_info,
-                       uint32_t const response_info_size,
-                       void const * const response,
-                       uint32_t const response_size,
-                       uint32_t timeout,
-                       char const * const trans_id,
-                       char const * const pid,
-                       uint32_t const pid_size)
+int cloudi_return_batch(cloudi_instance_t * p,
+                        cloudi_batch_response_t const * const responses,
+                        uint32_t const responses_count)
 {
-    int result = cloudi_return_(p,
-                                "return_sync",
-                                name, pattern,
-                                response_info, response_info_size,
-                                response, response_size,
-                                timeout, trans_id, pid, pid_size);
-    if (result == cloudi_success)
-    {
-        throw CloudI::API::return_sync_exception();
-    }
-    return result;
+    batch_state * const batch = reinterpret_cast<batch_state *>(p->batch);
+    if (batch == 0 || batch->returned() ||
+        batch->size() != responses_count)
+        return cloudi_error_function_parameter;
+    batch->returned(true);
+    return return_batch(p, *batch, responses);
 }
 
 int cloudi_recv_async(cloudi_instance_t * p,
@@ -1181,12 +3277,7 @@ int cloudi_recv_async(cloudi_instance_t * p,
     if (p->use_header)
         index = 4;
         
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_tuple_header(buffer.get<char>(), &index, 4))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, "recv_async"))
-        return cloudi_error_ei_encode;
+    protocol_encode_command(buffer.get<char>(), index, "recv_async", 4);
     if (timeout == 0)
         timeout = p->timeout_sync;
     if (ei_encode_ulong(buffer.get<char>(), &index, timeout))
@@ -1221,6 +3312,211 @@ int cloudi_recv_async(cloudi_instance_t * p,
     return cloudi_success;
 }
 
+static int cloudi_recv_async_future_(cloudi_instance_t * p,
+                                     char const * const trans_id,
+                                     future_function const & f)
+{
+    if (trans_id == 0)
+        return cloudi_error_function_parameter;
+    future_lookup & futures = *reinterpret_cast<future_lookup *>(p->futures);
+    futures.insert(trans_id, f);
+
+    buffer_t & buffer = *reinterpret_cast<buffer_t *>(p->buffer_send);
+    int index = 0;
+    if (p->use_header)
+        index = 4;
+    protocol_encode_command(buffer.get<char>(), index,
+                            "recv_async_future", 2);
+    if (ei_encode_binary(buffer.get<char>(), &index, trans_id, 16))
+        return cloudi_error_ei_encode;
+    return write_exact(p->fd_out, p->use_header,
+                       buffer.get<char>(), index);
+}
+
+int cloudi_recv_async_future(cloudi_instance_t * p,
+                             char const * const trans_id,
+                             cloudi_future_t f,
+                             void * context)
+{
+    return cloudi_recv_async_future_(p, trans_id,
+                                     future_function(p, f, context));
+}
+
+// the name for the chunks after the first chunk needs to be unique
+// among all the services that may share the same prefix
+// (the process_index is only unique within a single service),
+// so a random 128-bit identifier is used
+static void stream_name_id(cloudi_instance_t * p,
+                           char * const id)
+{
+    unsigned char value[16];
+    bool random = false;
+    int const fd = ::open("/dev/urandom", O_RDONLY);
+    if (fd != -1)
+    {
+        random = (::read(fd, value, sizeof(value)) ==
+                  static_cast<ssize_t>(sizeof(value)));
+        ::close(fd);
+    }
+    if (random == false)
+    {
+        size_t seed = 0;
+        boost::hash_combine(seed, ::getpid());
+        boost::hash_combine(seed, clock_milliseconds());
+        boost::hash_combine(seed, reinterpret_cast<uintptr_t>(p));
+        for (size_t i = 0; i < sizeof(value); ++i)
+        {
+            boost::hash_combine(seed, i);
+            value[i] = static_cast<unsigned char>(seed);
+        }
+    }
+    for (size_t i = 0; i < sizeof(value); ++i)
+        ::sprintf(&id[i * 2], "%02x", value[i]);
+}
+
+static int cloudi_stream_subscribe_(cloudi_instance_t * p,
+                                    char const * const pattern,
+                                    callback_function const & f)
+{
+    stream_lookup & streams = *reinterpret_cast<stream_lookup *>(p->streams);
+    int result;
+    if (streams.name().empty())
+    {
+        char suffix[64];
+        ::strcpy(suffix, "cloudi_api_stream/");
+        stream_name_id(p, &suffix[::strlen(suffix)]);
+        result = cloudi_subscribe_(p, suffix,
+                                   callback_function(new stream_function(p)));
+        if (result)
+            return result;
+        streams.name(std::string(p->prefix) + suffix);
+    }
+    return cloudi_subscribe_(p, pattern,
+                             callback_function(new stream_function(p, &f)));
+}
+
+int cloudi_stream_subscribe(cloudi_instance_t * p,
+                            char const * const pattern,
+                            cloudi_callback_t f)
+{
+    return cloudi_stream_subscribe_(p,
+                                    pattern,
+                                    callback_function(p, f));
+}
+
+int cloudi_stream_begin(cloudi_instance_t * p,
+                        char const * const name,
+                        uint32_t timeout,
+                        int8_t const priority)
+{
+    stream_lookup & streams = *reinterpret_cast<stream_lookup *>(p->streams);
+    stream_send & stream = streams.send();
+    if (timeout == 0)
+        timeout = p->timeout_sync;
+    stream.active = true;
+    stream.name = name;
+    stream.id.clear();
+    stream.timeout = timeout;
+    stream.priority = priority;
+    stream.chunk = 0;
+    return cloudi_success;
+}
+
+static int cloudi_stream_send_(cloudi_instance_t * p,
+                               stream_send & stream,
+                               std::string const & request_info,
+                               void const * const chunk,
+                               uint32_t const chunk_size,
+                               bool const end)
+{
+    int const result = cloudi_send_(p, COMMAND_SEND_SYNC, stream.name.c_str(),
+                                    request_info.data(), request_info.size(),
+                                    chunk, chunk_size,
+                                    stream.timeout, stream.priority);
+    if (result)
+    {
+        stream.active = false;
+        return result;
+    }
+    char const trans_id_null[16] = {0};
+    if (::memcmp(p->trans_id, trans_id_null, 16) == 0)
+    {
+        stream.active = false;
+        return cloudi_timeout;
+    }
+    stream_info const response(p->response_info, p->response_info_size);
+    if (response.unknown)
+    {
+        // the receiver abandoned the stream, so the chunk was not accepted
+        stream.active = false;
+        return cloudi_stream_unknown;
+    }
+    if (end)
+    {
+        stream.active = false;
+        return cloudi_success;
+    }
+    if (response.id.empty() ||
+        (stream.id.empty() == false && stream.id != response.id))
+    {
+        // the receiver provided a response that ended the stream
+        stream.active = false;
+        return cloudi_success;
+    }
+    if (stream.id.empty())
+    {
+        stream.id = response.id;
+        stream.name = response.name;
+    }
+    ++stream.chunk;
+    return cloudi_success;
+}
+
+static void cloudi_stream_info_(stream_send const & stream,
+                                std::string & request_info)
+{
+    if (stream.chunk > 0)
+    {
+        char chunk[16];
+        ::sprintf(chunk, "%u", stream.chunk);
+        stream_info::append(request_info, "stream_id", stream.id);
+        stream_info::append(request_info, "stream_chunk", chunk);
+    }
+}
+
+int cloudi_stream_append(cloudi_instance_t * p,
+                         void const * const chunk,
+                         uint32_t const chunk_size)
+{
+    stream_lookup & streams = *reinterpret_cast<stream_lookup *>(p->streams);
+    stream_send & stream = streams.send();
+    if (stream.active == false)
+        return cloudi_error_function_parameter;
+    std::string request_info;
+    cloudi_stream_info_(stream, request_info);
+    return cloudi_stream_send_(p, stream, request_info,
+                               chunk, chunk_size, false);
+}
+
+int cloudi_stream_end(cloudi_instance_t * p,
+                      void const * const request_info,
+                      uint32_t const request_info_size,
+                      void const * const chunk,
+                      uint32_t const chunk_size)
+{
+    stream_lookup & streams = *reinterpret_cast<stream_lookup *>(p->streams);
+    stream_send & stream = streams.send();
+    if (stream.active == false)
+        return cloudi_error_function_parameter;
+    std::string info;
+    cloudi_stream_info_(stream, info);
+    stream_info::append(info, "stream_end", "1");
+    info.append(reinterpret_cast<char const *>(request_info),
+                request_info_size);
+    return cloudi_stream_send_(p, stream, info,
+                               chunk, chunk_size, true);
+}
+
 static int polling(cloudi_instance_t * p)
 {
     assert(! p->initialization_complete);
@@ -1228,10 +3524,7 @@ static int polling(cloudi_instance_t * p)
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, "polling"))
-        return cloudi_error_ei_encode;
+    protocol_encode_command(buffer.get<char>(), index, "polling");
     int result = write_exact(p->fd_out, p->use_header,
                              buffer.get<char>(), index);
     if (result)
@@ -1245,10 +3538,7 @@ static int keepalive(cloudi_instance_t * p)
     int index = 0;
     if (p->use_header)
         index = 4;
-    if (ei_encode_version(buffer.get<char>(), &index))
-        return cloudi_error_ei_encode;
-    if (ei_encode_atom(buffer.get<char>(), &index, "keepalive"))
-        return cloudi_error_ei_encode;
+    protocol_encode_command(buffer.get<char>(), index, "keepalive");
     int result = write_exact(p->fd_out, p->use_header,
                              buffer.get<char>(), index);
     if (result)
@@ -1256,19 +3546,8 @@ static int keepalive(cloudi_instance_t * p)
     return cloudi_success;
 }
 
-#define MESSAGE_INIT                1
-#define MESSAGE_SEND_ASYNC          2
-#define MESSAGE_SEND_SYNC           3
-#define MESSAGE_RECV_ASYNC          4
-#define MESSAGE_RETURN_ASYNC        5
-#define MESSAGE_RETURN_SYNC         6
-#define MESSAGE_RETURNS_ASYNC       7
-#define MESSAGE_KEEPALIVE           8
-#define MESSAGE_REINIT              9
-#define MESSAGE_SUBSCRIBE_COUNT    10
-#define MESSAGE_TERM               11
-
 static void callback(cloudi_instance_t * p,
+                     callback_function const & f,
                      int const command,
                      char const * const name,
                      char const * const pattern,
@@ -1282,14 +3561,25 @@ static void callback(cloudi_instance_t * p,
                      char const * const pid,
                      uint32_t const pid_size)
 {
-    timer & request_timer = *reinterpret_cast<timer *>(p->request_timer);
-    if (p->request_timeout_adjustment)
+    uint64_t const deadline = p->receive_time + timeout;
+    if (clock_milliseconds() >= deadline)
     {
-        request_timer.restart();
-        p->request_timeout = timeout;
+        // the caller no longer waits for the response,
+        // so the callback function is not called
+        reinterpret_cast<request_stats *>(p->stats)->expired();
+        int const result = cloudi_return_(p,
+                                          (command == MESSAGE_SEND_ASYNC) ?
+                                          COMMAND_RETURN_ASYNC :
+                                          COMMAND_RETURN_SYNC,
+                                          name, pattern, "", 0, "", 0,
+                                          0, trans_id, pid, pid_size);
+        assert(result == cloudi_success);
+        return;
     }
-    lookup_t & lookup = *reinterpret_cast<lookup_t *>(p->lookup);
-    callback_function f = lookup.find(std::string(pattern));
+    request_stats_scope const stats_scope(
+        *reinterpret_cast<request_stats *>(p->stats));
+    callback_returned_scope const returned_scope(p);
+    request_deadline_scope const deadline_scope(p, deadline, timeout);
     int result;
     
     if (command == MESSAGE_SEND_ASYNC)
@@ -1300,6 +3590,8 @@ static void callback(cloudi_instance_t * p,
               request_info, request_info_size,
               request, request_size,
               timeout, priority, trans_id, pid, pid_size);
+            if (p->callback_returned)
+                return;
         }
         catch (CloudI::API::return_async_exception const &)
         {
@@ -1327,18 +3619,12 @@ static void callback(cloudi_instance_t * p,
         {
             std::cerr << boost::diagnostic_information(e);
         }
-        try
-        {
-            result = cloudi_return(p,
-                                   CLOUDI_ASYNC, name, pattern, "", 0, "", 0,
-                                   timeout, trans_id, pid, pid_size);
-            assert(result == cloudi_success);
-        }
-        catch (CloudI::API::return_async_exception const & e)
-        {
-            return;
-        }
-        assert(false);
+        // a null response (without an exception)
+        result = cloudi_return_(p,
+                                COMMAND_RETURN_ASYNC, name, pattern,
+                                "", 0, "", 0,
+                                timeout, trans_id, pid, pid_size);
+        assert(result == cloudi_success);
     }
     else if (command == MESSAGE_SEND_SYNC)
     {
@@ -1348,6 +3634,8 @@ static void callback(cloudi_instance_t * p,
               request_info, request_info_size,
               request, request_size,
               timeout, priority, trans_id, pid, pid_size);
+            if (p->callback_returned)
+                return;
         }
         catch (CloudI::API::return_async_exception const &)
         {
@@ -1375,63 +3663,109 @@ static void callback(cloudi_instance_t * p,
         {
             std::cerr << boost::diagnostic_information(e);
         }
-        try
-        {
-            result = cloudi_return(p,
-                                   CLOUDI_SYNC, name, pattern, "", 0, "", 0,
-                                   timeout, trans_id, pid, pid_size);
-            assert(result == cloudi_success);
-        }
-        catch (CloudI::API::return_sync_exception const & e)
-        {
-            return;
-        }
-        assert(false);
+        // a null response (without an exception)
+        result = cloudi_return_(p,
+                                COMMAND_RETURN_SYNC, name, pattern,
+                                "", 0, "", 0,
+                                timeout, trans_id, pid, pid_size);
+        assert(result == cloudi_success);
     }
     else
     {
         assert(false);
     }
-    // not executed, avoids warning
-    if (result == cloudi_success)
-    {
-        return;
-    }
-}
-
-static void store_incoming_binary(buffer_t const & buffer,
-                                  uint32_t & index,
-                                  char * & p)
-{
-    uint32_t size = *reinterpret_cast<uint32_t *>(&buffer[index]);
-    index += sizeof(uint32_t);
-    p = new char[size];
-    memcpy(p, &buffer[index], size);
-    index += size;
-}
-
-static void store_incoming_uint32(buffer_t const & buffer,
-                                  uint32_t & index,
-                                  uint32_t & i)
-{
-    i = *reinterpret_cast<uint32_t *>(&buffer[index]);
-    index += sizeof(uint32_t);
 }
 
-static void store_incoming_int8(buffer_t const & buffer,
-                                uint32_t & index,
-                                int8_t & i)
+// call the batch function with the requests for the pattern that were
+// already received (no delay occurs to fill the batch), a received message
+// that is not part of the batch remains in buffer_recv (pending)
+static int callback_batch(cloudi_instance_t * p,
+                          batch_function & f,
+                          uint32_t const command,
+                          protocol_send const & message,
+                          bool & pending)
 {
-    i = *reinterpret_cast<int8_t *>(&buffer[index]);
-    index += sizeof(int8_t);
-}
+    buffer_t & buffer_recv = *reinterpret_cast<buffer_t *>(p->buffer_recv);
+    buffer_trim & trim = *reinterpret_cast<buffer_trim *>(p->buffer_trim);
+    request_stats & stats = *reinterpret_cast<request_stats *>(p->stats);
+    timer callback_timer;
+    batch_state batch(p, f);
+    batch.push(command, message, buffer_recv);
+    p->buffer_recv_index = 0;
+    int result;
+    while (batch.size() < f.batch_max())
+    {
+        struct pollfd fds[1] = {{p->fd_in, POLLIN | POLLPRI, 0}};
+        if (::poll(fds, 1, 0) != 1)
+            break;
+        result = read_all(p->fd_in, p->use_header,
+                          reinterpret_cast<shm_t *>(p->shm),
+                          buffer_recv, p->buffer_recv_index,
+                          p->buffer_size);
+        if (result)
+            return result;
+        if (p->buffer_recv_index == 0)
+            return cloudi_error_read_underflow;
+        p->receive_time = clock_milliseconds();
+        trim.used(p->buffer_recv_index, buffer_recv.initial_size(),
+                  p->receive_time);
+        stats.received(p->buffer_recv_index);
+        protocol_decoder decoder(buffer_recv.get<char>(),
+                                 p->buffer_recv_index);
+        uint32_t next_command = 0;
+        decoder.get(next_command);
+        if (next_command == MESSAGE_SEND_ASYNC_ID ||
+            next_command == MESSAGE_SEND_SYNC_ID)
+        {
+            uint32_t callback_id;
+            decoder.get(callback_id);
+            next_command = (next_command == MESSAGE_SEND_ASYNC_ID) ?
+                           MESSAGE_SEND_ASYNC : MESSAGE_SEND_SYNC;
+        }
+        else if (next_command != MESSAGE_SEND_ASYNC &&
+                 next_command != MESSAGE_SEND_SYNC)
+        {
+            pending = true;
+            break;
+        }
+        // a request for a different pattern (or with events appended)
+        // is processed after the batch
+        protocol_send next;
+        if (! protocol_decode(decoder, next) || ! decoder.done() ||
+            ::strcmp(next.pattern.data, message.pattern.data) != 0)
+        {
+            pending = true;
+            break;
+        }
+        batch.push(next_command, next, buffer_recv);
+        p->buffer_recv_index = 0;
+    }
+    if (pending)
+        batch.pending(buffer_recv);
 
-static void store_incoming_uint8(buffer_t const & buffer,
-                                 uint32_t & index,
-                                 uint8_t & i)
-{
-    i = *reinterpret_cast<uint8_t *>(&buffer[index]);
-    index += sizeof(uint8_t);
+    try
+    {
+        f(batch.requests(), batch.size());
+    }
+    catch (boost::exception const & e)
+    {
+        std::cerr << boost::diagnostic_information(e);
+    }
+    catch (std::exception const & e)
+    {
+        std::cerr << boost::diagnostic_information(e);
+    }
+    result = cloudi_success;
+    if (! batch.returned())
+    {
+        cloudi_batch_response_t const response_null = {"", 0, "", 0};
+        std::vector<cloudi_batch_response_t> responses(batch.size(),
+                                                       response_null);
+        batch.returned(true);
+        result = return_batch(p, batch, &responses[0]);
+    }
+    stats.batch(callback_timer.elapsed_nanoseconds(), batch.size());
+    return result;
 }
 
 static bool handle_events(cloudi_instance_t * p,
@@ -1441,14 +3775,17 @@ static bool handle_events(cloudi_instance_t * p,
                           uint32_t command = 0)
 {
     buffer_t & buffer_recv = *reinterpret_cast<buffer_t *>(p->buffer_recv);
+    future_lookup & futures = *reinterpret_cast<future_lookup *>(p->futures);
+    protocol_decoder decoder(buffer_recv.get<char>(), p->buffer_recv_index,
+                             index);
     if (command == 0)
     {
-        if (index > p->buffer_recv_index)
+        decoder.get(command);
+        if (! decoder.valid())
         {
             result = cloudi_error_read_underflow;
             return false;
         }
-        store_incoming_uint32(buffer_recv, index, command);
     }
     while (true)
     {
@@ -1465,7 +3802,13 @@ static bool handle_events(cloudi_instance_t * p,
             }
             case MESSAGE_REINIT:
             {
-                store_incoming_uint32(buffer_recv, index, p->process_count);
+                protocol_reinit message;
+                if (! protocol_decode(decoder, message))
+                {
+                    result = cloudi_error_read_underflow;
+                    return false;
+                }
+                p->process_count = message.process_count;
                 break;
             }
             case MESSAGE_KEEPALIVE:
@@ -1475,25 +3818,221 @@ static bool handle_events(cloudi_instance_t * p,
                     return false;
                 break;
             }
+            case MESSAGE_RECV_ASYNC_FUTURE:
+            {
+                protocol_return_sync message;
+                if (! protocol_decode(decoder, message))
+                {
+                    result = cloudi_error_read_underflow;
+                    return false;
+                }
+                futures.complete(message.response_info.data,
+                                 message.response_info.size,
+                                 message.response.data,
+                                 message.response.size,
+                                 message.trans_id);
+                break;
+            }
             default:
             {
-                result = cloudi_error_read_underflow;
-                return false;
+                result = cloudi_error_read_underflow;
+                return false;
+            }
+        }
+        if (decoder.done())
+        {
+            return true;
+        }
+        decoder.get(command);
+        if (! decoder.valid())
+        {
+            result = cloudi_error_read_underflow;
+            return false;
+        }
+    }
+}
+
+static void stats_dump(cloudi_instance_t * p)
+{
+    request_stats & stats = *reinterpret_cast<request_stats *>(p->stats);
+    stats.dump_done();
+    cloudi_stats_t values;
+    stats.get(values);
+    std::ostringstream out;
+    out << "CloudI API stats (" <<
+        (p->prefix ? p->prefix : "") << ", " << p->process_index << ")\n"
+        "  requests: " << values.requests <<
+        " (" << values.expired << " expired)\n"
+        "  messages in: " << values.messages_in <<
+        " (" << values.bytes_in << " bytes)\n"
+        "  messages out: " << values.messages_out <<
+        " (" << values.bytes_out << " bytes)\n";
+    char const * const names[] = {"callback", "send_sync", "write"};
+    cloudi_stats_histogram_t const * const histograms[] = {
+        &values.callback, &values.send_sync, &values.write};
+    for (size_t i = 0; i < 3; ++i)
+    {
+        cloudi_stats_histogram_t const & h = *histograms[i];
+        out << "  " << names[i] << " ns: count " << h.count <<
+            ", min " << h.min << ", mean " << h.mean <<
+            ", p50 " << h.p50 << ", p90 " << h.p90 <<
+            ", p99 " << h.p99 << ", p99.9 " << h.p999 <<
+            ", max " << h.max << "\n";
+    }
+    reinterpret_cast<lookup_t *>(p->lookup)->print_counts(out);
+    std::cerr << out.str();
+}
+
+// wait for incoming data with poll, after spinning for p->poll_spin
+// microseconds with non-blocking reads (if enabled) to avoid the
+// wakeup latency of a blocking poll
+static int poll_wait(cloudi_instance_t * p,
+                     struct pollfd * fds,
+                     nfds_t const nfds,
+                     int timeout)
+{
+    if (p->poll_spin > 0 && timeout != 0)
+    {
+        timer spin_timer;
+        double const spin = p->poll_spin * 1.0e-6;
+        char c;
+        while (true)
+        {
+            ssize_t const i = ::recv(fds[0].fd, &c, 1,
+                                     MSG_PEEK | MSG_DONTWAIT);
+            if (i > 0)
+            {
+                ++(p->poll_spin_success);
+                fds[0].revents = POLLIN;
+                return 1;
+            }
+            else if (nfds > 1 &&
+                     reinterpret_cast<submit_queue *>(p->submit)->pending())
+            {
+                fds[1].revents = POLLIN;
+                return 1;
+            }
+            else if (i == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                // poll provides the socket error
+                break;
+            }
+            double const elapsed = spin_timer.elapsed();
+            if (elapsed >= spin)
+            {
+                ++(p->poll_spin_failure);
+                if (timeout > 0)
+                {
+                    timeout -= std::min(static_cast<int>(elapsed * 1000.0),
+                                        timeout);
+                }
+                break;
             }
         }
-        if (index > p->buffer_recv_index)
+    }
+    request_stats & stats = *reinterpret_cast<request_stats *>(p->stats);
+    int count;
+    while (true)
+    {
+        if (stats.dump_pending())
+            stats_dump(p);
+        count = ::poll(fds, nfds, timeout);
+        // only SIGUSR1 of cloudi_stats_dump_signal interrupts the poll
+        // without an error (the timeout is restarted)
+        if (count == -1 && errno == EINTR && stats.dump_pending())
+            continue;
+        return count;
+    }
+}
+
+static int submit_write(cloudi_instance_t * p)
+{
+    submit_queue & submit = *reinterpret_cast<submit_queue *>(p->submit);
+    int result = cloudi_success;
+    for (submit_queue::submission * s = submit.take(); s;
+         s = submit_queue::next(s))
+    {
+        if (result)
+            continue; // discard the remaining submissions
+        if (s->command() == COMMAND_SEND_ASYNC)
         {
-            result = cloudi_error_read_underflow;
-            return false;
+            result = cloudi_send_(p, COMMAND_SEND_ASYNC, s->name(),
+                                  s->info().data(), s->info().size(),
+                                  s->data().data(), s->data().size(),
+                                  s->timeout(), s->priority());
         }
-        else if (index == p->buffer_recv_index)
+        else
         {
-            return true;
+            result = cloudi_return_(p, s->command(), s->name(), s->pattern(),
+                                    s->info().data(), s->info().size(),
+                                    s->data().data(), s->data().size(),
+                                    s->timeout(), s->trans_id(),
+                                    s->pid().data(), s->pid().size());
+        }
+    }
+    return result;
+}
+
+// wait for incoming data, while writing the submissions of other threads
+static int poll_incoming(cloudi_instance_t * p,
+                         struct pollfd * fds,
+                         nfds_t const nfds,
+                         int const timeout)
+{
+    // the timeout is relative to this call (the caller may have already
+    // subtracted time spent waiting before the call, e.g., the idle interval)
+    timer const wait_timer;
+    int wait = timeout;
+    while (true)
+    {
+        fds[0].revents = 0;
+        if (nfds > 1)
+            fds[1].revents = 0;
+        int const count = poll_wait(p, fds, nfds, wait);
+        if (count == 0)
+            return cloudi_timeout;
+        else if (count < 0)
+            return errno_poll();
+        if (nfds > 1 && fds[1].revents)
+        {
+            int const result = submit_write(p);
+            if (result)
+                return result;
+        }
+        if (fds[0].revents)
+            return cloudi_success;
+        if (timeout > 0)
+        {
+            wait = timeout - std::min(static_cast<int>(::round(
+                wait_timer.elapsed() * 1000.0)), timeout);
+            if (wait == 0)
+                return cloudi_timeout;
         }
-        store_incoming_uint32(buffer_recv, index, command);
     }
 }
 
+// wait for incoming data, giving the memory of grown buffers back to the
+// operating system when no data arrives within the idle interval
+static int poll_incoming_idle(cloudi_instance_t * p,
+                              struct pollfd * fds,
+                              nfds_t const nfds,
+                              int const timeout)
+{
+    buffer_trim & trim = *reinterpret_cast<buffer_trim *>(p->buffer_trim);
+    int const idle = trim.idle_wait(clock_milliseconds());
+    if (idle < 0 || (timeout >= 0 && timeout < idle))
+        return poll_incoming(p, fds, nfds, timeout);
+    int const result = poll_incoming(p, fds, nfds, idle);
+    if (result != cloudi_timeout)
+        return result;
+    trim.idle(*reinterpret_cast<buffer_t *>(p->buffer_send),
+              *reinterpret_cast<buffer_t *>(p->buffer_recv),
+              *reinterpret_cast<buffer_t *>(p->buffer_call));
+    if (timeout == idle)
+        return cloudi_timeout;
+    return poll_incoming(p, fds, nfds, timeout < 0 ? timeout : timeout - idle);
+}
+
 static int poll_request(cloudi_instance_t * p,
                         int timeout,
                         int external)
@@ -1511,55 +4050,77 @@ static int poll_request(cloudi_instance_t * p,
         p->initialization_complete = 1;
     }
 
+    buffer_t & buffer_send = *reinterpret_cast<buffer_t *>(p->buffer_send);
     buffer_t & buffer_recv = *reinterpret_cast<buffer_t *>(p->buffer_recv);
     buffer_t & buffer_call = *reinterpret_cast<buffer_t *>(p->buffer_call);
+    future_lookup & futures = *reinterpret_cast<future_lookup *>(p->futures);
+    buffer_trim & trim = *reinterpret_cast<buffer_trim *>(p->buffer_trim);
+    request_stats & stats = *reinterpret_cast<request_stats *>(p->stats);
+    if (external)
+    {
+        // async responses received during the last request
+        futures.call();
+        trim.check(buffer_send, buffer_recv, buffer_call);
+    }
 
     timer & poll_timer = *reinterpret_cast<timer *>(p->poll_timer);
     if (timeout > 0)
     {
         poll_timer.restart();
     }
-    struct pollfd fds[1] = {{p->fd_in, POLLIN | POLLPRI, 0}};
-    int count = ::poll(fds, 1, timeout);
-    if (count == 0)
-        return cloudi_timeout;
-    else if (count < 0)
-        return errno_poll();
+    // only the outermost poll writes the submissions of other threads
+    submit_queue * const submit = external ?
+        reinterpret_cast<submit_queue *>(p->submit) : 0;
+    struct pollfd fds[2] = {{p->fd_in, POLLIN | POLLPRI, 0},
+                            {submit ? submit->fd() : -1, POLLIN, 0}};
+    nfds_t const nfds = submit ? 2 : 1;
+    result = poll_incoming_idle(p, fds, nfds, timeout);
+    if (result)
+        return result;
 
     result = read_all(p->fd_in, p->use_header,
+                      reinterpret_cast<shm_t *>(p->shm),
                       buffer_recv, p->buffer_recv_index,
                       p->buffer_size);
     if (result)
         return result;
     if (p->buffer_recv_index == 0)
         return cloudi_error_read_underflow;
-    uint32_t index = 0;
-        
+    p->receive_time = clock_milliseconds();
+    trim.used(p->buffer_recv_index, buffer_recv.initial_size(),
+              p->receive_time);
+    stats.received(p->buffer_recv_index);
+    protocol_decoder decoder(buffer_recv.get<char>(), p->buffer_recv_index);
+    bool pending = false;
+
     while (true)
     {
         uint32_t command = 0;
-        store_incoming_uint32(buffer_recv, index, command);
+        decoder.get(command);
         switch (command)
         {
             case MESSAGE_INIT:
             {
-                store_incoming_uint32(buffer_recv, index, p->process_index);
-                store_incoming_uint32(buffer_recv, index, p->process_count);
-                store_incoming_uint32(buffer_recv, index, p->process_count_max);
-                store_incoming_uint32(buffer_recv, index, p->process_count_min);
-                store_incoming_binary(buffer_recv, index, p->prefix);
-                store_incoming_uint32(buffer_recv, index,
-                                      p->timeout_initialize);
-                store_incoming_uint32(buffer_recv, index, p->timeout_async);
-                store_incoming_uint32(buffer_recv, index, p->timeout_sync);
-                store_incoming_uint32(buffer_recv, index, p->timeout_terminate);
-                store_incoming_int8(buffer_recv, index, p->priority_default);
-                store_incoming_uint8(buffer_recv, index,
-                                     p->request_timeout_adjustment);
-                if (index != p->buffer_recv_index)
+                protocol_init message;
+                if (! protocol_decode(decoder, message))
+                    return cloudi_error_read_underflow;
+                p->process_index = message.process_index;
+                p->process_count = message.process_count;
+                p->process_count_max = message.process_count_max;
+                p->process_count_min = message.process_count_min;
+                p->prefix = new char[message.prefix.size];
+                memcpy(p->prefix, message.prefix.data, message.prefix.size);
+                p->timeout_initialize = message.timeout_initialize;
+                p->timeout_async = message.timeout_async;
+                p->timeout_sync = message.timeout_sync;
+                p->timeout_terminate = message.timeout_terminate;
+                p->priority_default = message.priority_default;
+                p->request_timeout_adjustment =
+                    message.request_timeout_adjustment;
+                if (! decoder.done())
                 {
                     assert(! external);
-                    if (! handle_events(p, external, index, result))
+                    if (! handle_events(p, external, decoder.index(), result))
                         return result;
                 }
                 p->buffer_recv_index = 0;
@@ -1567,64 +4128,72 @@ static int poll_request(cloudi_instance_t * p,
             }
             case MESSAGE_SEND_ASYNC:
             case MESSAGE_SEND_SYNC:
+            case MESSAGE_SEND_ASYNC_ID:
+            case MESSAGE_SEND_SYNC_ID:
             {
-                buffer_call.copy(buffer_recv);
-                uint32_t name_size;
-                store_incoming_uint32(buffer_call, index, name_size);
-                char * name = &buffer_call[index];
-                index += name_size;
-                uint32_t pattern_size;
-                store_incoming_uint32(buffer_call, index, pattern_size);
-                char * pattern = &buffer_call[index];
-                index += pattern_size;
-                uint32_t request_info_size;
-                store_incoming_uint32(buffer_call, index, request_info_size);
-                char * request_info = &buffer_call[index];
-                index += request_info_size + 1;
-                uint32_t request_size;
-                store_incoming_uint32(buffer_call, index, request_size);
-                char * request = &buffer_call[index];
-                index += request_size + 1;
-                uint32_t request_timeout;
-                store_incoming_uint32(buffer_call, index, request_timeout);
-                int8_t priority;
-                store_incoming_int8(buffer_call, index, priority);
-                char * trans_id = &buffer_call[index];
-                index += 16;
-                uint32_t pid_size;
-                store_incoming_uint32(buffer_call, index, pid_size);
-                char * pid = &buffer_call[index];
-                index += pid_size;
-                if (index != p->buffer_recv_index)
+                // the send_id layout is the callback_id followed by
+                // the send layout
+                uint32_t callback_id = 0;
+                bool const callback_id_valid =
+                    (command == MESSAGE_SEND_ASYNC_ID ||
+                     command == MESSAGE_SEND_SYNC_ID);
+                if (callback_id_valid)
+                {
+                    decoder.get(callback_id);
+                    command = (command == MESSAGE_SEND_ASYNC_ID) ?
+                              MESSAGE_SEND_ASYNC : MESSAGE_SEND_SYNC;
+                }
+                protocol_send message;
+                if (! protocol_decode(decoder, message))
+                    return cloudi_error_read_underflow;
+                if (! decoder.done())
                 {
                     assert(external);
-                    if (! handle_events(p, external, index, result))
+                    if (! handle_events(p, external, decoder.index(), result))
                         return result;
                 }
+                lookup_t & lookup = *reinterpret_cast<lookup_t *>(p->lookup);
+                callback_function const f = callback_id_valid ?
+                                            lookup.find(callback_id) :
+                                            lookup.find(message.pattern.data);
+                batch_function * const batch = f.batch();
+                if (batch)
+                {
+                    result = callback_batch(p, *batch, command, message,
+                                            pending);
+                    if (result)
+                        return result;
+                    break;
+                }
+                // the callback data remains where it was received
+                // (the allocation now belongs to buffer_call) so that
+                // any nested poll_request reads into a separate buffer
+                buffer_call.swap(buffer_recv);
                 p->buffer_recv_index = 0;
-                callback(p, command, name, pattern,
-                         request_info, request_info_size,
-                         request, request_size, request_timeout,
-                         priority, trans_id, pid, pid_size);
+                callback(p, f,
+                         command, message.name.data, message.pattern.data,
+                         message.request_info.data, message.request_info.size,
+                         message.request.data, message.request.size,
+                         message.timeout, message.priority, message.trans_id,
+                         message.pid.data, message.pid.size);
                 break;
             }
             case MESSAGE_RECV_ASYNC:
             case MESSAGE_RETURN_SYNC:
             {
-                store_incoming_uint32(buffer_recv, index,
-                                      p->response_info_size);
-                p->response_info = &buffer_recv[index];
-                index += p->response_info_size + 1;
-                store_incoming_uint32(buffer_recv, index, p->response_size);
-                p->response = &buffer_recv[index];
-                index += p->response_size + 1;
+                protocol_return_sync message;
+                if (! protocol_decode(decoder, message))
+                    return cloudi_error_read_underflow;
+                p->response_info = message.response_info.data;
+                p->response_info_size = message.response_info.size;
+                p->response = message.response.data;
+                p->response_size = message.response.size;
                 p->trans_id_count = 1;
-                p->trans_id = &buffer_recv[index];
-                index += 16;
-                if (index != p->buffer_recv_index)
+                p->trans_id = message.trans_id;
+                if (! decoder.done())
                 {
                     assert(! external);
-                    if (! handle_events(p, external, index, result))
+                    if (! handle_events(p, external, decoder.index(), result))
                         return result;
                 }
                 p->buffer_recv_index = 0;
@@ -1632,13 +4201,15 @@ static int poll_request(cloudi_instance_t * p,
             }
             case MESSAGE_RETURN_ASYNC:
             {
+                protocol_return_async message;
+                if (! protocol_decode(decoder, message))
+                    return cloudi_error_read_underflow;
                 p->trans_id_count = 1;
-                p->trans_id = &buffer_recv[index];
-                index += 16;
-                if (index != p->buffer_recv_index)
+                p->trans_id = message.trans_id;
+                if (! decoder.done())
                 {
                     assert(! external);
-                    if (! handle_events(p, external, index, result))
+                    if (! handle_events(p, external, decoder.index(), result))
                         return result;
                 }
                 p->buffer_recv_index = 0;
@@ -1646,13 +4217,15 @@ static int poll_request(cloudi_instance_t * p,
             }
             case MESSAGE_RETURNS_ASYNC:
             {
-                store_incoming_uint32(buffer_recv, index, p->trans_id_count);
-                p->trans_id = &buffer_recv[index];
-                index += 16 * p->trans_id_count;
-                if (index != p->buffer_recv_index)
+                protocol_returns_async message;
+                if (! protocol_decode(decoder, message))
+                    return cloudi_error_read_underflow;
+                p->trans_id_count = message.trans_ids.count;
+                p->trans_id = message.trans_ids.data;
+                if (! decoder.done())
                 {
                     assert(! external);
-                    if (! handle_events(p, external, index, result))
+                    if (! handle_events(p, external, decoder.index(), result))
                         return result;
                 }
                 p->buffer_recv_index = 0;
@@ -1660,11 +4233,14 @@ static int poll_request(cloudi_instance_t * p,
             }
             case MESSAGE_SUBSCRIBE_COUNT:
             {
-                store_incoming_uint32(buffer_recv, index, p->subscribe_count);
-                if (index != p->buffer_recv_index)
+                protocol_subscribe_count message;
+                if (! protocol_decode(decoder, message))
+                    return cloudi_error_read_underflow;
+                p->subscribe_count = message.subscribe_count;
+                if (! decoder.done())
                 {
                     assert(! external);
-                    if (! handle_events(p, external, index, result))
+                    if (! handle_events(p, external, decoder.index(), result))
                         return result;
                 }
                 p->buffer_recv_index = 0;
@@ -1672,46 +4248,53 @@ static int poll_request(cloudi_instance_t * p,
             }
             case MESSAGE_TERM:
             {
-                if (! handle_events(p, external, index, result, command))
+                if (! handle_events(p, external, decoder.index(), result,
+                                    command))
                     return result;
                 assert(false);
                 break;
             }
             case MESSAGE_REINIT:
             {
-                store_incoming_uint32(buffer_recv, index, p->process_count);
-                if (index == p->buffer_recv_index)
+                protocol_reinit message;
+                if (! protocol_decode(decoder, message))
+                    return cloudi_error_read_underflow;
+                p->process_count = message.process_count;
+                if (decoder.done())
                 {
                     p->buffer_recv_index = 0;
                     break;
                 }
-                else if (index < p->buffer_recv_index)
-                {
-                    continue;
-                }
-                else
-                {
-                    return cloudi_error_read_underflow;
-                }
+                continue;
             }
             case MESSAGE_KEEPALIVE:
             {
                 result = keepalive(p);
                 if (result)
-                    return false;
-                if (index == p->buffer_recv_index)
+                    return result;
+                if (decoder.done())
                 {
                     p->buffer_recv_index = 0;
                     break;
                 }
-                else if (index < p->buffer_recv_index)
-                {
-                    continue;
-                }
-                else
-                {
+                continue;
+            }
+            case MESSAGE_RECV_ASYNC_FUTURE:
+            {
+                protocol_return_sync message;
+                if (! protocol_decode(decoder, message))
                     return cloudi_error_read_underflow;
+                futures.complete(message.response_info.data,
+                                 message.response_info.size,
+                                 message.response.data,
+                                 message.response.size,
+                                 message.trans_id);
+                if (decoder.done())
+                {
+                    p->buffer_recv_index = 0;
+                    break;
                 }
+                continue;
             }
             default:
             {
@@ -1719,6 +4302,22 @@ static int poll_request(cloudi_instance_t * p,
             }
         }
 
+        if (pending)
+        {
+            // a message received after a batch that is not part of it
+            pending = false;
+            decoder.reset(buffer_recv.get<char>(), p->buffer_recv_index);
+            continue;
+        }
+
+        if (external)
+        {
+            // the received data was processed, so the future functions
+            // can use the API (with the receive buffer) without a conflict
+            futures.call();
+            trim.check(buffer_send, buffer_recv, buffer_call);
+        }
+
         if (timeout > 0)
         {
             timeout -= std::min(static_cast<int>(::round(poll_timer.elapsed() *
@@ -1732,21 +4331,23 @@ static int poll_request(cloudi_instance_t * p,
         {
             poll_timer.restart();
         }
-        fds[0].revents = 0;
-        count = ::poll(fds, 1, timeout);
-        if (count == 0)
-            return cloudi_timeout;
-        else if (count < 0)
-            return errno_poll();
+        result = poll_incoming_idle(p, fds, nfds, timeout);
+        if (result)
+            return result;
 
         result = read_all(p->fd_in, p->use_header,
+                          reinterpret_cast<shm_t *>(p->shm),
                           buffer_recv, p->buffer_recv_index,
                           p->buffer_size);
         if (result)
             return result;
         if (p->buffer_recv_index == 0)
             return cloudi_error_read_underflow;
-        index = 0;
+        p->receive_time = clock_milliseconds();
+        trim.used(p->buffer_recv_index, buffer_recv.initial_size(),
+                  p->receive_time);
+        stats.received(p->buffer_recv_index);
+        decoder.reset(buffer_recv.get<char>(), p->buffer_recv_index);
     }
 }
 
@@ -1756,6 +4357,87 @@ int cloudi_poll(cloudi_instance_t * p,
     return poll_request(p, timeout, 1);
 }
 
+int cloudi_poll_spin(cloudi_instance_t * p,
+                     uint32_t const spin)
+{
+    p->poll_spin = spin;
+    return cloudi_success;
+}
+
+int cloudi_buffer_trim(cloudi_instance_t * p,
+                       uint32_t const trim_count,
+                       int const idle_release)
+{
+    buffer_trim & trim = *reinterpret_cast<buffer_trim *>(p->buffer_trim);
+    trim.set(trim_count, idle_release != 0);
+    return cloudi_success;
+}
+
+int cloudi_memory_stats(cloudi_instance_t * p,
+                        cloudi_memory_stats_t * stats)
+{
+    if (stats == 0)
+        return cloudi_error_function_parameter;
+    buffer_trim & trim = *reinterpret_cast<buffer_trim *>(p->buffer_trim);
+    trim.stats(*stats,
+               *reinterpret_cast<buffer_t *>(p->buffer_send),
+               *reinterpret_cast<buffer_t *>(p->buffer_recv),
+               *reinterpret_cast<buffer_t *>(p->buffer_call));
+    return cloudi_success;
+}
+
+int cloudi_stats_get(cloudi_instance_t * p,
+                     cloudi_stats_t * stats)
+{
+    if (stats == 0)
+        return cloudi_error_function_parameter;
+    reinterpret_cast<request_stats *>(p->stats)->get(*stats);
+    return cloudi_success;
+}
+
+int cloudi_stats_pattern(cloudi_instance_t * p,
+                         char const * const pattern,
+                         uint64_t * count)
+{
+    if (count == 0)
+        return cloudi_error_function_parameter;
+    lookup_t & lookup = *reinterpret_cast<lookup_t *>(p->lookup);
+    if (lookup.count(std::string(p->prefix) + pattern, *count) == false)
+        return cloudi_error_function_parameter;
+    return cloudi_success;
+}
+
+int cloudi_stats_reset(cloudi_instance_t * p)
+{
+    reinterpret_cast<request_stats *>(p->stats)->reset();
+    return cloudi_success;
+}
+
+int cloudi_stats_dump(cloudi_instance_t * p)
+{
+    stats_dump(p);
+    return cloudi_success;
+}
+
+int cloudi_stats_dump_signal(cloudi_instance_t * p,
+                             int const enable)
+{
+    static bool installed = false;
+    if (enable && ! installed)
+    {
+        struct sigaction action;
+        ::memset(&action, 0, sizeof(action));
+        action.sa_handler = &stats_signal;
+        action.sa_flags = SA_RESTART;
+        ::sigemptyset(&action.sa_mask);
+        if (::sigaction(SIGUSR1, &action, 0) != 0)
+            return cloudi_invalid_input;
+        installed = true;
+    }
+    reinterpret_cast<request_stats *>(p->stats)->dump_signal(enable != 0);
+    return cloudi_success;
+}
+
 static char const ** text_key_value_parse(void const * const text,
                                           uint32_t const text_size)
 {
@@ -1849,6 +4531,22 @@ unsigned int API::thread_count()
     return thread_count;
 }
 
+int API::thread_affinity(unsigned int const thread_index)
+{
+    int cpu;
+    int const result = cloudi_initialize_thread_affinity(thread_index, &cpu);
+    if (result != return_value::success)
+        throw invalid_input_exception(result);
+    return cpu;
+}
+
+void API::thread_affinity_set(unsigned int const thread_index)
+{
+    int const result = cloudi_initialize_thread_affinity_set(thread_index);
+    if (result != return_value::success)
+        throw invalid_input_exception(result);
+}
+
 int API::subscribe(char const * const pattern,
                    API::callback_function_generic * p) const
 {
@@ -1857,6 +4555,16 @@ int API::subscribe(char const * const pattern,
                              callback_function(p));
 }
 
+int API::subscribe_batch(char const * const pattern,
+                         API::batch_function_generic * p,
+                         uint32_t const batch_max) const
+{
+    return cloudi_subscribe_batch_(m_api,
+                                   pattern,
+                                   p,
+                                   batch_max);
+}
+
 int API::subscribe_count(char const * const pattern) const
 {
     return cloudi_subscribe_count(m_api,
@@ -1897,6 +4605,14 @@ int API::send_async(char const * const name,
                              priority);
 }
 
+int API::send_async_batch(cloudi_send_async_batch_t const * const requests,
+                          uint32_t const requests_count) const
+{
+    return cloudi_send_async_batch(m_api,
+                                   requests,
+                                   requests_count);
+}
+
 int API::send_sync(char const * const name,
                    void const * const request,
                    uint32_t const request_size) const
@@ -2146,6 +4862,76 @@ int API::return_sync(char const * const name,
                               pid_size);
 }
 
+int API::return_nothrow(bool const enable) const
+{
+    return cloudi_return_nothrow(m_api, enable ? 1 : 0);
+}
+
+uint32_t API::timeout_remaining() const
+{
+    return cloudi_timeout_remaining(m_api);
+}
+
+int API::submit_enable() const
+{
+    return cloudi_submit_enable(m_api);
+}
+
+int API::submit_send_async(char const * const name,
+                           void const * const request_info,
+                           uint32_t const request_info_size,
+                           void const * const request,
+                           uint32_t const request_size,
+                           uint32_t timeout,
+                           int8_t const priority) const
+{
+    return cloudi_submit_send_async(m_api,
+                                    name,
+                                    request_info,
+                                    request_info_size,
+                                    request,
+                                    request_size,
+                                    timeout,
+                                    priority);
+}
+
+int API::submit_return(int const command,
+                       char const * const name,
+                       char const * const pattern,
+                       void const * const response_info,
+                       uint32_t const response_info_size,
+                       void const * const response,
+                       uint32_t const response_size,
+                       uint32_t timeout,
+                       char const * const trans_id,
+                       char const * const pid,
+                       uint32_t const pid_size) const
+{
+    return cloudi_submit_return(m_api,
+                                command,
+                                name,
+                                pattern,
+                                response_info,
+                                response_info_size,
+                                response,
+                                response_size,
+                                timeout,
+                                trans_id,
+                                pid,
+                                pid_size);
+}
+
+int API::submit_defer() const
+{
+    return cloudi_submit_defer(m_api);
+}
+
+int API::return_batch(cloudi_batch_response_t const * const responses,
+                      uint32_t const responses_count) const
+{
+    return cloudi_return_batch(m_api, responses, responses_count);
+}
+
 int API::recv_async() const
 {
     return cloudi_recv_async(m_api,
@@ -2207,6 +4993,75 @@ int API::recv_async(uint32_t timeout,
                              static_cast<int>(consume));
 }
 
+int API::recv_async_future(char const * const trans_id,
+                           API::future_function_generic * p) const
+{
+    return cloudi_recv_async_future_(m_api,
+                                     trans_id,
+                                     future_function(p));
+}
+
+int API::stream_subscribe(char const * const pattern,
+                          API::callback_function_generic * p) const
+{
+    return cloudi_stream_subscribe_(m_api,
+                                    pattern,
+                                    callback_function(p));
+}
+
+char const * API::get_stream_id() const
+{
+    return m_api->stream_id;
+}
+
+uint32_t API::get_stream_chunk() const
+{
+    return m_api->stream_chunk;
+}
+
+bool API::get_stream_chunk_last() const
+{
+    return (m_api->stream_chunk_last != 0);
+}
+
+int API::stream_begin(char const * const name) const
+{
+    return cloudi_stream_begin(m_api,
+                               name,
+                               0,
+                               m_api->priority_default);
+}
+
+int API::stream_begin(char const * const name,
+                      uint32_t timeout,
+                      int8_t const priority) const
+{
+    return cloudi_stream_begin(m_api,
+                               name,
+                               timeout,
+                               priority);
+}
+
+int API::stream_append(void const * const chunk,
+                       uint32_t const chunk_size) const
+{
+    return cloudi_stream_append(m_api,
+                                chunk,
+                                chunk_size);
+}
+
+int API::stream_end(void const * const request_info,
+                    uint32_t const request_info_size,
+                    void const * const chunk,
+                    uint32_t const chunk_size) const
+{
+    return cloudi_stream_end(m_api,
+                             request_info,
+                             request_info_size,
+                             chunk,
+                             chunk_size);
+}
+
 uint32_t API::process_index() const
 {
     return m_api->process_index;
@@ -2263,6 +5118,80 @@ int API::poll(int timeout) const
                        timeout);
 }
 
+int API::poll_spin(uint32_t const spin) const
+{
+    return cloudi_poll_spin(m_api,
+                            spin);
+}
+
+uint64_t API::poll_spin_success() const
+{
+    return m_api->poll_spin_success;
+}
+
+uint64_t API::poll_spin_failure() const
+{
+    return m_api->poll_spin_failure;
+}
+
+int API::buffer_trim(uint32_t const trim_count,
+                     bool const idle_release) const
+{
+    return cloudi_buffer_trim(m_api,
+                              trim_count,
+                              static_cast<int>(idle_release));
+}
+
+int API::memory_stats(cloudi_memory_stats_t & stats) const
+{
+    return cloudi_memory_stats(m_api,
+                               &stats);
+}
+
+int API::stats_get(cloudi_stats_t & stats) const
+{
+    return cloudi_stats_get(m_api,
+                            &stats);
+}
+
+int API::stats_pattern(char const * const pattern,
+                       uint64_t & count) const
+{
+    return cloudi_stats_pattern(m_api,
+                                pattern,
+                                &count);
+}
+
+int API::stats_reset() const
+{
+    return cloudi_stats_reset(m_api);
+}
+
+int API::stats_dump() const
+{
+    return cloudi_stats_dump(m_api);
+}
+
+int API::stats_dump_signal(bool const enable) const
+{
+    return cloudi_stats_dump_signal(m_api,
+                                    static_cast<int>(enable));
+}
+
+int API::poll_reactor(API const * const * apis,
+                      uint32_t const apis_count,
+                      uint32_t const worker_count)
+{
+    if (apis == 0)
+        return return_value::error_function_parameter;
+    std::vector<cloudi_instance_t *> instances(apis_count);
+    for (uint32_t i = 0; i < apis_count; ++i)
+        instances[i] = apis[i]->m_api;
+    return cloudi_poll_reactor(apis_count ? &instances[0] : 0,
+                               apis_count,
+                               worker_count);
+}
+
 char const ** API::request_http_qs_parse(void const * const request,
                                          uint32_t const request_size) const
 {
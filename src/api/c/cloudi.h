@@ -67,8 +67,16 @@ typedef struct cloudi_instance_t
     uint32_t buffer_recv_index;
     void * buffer_call;
     void * poll_timer;
-    void * request_timer;
+    void * shm;
+    void * futures;
+    void * buffer_trim;
+    void * streams;
+    void * batch;
+    void * stats;
+    void * submit;
     uint32_t request_timeout;
+    uint64_t request_deadline; /* of the callback request (milliseconds) */
+    uint64_t receive_time;    /* of the last received message */
     uint32_t process_index;
     uint32_t process_count;
     uint32_t process_count_max;
@@ -87,9 +95,109 @@ typedef struct cloudi_instance_t
     char * trans_id;          /* always 16 characters (128 bits) length */
     uint32_t trans_id_count;
     uint32_t subscribe_count;
+    uint32_t poll_spin;       /* microseconds, set with cloudi_poll_spin */
+    uint64_t poll_spin_success;
+    uint64_t poll_spin_failure;
+    int return_nothrow;       /* set with cloudi_return_nothrow */
+    int callback_returned;    /* the callback used a return or forward */
+    char const * stream_id;   /* incoming stream chunk (only in the callback) */
+    uint32_t stream_chunk;
+    int stream_chunk_last;
 
 } cloudi_instance_t;
 
+#ifndef CLOUDI_SEND_ASYNC_BATCH_T
+#define CLOUDI_SEND_ASYNC_BATCH_T
+/* a single request provided to cloudi_send_async_batch */
+typedef struct cloudi_send_async_batch_t
+{
+    char const * name;
+    void const * request_info;
+    uint32_t request_info_size;
+    void const * request;
+    uint32_t request_size;
+    uint32_t timeout;         /* 0 uses the timeout_async default */
+    int8_t priority;
+
+} cloudi_send_async_batch_t;
+#endif
+
+#ifndef CLOUDI_BATCH_T
+#define CLOUDI_BATCH_T
+/* a single request provided to a batch function */
+typedef struct cloudi_batch_request_t
+{
+    int command;              /* CLOUDI_ASYNC or CLOUDI_SYNC */
+    char const * name;
+    char const * pattern;
+    void const * request_info;
+    uint32_t request_info_size;
+    void const * request;
+    uint32_t request_size;
+    uint32_t timeout;
+    int8_t priority;
+    char const * trans_id;
+    char const * pid;
+    uint32_t pid_size;
+
+} cloudi_batch_request_t;
+
+/* the response of a single request provided to a batch function */
+typedef struct cloudi_batch_response_t
+{
+    void const * response_info;
+    uint32_t response_info_size;
+    void const * response;
+    uint32_t response_size;
+
+} cloudi_batch_response_t;
+#endif
+
+#ifndef CLOUDI_MEMORY_STATS_T
+#define CLOUDI_MEMORY_STATS_T
+/* memory used by the send, receive and call buffers */
+typedef struct cloudi_memory_stats_t
+{
+    uint64_t allocated;       /* current size of the buffers in bytes */
+    uint64_t allocated_max;   /* largest size of the buffers in bytes */
+    uint64_t trimmed;         /* bytes freed by shrinking the buffers */
+    uint64_t released;        /* bytes released (MADV_DONTNEED) while idle */
+    uint64_t trim_count;      /* number of times a buffer was shrunk */
+
+} cloudi_memory_stats_t;
+#endif
+
+#ifndef CLOUDI_STATS_T
+#define CLOUDI_STATS_T
+/* latency histogram summary (in nanoseconds) */
+typedef struct cloudi_stats_histogram_t
+{
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+
+} cloudi_stats_histogram_t;
+
+typedef struct cloudi_stats_t
+{
+    uint64_t requests;        /* incoming service requests */
+    uint64_t expired;         /* requests dropped after their deadline */
+    uint64_t messages_in;     /* messages received from cloudi_core */
+    uint64_t bytes_in;
+    uint64_t messages_out;    /* send, forward and return messages */
+    uint64_t bytes_out;
+    cloudi_stats_histogram_t callback;  /* callback execution and return */
+    cloudi_stats_histogram_t send_sync; /* send_sync round-trip */
+    cloudi_stats_histogram_t write;     /* encoding and writing a message */
+
+} cloudi_stats_t;
+#endif
+
 /* command values */
 #define CLOUDI_ASYNC     1
 #define CLOUDI_SYNC     -1
@@ -108,6 +216,19 @@ typedef void (*cloudi_callback_t)(cloudi_instance_t * p,
                                   char const * const pid,
                                   uint32_t const pid_size);
 
+/* called with the requests of a batch subscription */
+typedef void (*cloudi_batch_t)(cloudi_instance_t * p,
+                               cloudi_batch_request_t const * const requests,
+                               uint32_t const requests_count);
+
+/* called with the async response (empty if the request timed out) */
+typedef void (*cloudi_future_t)(cloudi_instance_t * p,
+                                void const * const response_info,
+                                uint32_t const response_info_size,
+                                void const * const response,
+                                uint32_t const response_size,
+                                char const * const trans_id,
+                                void * context);
 
 #define cloudi_get_response(p)               ((p)->response)
 #define cloudi_get_response_size(p)          ((p)->response_size)
@@ -126,6 +247,11 @@ typedef void (*cloudi_callback_t)(cloudi_instance_t * p,
 #define cloudi_get_timeout_sync(p)           ((p)->timeout_sync)
 #define cloudi_get_timeout_terminate(p)      ((p)->timeout_terminate)
 #define cloudi_get_priority_default(p)       ((p)->priority_default)
+#define cloudi_get_poll_spin_success(p)      ((p)->poll_spin_success)
+#define cloudi_get_poll_spin_failure(p)      ((p)->poll_spin_failure)
+#define cloudi_get_stream_id(p)              ((p)->stream_id)
+#define cloudi_get_stream_chunk(p)           ((p)->stream_chunk)
+#define cloudi_get_stream_chunk_last(p)      ((p)->stream_chunk_last)
 
 int cloudi_initialize(cloudi_instance_t * p,
                       unsigned int const thread_index);
@@ -134,10 +260,25 @@ void cloudi_destroy(cloudi_instance_t * p);
 
 int cloudi_initialize_thread_count(unsigned int * const thread_count);
 
+int cloudi_initialize_thread_affinity(unsigned int const thread_index,
+                                      int * const cpu);
+
+int cloudi_initialize_thread_affinity_set(unsigned int const thread_index);
+
 int cloudi_subscribe(cloudi_instance_t * p,
                      char const * const pattern,
                      cloudi_callback_t f);
 
+/* f is called with the requests for the pattern that were received
+ * together (up to batch_max requests, without a delay to fill the batch)
+ * and provides all the responses with cloudi_return_batch
+ * (an empty response is returned for each request if
+ * cloudi_return_batch is not called) */
+int cloudi_subscribe_batch(cloudi_instance_t * p,
+                           char const * const pattern,
+                           cloudi_batch_t f,
+                           uint32_t const batch_max);
+
 int cloudi_subscribe_count(cloudi_instance_t * p,
                            char const * const pattern);
 
@@ -158,6 +299,13 @@ int cloudi_send_async_(cloudi_instance_t * p,
                        uint32_t timeout,
                        int8_t const priority);
 
+/* send all the requests with a single write and receive all the
+ * trans_ids with a single response (in the same order as the requests,
+ * a null trans_id is provided if a request could not be sent) */
+int cloudi_send_async_batch(cloudi_instance_t * p,
+                            cloudi_send_async_batch_t const * const requests,
+                            uint32_t const requests_count);
+
 int cloudi_send_sync(cloudi_instance_t * p,
                      char const * const name,
                      void const * const request,
@@ -260,14 +408,158 @@ int cloudi_return_sync(cloudi_instance_t * p,
                        char const * const pid,
                        uint32_t const pid_size);
 
+/* if enabled, the return and forward functions do not throw an exception
+ * to end the callback function (the callback function must return after
+ * the return or forward function succeeds, but the exception unwinding
+ * cost is avoided) */
+int cloudi_return_nothrow(cloudi_instance_t * p,
+                          int const enable);
+
+/* the remaining timeout of the request being handled by the callback
+ * function (based on the request deadline, 0 outside of a callback function) */
+uint32_t cloudi_timeout_remaining(cloudi_instance_t * p);
+
+/* allow other threads to use the cloudi_submit functions with this
+ * instance (call before the other threads use the instance), the submitted
+ * sends and returns are written by the thread in cloudi_poll
+ * (with cloudi_poll_reactor the submissions are only written after
+ * the instance receives incoming data) */
+int cloudi_submit_enable(cloudi_instance_t * p);
+
+/* thread-safe send_async (the trans_id is not provided) */
+int cloudi_submit_send_async(cloudi_instance_t * p,
+                             char const * const name,
+                             void const * const request_info,
+                             uint32_t const request_info_size,
+                             void const * const request,
+                             uint32_t const request_size,
+                             uint32_t timeout,
+                             int8_t const priority);
+
+/* thread-safe return of a request deferred with cloudi_submit_defer */
+int cloudi_submit_return(cloudi_instance_t * p,
+                         int const command,
+                         char const * const name,
+                         char const * const pattern,
+                         void const * const response_info,
+                         uint32_t const response_info_size,
+                         void const * const response,
+                         uint32_t const response_size,
+                         uint32_t timeout,
+                         char const * const trans_id,
+                         char const * const pid,
+                         uint32_t const pid_size);
+
+/* the callback function returns without a response because another thread
+ * provides the response with cloudi_submit_return (the callback function
+ * arguments must be copied before the callback function returns) */
+int cloudi_submit_defer(cloudi_instance_t * p);
+
+/* return the responses of the batch function requests, in the same order
+ * (written with a single writev when possible) */
+int cloudi_return_batch(cloudi_instance_t * p,
+                        cloudi_batch_response_t const * const responses,
+                        uint32_t const responses_count);
+
 int cloudi_recv_async(cloudi_instance_t * p,
                       uint32_t timeout,
                       char const * const trans_id,
                       int consume);
 
+/* receive the async response of trans_id without blocking, f is called
+ * by cloudi_poll after the response arrives (incoming requests are still
+ * processed while the response is pending) */
+int cloudi_recv_async_future(cloudi_instance_t * p,
+                             char const * const trans_id,
+                             cloudi_future_t f,
+                             void * context);
+
+/* streams send a large request as a sequence of chunks, each chunk is
+ * a send_sync request that is acknowledged by the receiving process before
+ * the next chunk is sent (only a single chunk is buffered at a time).
+ * f is called for each chunk, in order, with cloudi_get_stream_id(p),
+ * cloudi_get_stream_chunk(p) and cloudi_get_stream_chunk_last(p) set.
+ * the response of the last chunk is the response of the stream and
+ * a response provided for any other chunk ends the stream early. */
+int cloudi_stream_subscribe(cloudi_instance_t * p,
+                            char const * const pattern,
+                            cloudi_callback_t f);
+
+/* only a single outgoing stream exists for each instance.
+ * cloudi_stream_append and cloudi_stream_end return cloudi_stream_unknown
+ * if the chunk was not accepted because the receiver abandoned the stream
+ * after the timeout.  a chunk that the receiver provided a response for
+ * ends the stream early (cloudi_success is returned, with the response
+ * available from cloudi_get_response(p)) and any later call returns
+ * cloudi_error_function_parameter.  the response of cloudi_stream_end
+ * is available with cloudi_get_response(p) */
+int cloudi_stream_begin(cloudi_instance_t * p,
+                        char const * const name,
+                        uint32_t timeout,
+                        int8_t const priority);
+
+int cloudi_stream_append(cloudi_instance_t * p,
+                         void const * const chunk,
+                         uint32_t const chunk_size);
+
+int cloudi_stream_end(cloudi_instance_t * p,
+                      void const * const request_info,
+                      uint32_t const request_info_size,
+                      void const * const chunk,
+                      uint32_t const chunk_size);
+
 int cloudi_poll(cloudi_instance_t * p,
                 int timeout);
 
+/* spin with non-blocking socket reads for up to spin microseconds before
+ * blocking while waiting for incoming data (0 disables spinning, the default).
+ * cloudi_get_poll_spin_success(p) counts the incoming data found while
+ * spinning and cloudi_get_poll_spin_failure(p) counts the blocking waits
+ * that occurred after spinning. */
+int cloudi_poll_spin(cloudi_instance_t * p,
+                     uint32_t const spin);
+
+/* poll all the instances (e.g., one for each thread_index) with a single
+ * thread waiting on all the sockets that dispatches the incoming requests
+ * to worker_count threads (each instance is used by only one
+ * worker thread at a time), instead of a thread for each instance
+ * calling cloudi_poll.  returns after all the instances have terminated. */
+int cloudi_poll_reactor(cloudi_instance_t ** instances,
+                        uint32_t const instances_count,
+                        uint32_t const worker_count);
+
+/* shrink the send, receive and call buffers after trim_count received
+ * messages that would have fit in smaller buffers (0 disables shrinking,
+ * the default) and if idle_release is set, give the memory of grown buffers
+ * back to the operating system after cloudi_poll waited a second without
+ * receiving a request.
+ * buffers larger than 2MB are marked for transparent huge pages. */
+int cloudi_buffer_trim(cloudi_instance_t * p,
+                       uint32_t const trim_count,
+                       int const idle_release);
+
+int cloudi_memory_stats(cloudi_instance_t * p,
+                        cloudi_memory_stats_t * stats);
+
+/* request latency histograms and counters of the instance,
+ * with the number of requests received for each subscribed pattern */
+int cloudi_stats_get(cloudi_instance_t * p,
+                     cloudi_stats_t * stats);
+
+int cloudi_stats_pattern(cloudi_instance_t * p,
+                         char const * const pattern,
+                         uint64_t * count);
+
+int cloudi_stats_reset(cloudi_instance_t * p);
+
+/* write the stats to stderr */
+int cloudi_stats_dump(cloudi_instance_t * p);
+
+/* dump the stats when SIGUSR1 is received (the signal handler is installed
+ * if enable is set), the next time the instance waits for incoming data */
+int cloudi_stats_dump_signal(cloudi_instance_t * p,
+                             int const enable);
+
 char const ** cloudi_request_http_qs_parse(void const * const request,
                                            uint32_t const request_size);
 void cloudi_request_http_qs_destroy(char const ** p);
@@ -288,6 +580,8 @@ enum
     cloudi_error_function_parameter            =   8,
     cloudi_error_read_underflow                =   9,
     cloudi_error_ei_decode                     =  10,
+    // the stream chunk was not accepted by the receiver
+    cloudi_stream_unknown                      =  13,
     // reuse some exit status values from os_spawn
     cloudi_invalid_input                       =  11,
     cloudi_out_of_memory                       =  12,
@@ -52,6 +52,98 @@
 
 typedef struct cloudi_instance_t cloudi_instance_t;
 
+#ifndef CLOUDI_SEND_ASYNC_BATCH_T
+#define CLOUDI_SEND_ASYNC_BATCH_T
+/* a single request provided to cloudi_send_async_batch */
+typedef struct cloudi_send_async_batch_t
+{
+    char const * name;
+    void const * request_info;
+    uint32_t request_info_size;
+    void const * request;
+    uint32_t request_size;
+    uint32_t timeout;         /* 0 uses the timeout_async default */
+    int8_t priority;
+
+} cloudi_send_async_batch_t;
+#endif
+
+#ifndef CLOUDI_BATCH_T
+#define CLOUDI_BATCH_T
+/* a single request provided to a batch function */
+typedef struct cloudi_batch_request_t
+{
+    int command;              /* CLOUDI_ASYNC or CLOUDI_SYNC */
+    char const * name;
+    char const * pattern;
+    void const * request_info;
+    uint32_t request_info_size;
+    void const * request;
+    uint32_t request_size;
+    uint32_t timeout;
+    int8_t priority;
+    char const * trans_id;
+    char const * pid;
+    uint32_t pid_size;
+
+} cloudi_batch_request_t;
+
+/* the response of a single request provided to a batch function */
+typedef struct cloudi_batch_response_t
+{
+    void const * response_info;
+    uint32_t response_info_size;
+    void const * response;
+    uint32_t response_size;
+
+} cloudi_batch_response_t;
+#endif
+
+#ifndef CLOUDI_MEMORY_STATS_T
+#define CLOUDI_MEMORY_STATS_T
+/* memory used by the send, receive and call buffers */
+typedef struct cloudi_memory_stats_t
+{
+    uint64_t allocated;       /* current size of the buffers in bytes */
+    uint64_t allocated_max;   /* largest size of the buffers in bytes */
+    uint64_t trimmed;         /* bytes freed by shrinking the buffers */
+    uint64_t released;        /* bytes released (MADV_DONTNEED) while idle */
+    uint64_t trim_count;      /* number of times a buffer was shrunk */
+
+} cloudi_memory_stats_t;
+#endif
+
+#ifndef CLOUDI_STATS_T
+#define CLOUDI_STATS_T
+/* latency histogram summary (in nanoseconds) */
+typedef struct cloudi_stats_histogram_t
+{
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t mean;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+
+} cloudi_stats_histogram_t;
+
+typedef struct cloudi_stats_t
+{
+    uint64_t requests;        /* incoming service requests */
+    uint64_t expired;         /* requests dropped after their deadline */
+    uint64_t messages_in;     /* messages received from cloudi_core */
+    uint64_t bytes_in;
+    uint64_t messages_out;    /* send, forward and return messages */
+    uint64_t bytes_out;
+    cloudi_stats_histogram_t callback;  /* callback execution and return */
+    cloudi_stats_histogram_t send_sync; /* send_sync round-trip */
+    cloudi_stats_histogram_t write;     /* encoding and writing a message */
+
+} cloudi_stats_t;
+#endif
+
 namespace CloudI
 {
 
@@ -615,6 +707,15 @@ class API
 
         static unsigned int thread_count();
 
+        // the logical processor planned for the thread_index by the
+        // affinity service configuration option (-1 if none is planned)
+        static int thread_affinity(unsigned int const thread_index);
+        // pin the calling thread to the logical processor planned for
+        // the thread_index (call before the API object is created, so the
+        // buffers are allocated on the local NUMA node), an exception is
+        // thrown if the thread could not be pinned
+        static void thread_affinity_set(unsigned int const thread_index);
+
         int subscribe(std::string const & pattern,
                       function_object_cxx_const const & object) const
         {
@@ -819,6 +920,180 @@ class API
         int subscribe(char const * const pattern,
                       callback_function_generic * p) const;
 
+    public:
+        class batch_function_generic
+        {
+            public:
+                virtual ~batch_function_generic() throw() {}
+                virtual void operator () (cloudi_batch_request_t const * const,
+                                          uint32_t const) = 0;
+        };
+
+        class batch_function_object_c
+        {
+            public:
+                virtual ~batch_function_object_c() throw() {}
+                virtual void operator() (API const &,
+                                         cloudi_batch_request_t const * const,
+                                         uint32_t const) = 0;
+        };
+
+    private:
+        template <typename T>
+        class batch_function_cxx_m : public batch_function_generic
+        {
+            public:
+                batch_function_cxx_m(T & object,
+                                     API const * api,
+                                     void (T::*f) (API const &,
+                                                   cloudi_batch_request_t
+                                                       const * const,
+                                                   uint32_t const)) :
+                    m_object(object), m_api(api), m_f(f) {}
+                virtual ~batch_function_cxx_m() throw()
+                {
+                    delete m_api;
+                }
+
+                virtual void operator () (cloudi_batch_request_t
+                                              const * const requests,
+                                          uint32_t const requests_count)
+                {
+                    (m_object.*m_f)(*m_api,
+                                    requests,
+                                    requests_count);
+                }
+            private:
+                T & m_object;
+                API const * m_api;
+                void (T::*m_f) (API const &,
+                                cloudi_batch_request_t const * const,
+                                uint32_t const);
+        };
+
+        class batch_function_cxx_s : public batch_function_generic
+        {
+            public:
+                batch_function_cxx_s(API const * api,
+                                     void (*f) (API const &,
+                                                cloudi_batch_request_t
+                                                    const * const,
+                                                uint32_t const)) :
+                    m_api(api), m_f(f) {}
+                virtual ~batch_function_cxx_s() throw()
+                {
+                    delete m_api;
+                }
+
+                virtual void operator () (cloudi_batch_request_t
+                                              const * const requests,
+                                          uint32_t const requests_count)
+                {
+                    (*m_f)(*m_api,
+                           requests,
+                           requests_count);
+                }
+            private:
+                API const * m_api;
+                void (*m_f) (API const &,
+                             cloudi_batch_request_t const * const,
+                             uint32_t const);
+        };
+
+        class batch_function_cxx_op : public batch_function_generic
+        {
+            public:
+                batch_function_cxx_op(batch_function_object_c * object,
+                                      API const * api) :
+                    m_object(object), m_api(api) {}
+                virtual ~batch_function_cxx_op() throw()
+                {
+                    delete m_object;
+                    delete m_api;
+                }
+
+                virtual void operator () (cloudi_batch_request_t
+                                              const * const requests,
+                                          uint32_t const requests_count)
+                {
+                    (*m_object)(*m_api,
+                                requests,
+                                requests_count);
+                }
+            private:
+                batch_function_object_c * const m_object;
+                API const * m_api;
+        };
+
+    public:
+        // the function is called with the requests for the pattern that
+        // were received together (up to batch_max requests, without a delay
+        // to fill the batch) and provides all the responses with
+        // return_batch (an empty response is returned for each request
+        // if return_batch is not called)
+        template <typename T>
+        int subscribe_batch(char const * const pattern,
+                            T & object,
+                            void (T::*f) (API const &,
+                                          cloudi_batch_request_t const * const,
+                                          uint32_t const),
+                            uint32_t const batch_max) const
+        {
+            return subscribe_batch(pattern,
+                                   new batch_function_cxx_m<T>(object,
+                                       new API(*this), f),
+                                   batch_max);
+        }
+
+        template <typename T>
+        inline int subscribe_batch(std::string const & pattern,
+                                   T & object,
+                                   void (T::*f) (API const &,
+                                                 cloudi_batch_request_t
+                                                     const * const,
+                                                 uint32_t const),
+                                   uint32_t const batch_max) const
+        {
+            return subscribe_batch(pattern.c_str(), object, f, batch_max);
+        }
+
+        int subscribe_batch(char const * const pattern,
+                            void (*f) (API const &,
+                                       cloudi_batch_request_t const * const,
+                                       uint32_t const),
+                            uint32_t const batch_max) const
+        {
+            return subscribe_batch(pattern,
+                                   new batch_function_cxx_s(
+                                       new API(*this), f),
+                                   batch_max);
+        }
+
+        inline int subscribe_batch(std::string const & pattern,
+                                   void (*f) (API const &,
+                                              cloudi_batch_request_t
+                                                  const * const,
+                                              uint32_t const),
+                                   uint32_t const batch_max) const
+        {
+            return subscribe_batch(pattern.c_str(), f, batch_max);
+        }
+
+        int subscribe_batch(char const * const pattern,
+                            batch_function_object_c * object,
+                            uint32_t const batch_max) const
+        {
+            return subscribe_batch(pattern,
+                                   new batch_function_cxx_op(object,
+                                                             new API(*this)),
+                                   batch_max);
+        }
+
+    private:
+        int subscribe_batch(char const * const pattern,
+                            batch_function_generic * p,
+                            uint32_t const batch_max) const;
+
     public:
         int subscribe_count(char const * const pattern) const;
 
@@ -872,6 +1147,12 @@ class API
                               priority);
         }
 
+        // send all the requests with a single write and receive all the
+        // trans_ids with a single response (in the same order as the
+        // requests, a null trans_id is provided if a request was not sent)
+        int send_async_batch(cloudi_send_async_batch_t const * const requests,
+                             uint32_t const requests_count) const;
+
         int send_sync(char const * const name,
                       void const * const request,
                       uint32_t const request_size) const;
@@ -1170,6 +1451,49 @@ class API
                                pid_size);
         }
 
+        // if enabled, the return and forward functions do not throw
+        // an exception to end the callback function (the callback function
+        // must return after the return or forward function succeeds)
+        int return_nothrow(bool const enable) const;
+
+        // the remaining timeout of the request being handled by
+        // the callback function (0 outside of a callback function)
+        uint32_t timeout_remaining() const;
+
+        // allow other threads to use the submit functions
+        // (call before the other threads use the instance)
+        int submit_enable() const;
+
+        // thread-safe send_async (the trans_id is not provided)
+        int submit_send_async(char const * const name,
+                              void const * const request_info,
+                              uint32_t const request_info_size,
+                              void const * const request,
+                              uint32_t const request_size,
+                              uint32_t timeout,
+                              int8_t const priority) const;
+
+        // thread-safe return of a request deferred with submit_defer
+        int submit_return(int const command,
+                          char const * const name,
+                          char const * const pattern,
+                          void const * const response_info,
+                          uint32_t const response_info_size,
+                          void const * const response,
+                          uint32_t const response_size,
+                          uint32_t timeout,
+                          char const * const trans_id,
+                          char const * const pid,
+                          uint32_t const pid_size) const;
+
+        // the callback function returns without a response because
+        // another thread provides the response with submit_return
+        int submit_defer() const;
+
+        // the responses of the batch function requests, in the same order
+        int return_batch(cloudi_batch_response_t const * const responses,
+                         uint32_t const responses_count) const;
+
         int recv_async() const;
 
         int recv_async(uint32_t timeout) const;
@@ -1212,6 +1536,299 @@ class API
                               consume);
         }
 
+    public:
+        class future_function_generic
+        {
+            public:
+                virtual ~future_function_generic() throw() {}
+                virtual void operator () (void const * const,
+                                          uint32_t const,
+                                          void const * const,
+                                          uint32_t const,
+                                          char const * const) = 0;
+        };
+
+    private:
+        template <typename T>
+        class future_function_cxx_m : public future_function_generic
+        {
+            public:
+                future_function_cxx_m(T & object,
+                                      API const * api,
+                                      void (T::*f) (API const &,
+                                                    void const * const,
+                                                    uint32_t const,
+                                                    void const * const,
+                                                    uint32_t const,
+                                                    char const * const)) :
+                    m_object(object), m_api(api), m_f(f) {}
+                virtual ~future_function_cxx_m() throw()
+                {
+                    delete m_api;
+                }
+
+                virtual void operator () (void const * const response_info,
+                                          uint32_t const response_info_size,
+                                          void const * const response,
+                                          uint32_t const response_size,
+                                          char const * const trans_id)
+                {
+                    (m_object.*m_f)(*m_api,
+                                    response_info,
+                                    response_info_size,
+                                    response,
+                                    response_size,
+                                    trans_id);
+                }
+            private:
+                T & m_object;
+                API const * m_api;
+                void (T::*m_f) (API const &,
+                                void const * const,
+                                uint32_t const,
+                                void const * const,
+                                uint32_t const,
+                                char const * const);
+        };
+
+        class future_function_cxx_s : public future_function_generic
+        {
+            public:
+                future_function_cxx_s(API const * api,
+                                      void (*f) (API const &,
+                                                 void const * const,
+                                                 uint32_t const,
+                                                 void const * const,
+                                                 uint32_t const,
+                                                 char const * const)) :
+                    m_api(api), m_f(f) {}
+                virtual ~future_function_cxx_s() throw()
+                {
+                    delete m_api;
+                }
+
+                virtual void operator () (void const * const response_info,
+                                          uint32_t const response_info_size,
+                                          void const * const response,
+                                          uint32_t const response_size,
+                                          char const * const trans_id)
+                {
+                    (*m_f)(*m_api,
+                           response_info,
+                           response_info_size,
+                           response,
+                           response_size,
+                           trans_id);
+                }
+            private:
+                API const * m_api;
+                void (*m_f) (API const &,
+                             void const * const,
+                             uint32_t const,
+                             void const * const,
+                             uint32_t const,
+                             char const * const);
+        };
+
+    public:
+        // receive the async response of trans_id without blocking,
+        // the function is called by poll after the response arrives
+        // (with an empty response if the request timed out) and
+        // incoming requests are still processed while it is pending
+        template <typename T>
+        int recv_async_future(char const * const trans_id,
+                              T & object,
+                              void (T::*f) (API const &,
+                                            void const * const,
+                                            uint32_t const,
+                                            void const * const,
+                                            uint32_t const,
+                                            char const * const)) const
+        {
+            return recv_async_future(trans_id,
+                                     new future_function_cxx_m<T>(object,
+                                         new API(*this), f));
+        }
+
+        template <typename T>
+        inline int recv_async_future(std::string const & trans_id,
+                                     T & object,
+                                     void (T::*f) (API const &,
+                                                   void const * const,
+                                                   uint32_t const,
+                                                   void const * const,
+                                                   uint32_t const,
+                                                   char const * const)) const
+        {
+            return recv_async_future(trans_id.c_str(), object, f);
+        }
+
+        int recv_async_future(char const * const trans_id,
+                              void (*f) (API const &,
+                                         void const * const,
+                                         uint32_t const,
+                                         void const * const,
+                                         uint32_t const,
+                                         char const * const)) const
+        {
+            return recv_async_future(trans_id,
+                                     new future_function_cxx_s(
+                                         new API(*this), f));
+        }
+
+        inline int recv_async_future(std::string const & trans_id,
+                                     void (*f) (API const &,
+                                                void const * const,
+                                                uint32_t const,
+                                                void const * const,
+                                                uint32_t const,
+                                                char const * const)) const
+        {
+            return recv_async_future(trans_id.c_str(), f);
+        }
+
+    private:
+        int recv_async_future(char const * const trans_id,
+                              future_function_generic * p) const;
+
+    public:
+        // streams send a large request as a sequence of chunks, each chunk
+        // is a send_sync request that is acknowledged by the receiving
+        // process before the next chunk is sent.  the function is called for
+        // each chunk, in order, with get_stream_id(), get_stream_chunk()
+        // and get_stream_chunk_last() set.  the response of the last chunk
+        // is the response of the stream and a response provided for
+        // any other chunk ends the stream early.
+        template <typename T>
+        int stream_subscribe(std::string const & pattern,
+                             T & object,
+                             void (T::*f) (API const &,
+                                           int const,
+                                           std::string const &,
+                                           std::string const &,
+                                           void const * const,
+                                           uint32_t const,
+                                           void const * const,
+                                           uint32_t const,
+                                           uint32_t,
+                                           int8_t,
+                                           char const * const,
+                                           char const * const,
+                                           uint32_t const)) const
+        {
+            return stream_subscribe(pattern.c_str(),
+                                    new callback_function_cxx_m1<T>(object,
+                                        new API(*this), f));
+        }
+
+        template <typename T>
+        int stream_subscribe(char const * const pattern,
+                             T & object,
+                             void (T::*f) (API const &,
+                                           int const,
+                                           std::string const &,
+                                           std::string const &,
+                                           void const * const,
+                                           uint32_t const,
+                                           void const * const,
+                                           uint32_t const,
+                                           uint32_t,
+                                           int8_t,
+                                           char const * const,
+                                           char const * const,
+                                           uint32_t const)) const
+        {
+            return stream_subscribe(pattern,
+                                    new callback_function_cxx_m1<T>(object,
+                                        new API(*this), f));
+        }
+
+        inline int stream_subscribe(std::string const & pattern,
+                                    void (*f) (API const &,
+                                               int const,
+                                               std::string const &,
+                                               std::string const &,
+                                               void const * const,
+                                               uint32_t const,
+                                               void const * const,
+                                               uint32_t const,
+                                               uint32_t,
+                                               int8_t,
+                                               char const * const,
+                                               char const * const,
+                                               uint32_t const)) const
+        {
+            return stream_subscribe(pattern.c_str(),
+                                    new callback_function_cxx_s1(
+                                        new API(*this), f));
+        }
+
+        inline int stream_subscribe(char const * const pattern,
+                                    void (*f) (API const &,
+                                               int const,
+                                               std::string const &,
+                                               std::string const &,
+                                               void const * const,
+                                               uint32_t const,
+                                               void const * const,
+                                               uint32_t const,
+                                               uint32_t,
+                                               int8_t,
+                                               char const * const,
+                                               char const * const,
+                                               uint32_t const)) const
+        {
+            return stream_subscribe(pattern,
+                                    new callback_function_cxx_s1(
+                                        new API(*this), f));
+        }
+
+    private:
+        int stream_subscribe(char const * const pattern,
+                             callback_function_generic * p) const;
+
+    public:
+        char const * get_stream_id() const;
+        uint32_t get_stream_chunk() const;
+        bool get_stream_chunk_last() const;
+
+        // only a single outgoing stream exists for each API object.
+        // stream_append and stream_end return stream_unknown if the
+        // chunk was not accepted because the receiver abandoned the
+        // stream after the timeout.  a chunk that the receiver provided
+        // a response for ends the stream early (success is returned,
+        // with the response available from get_response()) and any later
+        // call returns error_function_parameter.  the response of
+        // stream_end is available with get_response()
+        int stream_begin(char const * const name) const;
+
+        inline int stream_begin(std::string const & name) const
+        {
+            return stream_begin(name.c_str());
+        }
+
+        int stream_begin(char const * const name,
+                         uint32_t timeout,
+                         int8_t const priority) const;
+
+        inline int stream_begin(std::string const & name,
+                                uint32_t timeout,
+                                int8_t const priority) const
+        {
+            return stream_begin(name.c_str(),
+                                timeout,
+                                priority);
+        }
+
+        int stream_append(void const * const chunk,
+                          uint32_t const chunk_size) const;
+
+        int stream_end(void const * const request_info,
+                       uint32_t const request_info_size,
+                       void const * const chunk = 0,
+                       uint32_t const chunk_size = 0) const;
+
+    public:
         uint32_t process_index() const;
 
         uint32_t process_count() const;
@@ -1234,6 +1851,57 @@ class API
 
         int poll(int timeout = -1) const;
 
+        // spin with non-blocking socket reads for up to spin microseconds
+        // before blocking while waiting for incoming data
+        // (0 disables spinning, the default)
+        int poll_spin(uint32_t const spin) const;
+
+        // incoming data found while spinning
+        uint64_t poll_spin_success() const;
+
+        // blocking waits that occurred after spinning
+        uint64_t poll_spin_failure() const;
+
+        // shrink the send, receive and call buffers after trim_count
+        // received messages that would have fit in smaller buffers
+        // (0 disables shrinking, the default) and if idle_release is set,
+        // give the memory of grown buffers back to the operating system
+        // after poll waited a second without receiving a request
+        int buffer_trim(uint32_t const trim_count,
+                        bool const idle_release = false) const;
+
+        int memory_stats(cloudi_memory_stats_t & stats) const;
+
+        // request latency histograms and counters, with the number of
+        // requests received for each subscribed pattern
+        int stats_get(cloudi_stats_t & stats) const;
+
+        int stats_pattern(char const * const pattern,
+                          uint64_t & count) const;
+
+        inline int stats_pattern(std::string const & pattern,
+                                 uint64_t & count) const
+        {
+            return stats_pattern(pattern.c_str(), count);
+        }
+
+        int stats_reset() const;
+
+        // write the stats to stderr
+        int stats_dump() const;
+
+        // dump the stats when SIGUSR1 is received, the next time
+        // poll waits for incoming data
+        int stats_dump_signal(bool const enable = true) const;
+
+        // poll all the API objects (e.g., one for each thread_index) with
+        // a single thread waiting on all the sockets that dispatches the
+        // incoming requests to worker_count threads, instead of a thread
+        // for each API object calling poll
+        static int poll_reactor(API const * const * apis,
+                                uint32_t const apis_count,
+                                uint32_t const worker_count);
+
         char const ** request_http_qs_parse(void const * const request,
                                             uint32_t const request_size) const;
         void request_http_qs_destroy(char const ** p) const;
@@ -1265,6 +1933,8 @@ class API
                 error_function_parameter            =   8,
                 error_read_underflow                =   9,
                 error_ei_decode                     =  10,
+                // the stream chunk was not accepted by the receiver
+                stream_unknown                      =  13,
                 // reuse some exit status values from os_spawn
                 invalid_input                       =  11,
                 out_of_memory                       =  12,
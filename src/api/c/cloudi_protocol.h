@@ -0,0 +1,162 @@
+/* -*- coding: utf-8; Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*-
+ * ex: set softtabstop=4 tabstop=4 shiftwidth=4 expandtab fileencoding=utf-8:
+ *
+ * BSD LICENSE
+ * 
+ * Copyright (c) 2015, Michael Truog <mjtruog at gmail dot com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * All advertising materials mentioning features or use of this
+ *       software must display the following acknowledgment:
+ *         This product includes software developed by Michael Truog
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#ifndef CLOUDI_PROTOCOL_H
+#define CLOUDI_PROTOCOL_H
+
+/* The schema of the messages cloudi_core sends to an external service.
+ * The C/C++ CloudI API decoder (protocol.hpp) and the cloudi_core message
+ * type constants (cloudi_core_i_protocol.hrl) are generated from this file.
+ *
+ * Each message is a 32 bit message type followed by the fields of
+ * the message's layout (all integers use the native byte order):
+ *   uint32     32 bit unsigned integer
+ *   int8       8 bit signed integer
+ *   uint8      8 bit unsigned integer
+ *   string     uint32 size, data ('\0' terminated, included in size)
+ *   binary     uint32 size, data, '\0' (the '\0' is not included in size)
+ *   term       uint32 size, external term format data
+ *   trans_id   16 bytes (v1 UUID)
+ *   trans_ids  uint32 count, 16 bytes * count
+ * A single read may contain multiple messages, one after the other.
+ */
+
+/* MESSAGE(NAME, TYPE, LAYOUT) */
+#define CLOUDI_PROTOCOL_MESSAGES(MESSAGE) \
+    MESSAGE(INIT,                1, init) \
+    MESSAGE(SEND_ASYNC,          2, send) \
+    MESSAGE(SEND_SYNC,           3, send) \
+    MESSAGE(RECV_ASYNC,          4, return_sync) \
+    MESSAGE(RETURN_ASYNC,        5, return_async) \
+    MESSAGE(RETURN_SYNC,         6, return_sync) \
+    MESSAGE(RETURNS_ASYNC,       7, returns_async) \
+    MESSAGE(KEEPALIVE,           8, empty) \
+    MESSAGE(REINIT,              9, reinit) \
+    MESSAGE(SUBSCRIBE_COUNT,    10, subscribe_count) \
+    MESSAGE(TERM,               11, empty) \
+    MESSAGE(RECV_ASYNC_FUTURE,  12, return_sync) \
+    MESSAGE(SEND_ASYNC_ID,      13, send_id) \
+    MESSAGE(SEND_SYNC_ID,       14, send_id)
+
+/* LAYOUT(NAME) for each CLOUDI_PROTOCOL_LAYOUT_NAME(FIELD) below */
+#define CLOUDI_PROTOCOL_LAYOUTS(LAYOUT) \
+    LAYOUT(init) \
+    LAYOUT(send) \
+    LAYOUT(send_id) \
+    LAYOUT(return_sync) \
+    LAYOUT(return_async) \
+    LAYOUT(returns_async) \
+    LAYOUT(reinit) \
+    LAYOUT(subscribe_count)
+
+/* FIELD(TYPE, NAME) */
+#define CLOUDI_PROTOCOL_LAYOUT_init(FIELD) \
+    FIELD(uint32,    process_index) \
+    FIELD(uint32,    process_count) \
+    FIELD(uint32,    process_count_max) \
+    FIELD(uint32,    process_count_min) \
+    FIELD(string,    prefix) \
+    FIELD(uint32,    timeout_initialize) \
+    FIELD(uint32,    timeout_async) \
+    FIELD(uint32,    timeout_sync) \
+    FIELD(uint32,    timeout_terminate) \
+    FIELD(int8,      priority_default) \
+    FIELD(uint8,     request_timeout_adjustment)
+#define CLOUDI_PROTOCOL_LAYOUT_send(FIELD) \
+    FIELD(string,    name) \
+    FIELD(string,    pattern) \
+    FIELD(binary,    request_info) \
+    FIELD(binary,    request) \
+    FIELD(uint32,    timeout) \
+    FIELD(int8,      priority) \
+    FIELD(trans_id,  trans_id) \
+    FIELD(term,      pid)
+/* a service request for a pattern that was subscribed with
+ * {subscribe, Pattern, CallbackId} provides the CallbackId,
+ * so the callback is found without the pattern */
+#define CLOUDI_PROTOCOL_LAYOUT_send_id(FIELD) \
+    FIELD(uint32,    callback_id) \
+    CLOUDI_PROTOCOL_LAYOUT_send(FIELD)
+#define CLOUDI_PROTOCOL_LAYOUT_return_sync(FIELD) \
+    FIELD(binary,    response_info) \
+    FIELD(binary,    response) \
+    FIELD(trans_id,  trans_id)
+#define CLOUDI_PROTOCOL_LAYOUT_return_async(FIELD) \
+    FIELD(trans_id,  trans_id)
+#define CLOUDI_PROTOCOL_LAYOUT_returns_async(FIELD) \
+    FIELD(trans_ids, trans_ids)
+#define CLOUDI_PROTOCOL_LAYOUT_reinit(FIELD) \
+    FIELD(uint32,    process_count)
+#define CLOUDI_PROTOCOL_LAYOUT_subscribe_count(FIELD) \
+    FIELD(uint32,    subscribe_count)
+
+/* The binary framing of the most frequent commands an external service
+ * sends to cloudi_core, used instead of the external term format after
+ * the service requests it with {init, binary} (the first byte of the
+ * frame is the command, so it is never the external term format version
+ * byte 131).  Each command is a fixed header followed by the data
+ * (all integers use the native byte order, the name and pattern
+ * are not '\0' terminated and the pid is external term format data):
+ *   send       uint8 command, uint32 timeout, int8 priority,
+ *              uint32 name_size, uint32 request_info_size,
+ *              uint32 request_size,
+ *              name, request_info, request
+ *   forward    uint8 command, uint32 timeout, int8 priority,
+ *              trans_id, uint32 name_size, uint32 request_info_size,
+ *              uint32 request_size, uint32 pid_size,
+ *              name, request_info, request, pid
+ *   return     uint8 command, uint32 timeout, trans_id,
+ *              uint32 name_size, uint32 pattern_size,
+ *              uint32 response_info_size, uint32 response_size,
+ *              uint32 pid_size,
+ *              name, pattern, response_info, response, pid
+ */
+
+/* COMMAND(NAME, TYPE, LAYOUT) */
+#define CLOUDI_PROTOCOL_COMMANDS(COMMAND) \
+    COMMAND(SEND_ASYNC,          1, send) \
+    COMMAND(SEND_SYNC,           2, send) \
+    COMMAND(MCAST_ASYNC,         3, send) \
+    COMMAND(FORWARD_ASYNC,       4, forward) \
+    COMMAND(FORWARD_SYNC,        5, forward) \
+    COMMAND(RETURN_ASYNC,        6, return) \
+    COMMAND(RETURN_SYNC,         7, return)
+
+#endif /* CLOUDI_PROTOCOL_H */
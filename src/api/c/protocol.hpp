@@ -0,0 +1,301 @@
+//-*-Mode:C++;coding:utf-8;tab-width:4;c-basic-offset:4;indent-tabs-mode:()-*-
+// ex: set ft=cpp fenc=utf-8 sts=4 ts=4 sw=4 et:
+//
+// BSD LICENSE
+// 
+// Copyright (c) 2015, Michael Truog <mjtruog at gmail dot com>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * All advertising materials mentioning features or use of this
+//       software must display the following acknowledgment:
+//         This product includes software developed by Michael Truog
+//     * The name of the author may not be used to endorse or promote
+//       products derived from this software without specific prior
+//       written permission
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include "cloudi_protocol.h"
+#include <stdint.h>
+#include <cstring>
+#include <ei.h>
+#include "assert.hpp"
+
+// decoding of the messages described by cloudi_protocol.h
+// with bounds-checking on every field.  the integer fields are copied with
+// memcpy, since the message fields are not aligned within the buffer.
+
+struct protocol_string
+{
+    char * data;
+    uint32_t size; // includes the '\0' terminator
+};
+
+struct protocol_binary
+{
+    char * data;
+    uint32_t size; // the '\0' terminator is not included
+};
+
+struct protocol_term
+{
+    char * data;
+    uint32_t size;
+};
+
+typedef uint32_t protocol_uint32;
+typedef int8_t protocol_int8;
+typedef uint8_t protocol_uint8;
+typedef char * protocol_trans_id;
+
+struct protocol_trans_ids
+{
+    char * data;
+    uint32_t count;
+};
+
+class protocol_decoder
+{
+    public:
+        protocol_decoder(char * const buffer,
+                         uint32_t const size,
+                         uint32_t const index = 0) :
+            m_buffer(buffer),
+            m_size(size),
+            m_index(index),
+            m_valid(index <= size)
+        {
+        }
+
+        // all fields decoded so far were within the buffer
+        bool valid() const
+        {
+            return m_valid;
+        }
+
+        // all the buffer data has been decoded
+        bool done() const
+        {
+            return m_index == m_size;
+        }
+
+        uint32_t index() const
+        {
+            return m_index;
+        }
+
+        // decode a new buffer from the start
+        void reset(char * const buffer, uint32_t const size)
+        {
+            m_buffer = buffer;
+            m_size = size;
+            m_index = 0;
+            m_valid = true;
+        }
+
+        void get(uint32_t & value)
+        {
+            get_integer(value);
+        }
+
+        void get(int8_t & value)
+        {
+            get_integer(value);
+        }
+
+        void get(uint8_t & value)
+        {
+            get_integer(value);
+        }
+
+        void get(protocol_string & value)
+        {
+            get_integer(value.size);
+            value.data = take(value.size);
+        }
+
+        void get(protocol_binary & value)
+        {
+            get_integer(value.size);
+            value.data = take(static_cast<uint64_t>(value.size) + 1);
+        }
+
+        void get(protocol_term & value)
+        {
+            get_integer(value.size);
+            value.data = take(value.size);
+        }
+
+        void get(protocol_trans_id & value)
+        {
+            value = take(16);
+        }
+
+        void get(protocol_trans_ids & value)
+        {
+            get_integer(value.count);
+            value.data = take(static_cast<uint64_t>(value.count) * 16);
+        }
+
+    private:
+        template <typename T>
+        void get_integer(T & value)
+        {
+            char const * const p = take(sizeof(T));
+            if (p)
+                ::memcpy(&value, p, sizeof(T));
+            else
+                value = 0;
+        }
+
+        char * take(uint64_t const size)
+        {
+            if (m_valid == false || size > m_size - m_index)
+            {
+                m_valid = false;
+                return 0;
+            }
+            char * const p = &m_buffer[m_index];
+            m_index += static_cast<uint32_t>(size);
+            return p;
+        }
+
+        char * m_buffer;
+        uint32_t m_size;
+        uint32_t m_index;
+        bool m_valid;
+};
+
+// message type constants
+#define PROTOCOL_MESSAGE_TYPE(NAME, TYPE, LAYOUT) \
+    uint32_t const MESSAGE_##NAME = TYPE;
+CLOUDI_PROTOCOL_MESSAGES(PROTOCOL_MESSAGE_TYPE)
+#undef PROTOCOL_MESSAGE_TYPE
+
+// a struct and a decode function for each message layout
+#define PROTOCOL_FIELD_MEMBER(TYPE, NAME) \
+    protocol_##TYPE NAME;
+#define PROTOCOL_FIELD_DECODE(TYPE, NAME) \
+    decoder.get(message.NAME);
+#define PROTOCOL_LAYOUT(LAYOUT) \
+    struct protocol_##LAYOUT \
+    { \
+        CLOUDI_PROTOCOL_LAYOUT_##LAYOUT(PROTOCOL_FIELD_MEMBER) \
+    }; \
+    inline bool protocol_decode(protocol_decoder & decoder, \
+                                protocol_##LAYOUT & message) \
+    { \
+        CLOUDI_PROTOCOL_LAYOUT_##LAYOUT(PROTOCOL_FIELD_DECODE) \
+        return decoder.valid(); \
+    }
+CLOUDI_PROTOCOL_LAYOUTS(PROTOCOL_LAYOUT)
+#undef PROTOCOL_LAYOUT
+#undef PROTOCOL_FIELD_DECODE
+#undef PROTOCOL_FIELD_MEMBER
+
+// binary framing command constants
+#define PROTOCOL_COMMAND_TYPE(NAME, TYPE, LAYOUT) \
+    uint8_t const COMMAND_##NAME = TYPE;
+CLOUDI_PROTOCOL_COMMANDS(PROTOCOL_COMMAND_TYPE)
+#undef PROTOCOL_COMMAND_TYPE
+
+// encoding of the binary framing commands described by cloudi_protocol.h
+// (the buffer must already be large enough for the data)
+class protocol_encoder
+{
+    public:
+        protocol_encoder(char * const buffer,
+                         int const index = 0) :
+            m_buffer(buffer),
+            m_index(index)
+        {
+        }
+
+        int index() const
+        {
+            return m_index;
+        }
+
+        void put(uint32_t const value)
+        {
+            put(&value, sizeof(value));
+        }
+
+        void put(int8_t const value)
+        {
+            put(&value, sizeof(value));
+        }
+
+        void put(uint8_t const value)
+        {
+            put(&value, sizeof(value));
+        }
+
+        void put(void const * const data, size_t const size)
+        {
+            ::memcpy(&m_buffer[m_index], data, size);
+            m_index += static_cast<int>(size);
+        }
+
+    private:
+        char * const m_buffer;
+        int m_index;
+};
+
+// encode the external term format version and the command tuple header
+// (the same data as ei_encode_version, ei_encode_tuple_header and
+//  ei_encode_atom, with the atom length known at compile time)
+inline void protocol_encode_command(char * const buffer, int & index,
+                                    char const * const name,
+                                    size_t const name_size,
+                                    int const arity)
+{
+    assert(arity >= 0 && arity < 256 && name_size < MAXATOMLEN);
+    char * s = &buffer[index];
+    *s++ = static_cast<char>(ERL_VERSION_MAGIC);
+    if (arity > 0)
+    {
+        *s++ = ERL_SMALL_TUPLE_EXT;
+        *s++ = static_cast<char>(arity);
+    }
+    *s++ = ERL_ATOM_EXT;
+    *s++ = static_cast<char>((name_size >> 8) & 0xff);
+    *s++ = static_cast<char>(name_size & 0xff);
+    ::memcpy(s, name, name_size);
+    index += static_cast<int>((s - &buffer[index]) + name_size);
+}
+
+template <size_t N>
+inline void protocol_encode_command(char * const buffer, int & index,
+                                    char const (&name)[N],
+                                    int const arity = 0)
+{
+    protocol_encode_command(buffer, index, name, N - 1, arity);
+}
+
+#endif // PROTOCOL_HPP
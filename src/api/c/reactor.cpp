@@ -0,0 +1,470 @@
+//-*-Mode:C++;coding:utf-8;tab-width:4;c-basic-offset:4;indent-tabs-mode:()-*-
+// ex: set ft=cpp fenc=utf-8 sts=4 ts=4 sw=4 et:
+//
+// BSD LICENSE
+// 
+// Copyright (c) 2015, Michael Truog <mjtruog at gmail dot com>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * All advertising materials mentioning features or use of this
+//       software must display the following acknowledgment:
+//         This product includes software developed by Michael Truog
+//     * The name of the author may not be used to endorse or promote
+//       products derived from this software without specific prior
+//       written permission
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+
+#include "cloudi.h"
+#include "copy_ptr.hpp"
+#include "config.h"
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#endif
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
+#include <vector>
+#include "assert.hpp"
+
+namespace
+{
+    // wait for incoming data on all the instance sockets with a single
+    // thread, an instance is disarmed after it is ready so only a single
+    // worker thread uses the instance until it is armed again
+    class poller
+    {
+        public:
+            static uint32_t const wake_index = 0xffffffff;
+
+            poller(uint32_t const count) :
+#if defined(HAVE_SYS_EPOLL_H)
+                m_fd(::epoll_create(count + 1))
+#else
+                m_fds(count),
+                m_armed(count, false)
+#endif
+            {
+                m_wake[0] = m_wake[1] = -1;
+                if (::pipe(m_wake) == 0)
+                {
+                    ::fcntl(m_wake[0], F_SETFL, O_NONBLOCK);
+                    ::fcntl(m_wake[1], F_SETFL, O_NONBLOCK);
+                }
+#if defined(HAVE_SYS_EPOLL_H)
+                if (m_fd != -1 && m_wake[0] != -1)
+                {
+                    struct epoll_event event;
+                    event.events = EPOLLIN;
+                    event.data.u32 = wake_index;
+                    ::epoll_ctl(m_fd, EPOLL_CTL_ADD, m_wake[0], &event);
+                }
+#endif
+            }
+
+            ~poller()
+            {
+#if defined(HAVE_SYS_EPOLL_H)
+                if (m_fd != -1)
+                    ::close(m_fd);
+#endif
+                if (m_wake[0] != -1)
+                {
+                    ::close(m_wake[0]);
+                    ::close(m_wake[1]);
+                }
+            }
+
+            bool valid() const
+            {
+#if defined(HAVE_SYS_EPOLL_H)
+                return (m_fd != -1 && m_wake[0] != -1);
+#else
+                return (m_wake[0] != -1);
+#endif
+            }
+
+            // add an armed instance socket
+            bool add(uint32_t const index, int const fd)
+            {
+#if defined(HAVE_SYS_EPOLL_H)
+                struct epoll_event event;
+                event.events = EPOLLIN | EPOLLPRI | EPOLLONESHOT;
+                event.data.u32 = index;
+                return (::epoll_ctl(m_fd, EPOLL_CTL_ADD, fd, &event) == 0);
+#else
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                m_fds[index].fd = fd;
+                m_fds[index].events = POLLIN | POLLPRI;
+                m_armed[index] = true;
+                return true;
+#endif
+            }
+
+            // the instance socket is ready to be waited on again
+            // (called by a worker thread)
+            bool arm(uint32_t const index, int const fd)
+            {
+#if defined(HAVE_SYS_EPOLL_H)
+                struct epoll_event event;
+                event.events = EPOLLIN | EPOLLPRI | EPOLLONESHOT;
+                event.data.u32 = index;
+                return (::epoll_ctl(m_fd, EPOLL_CTL_MOD, fd, &event) == 0);
+#else
+                {
+                    boost::lock_guard<boost::mutex> lock(m_mutex);
+                    assert(m_fds[index].fd == fd);
+                    m_armed[index] = true;
+                }
+                wake();
+                return true;
+#endif
+            }
+
+            // interrupt the wait
+            void wake()
+            {
+                char const byte = 0;
+                // EAGAIN means a wake is already pending
+                while (::write(m_wake[1], &byte, 1) == -1 && errno == EINTR)
+                {
+                }
+            }
+
+            // get the indexes of the ready instance sockets
+            // (wake_index is provided if wake() was called)
+            int wait(std::vector<uint32_t> & ready)
+            {
+                ready.clear();
+#if defined(HAVE_SYS_EPOLL_H)
+                struct epoll_event events[64];
+                int const count = ::epoll_wait(m_fd, events, 64, -1);
+                if (count == -1)
+                    return (errno == EINTR) ? 0 : cloudi_error_poll_unknown;
+                for (int i = 0; i < count; ++i)
+                {
+                    uint32_t const index = events[i].data.u32;
+                    if (index == wake_index)
+                        wake_clear();
+                    ready.push_back(index);
+                }
+#else
+                std::vector<struct pollfd> fds;
+                std::vector<uint32_t> indexes;
+                {
+                    boost::lock_guard<boost::mutex> lock(m_mutex);
+                    for (uint32_t index = 0; index < m_fds.size(); ++index)
+                    {
+                        if (m_armed[index])
+                        {
+                            fds.push_back(m_fds[index]);
+                            indexes.push_back(index);
+                        }
+                    }
+                }
+                struct pollfd const wake_fd = {m_wake[0], POLLIN, 0};
+                fds.push_back(wake_fd);
+                indexes.push_back(wake_index);
+                int const count = ::poll(&fds[0], fds.size(), -1);
+                if (count == -1)
+                    return (errno == EINTR) ? 0 : cloudi_error_poll_unknown;
+                boost::lock_guard<boost::mutex> lock(m_mutex);
+                for (size_t i = 0; i < fds.size(); ++i)
+                {
+                    if (fds[i].revents == 0)
+                        continue;
+                    uint32_t const index = indexes[i];
+                    if (index == wake_index)
+                    {
+                        wake_clear();
+                    }
+                    else
+                    {
+                        m_armed[index] = false;
+                    }
+                    ready.push_back(index);
+                }
+#endif
+                return cloudi_success;
+            }
+
+        private:
+            void wake_clear()
+            {
+                char bytes[64];
+                while (::read(m_wake[0], bytes, sizeof(bytes)) > 0)
+                {
+                }
+            }
+
+#if defined(HAVE_SYS_EPOLL_H)
+            int m_fd;
+#else
+            boost::mutex m_mutex;
+            std::vector<struct pollfd> m_fds;
+            std::vector<bool> m_armed;
+#endif
+            int m_wake[2];
+    };
+    uint32_t const poller::wake_index;
+
+    // the ready instances are queued on the worker thread
+    // that is preferred for each instance (for cache locality),
+    // an idle worker thread steals work from the other queues
+    class reactor
+    {
+        private:
+            class worker_queue
+            {
+                public:
+                    bool pop_back(uint32_t & index)
+                    {
+                        boost::lock_guard<boost::mutex> lock(m_mutex);
+                        if (m_queue.empty())
+                            return false;
+                        index = m_queue.back();
+                        m_queue.pop_back();
+                        return true;
+                    }
+
+                    bool pop_front(uint32_t & index)
+                    {
+                        boost::lock_guard<boost::mutex> lock(m_mutex);
+                        if (m_queue.empty())
+                            return false;
+                        index = m_queue.front();
+                        m_queue.pop_front();
+                        return true;
+                    }
+
+                    void push_back(uint32_t const index)
+                    {
+                        boost::lock_guard<boost::mutex> lock(m_mutex);
+                        m_queue.push_back(index);
+                    }
+
+                private:
+                    boost::mutex m_mutex;
+                    std::deque<uint32_t> m_queue;
+            };
+
+            class worker
+            {
+                public:
+                    worker(reactor & object, uint32_t const worker_index) :
+                        m_object(object), m_worker_index(worker_index) {}
+                    void operator () () { m_object.work(m_worker_index); }
+                private:
+                    reactor & m_object;
+                    uint32_t const m_worker_index;
+            };
+
+        public:
+            reactor(cloudi_instance_t ** instances,
+                    uint32_t const instances_count,
+                    uint32_t const worker_count) :
+                m_instances(instances),
+                m_instances_count(instances_count),
+                m_poller(instances_count),
+                m_queues(worker_count),
+                m_pending(0),
+                m_active(0),
+                m_done(false),
+                m_result(cloudi_success)
+            {
+                for (uint32_t i = 0; i < worker_count; ++i)
+                    m_queues[i].reset(new worker_queue());
+            }
+
+            int run()
+            {
+                if (! m_poller.valid())
+                    return cloudi_error_poll_unknown;
+
+                // the first cloudi_poll call completes the initialization
+                // of each instance within the current thread
+                for (uint32_t index = 0; index < m_instances_count; ++index)
+                {
+                    cloudi_instance_t * p = m_instances[index];
+                    int const result = cloudi_poll(p, 0);
+                    if (result == cloudi_timeout)
+                    {
+                        if (! m_poller.add(index, p->fd_in))
+                            return cloudi_error_poll_unknown;
+                        ++m_active;
+                    }
+                    else if (! (p->terminate &&
+                                (result == cloudi_success ||
+                                 result == cloudi_terminate)))
+                    {
+                        return result;
+                    }
+                }
+                if (m_active == 0)
+                    return cloudi_success;
+
+                boost::thread_group threads;
+                for (uint32_t i = 0; i < m_queues.size(); ++i)
+                    threads.create_thread(worker(*this, i));
+
+                std::vector<uint32_t> ready;
+                while (true)
+                {
+                    int const result = m_poller.wait(ready);
+                    if (result)
+                    {
+                        done(result);
+                        break;
+                    }
+                    for (size_t i = 0; i < ready.size(); ++i)
+                    {
+                        if (ready[i] != poller::wake_index)
+                            push(ready[i]);
+                    }
+                    boost::lock_guard<boost::mutex> lock(m_mutex);
+                    if (m_done)
+                        break;
+                }
+                threads.join_all();
+                return m_result;
+            }
+
+        private:
+            void push(uint32_t const index)
+            {
+                m_queues[index % m_queues.size()]->push_back(index);
+                {
+                    boost::lock_guard<boost::mutex> lock(m_mutex);
+                    ++m_pending;
+                }
+                m_condition.notify_one();
+            }
+
+            bool pop(uint32_t const worker_index, uint32_t & index)
+            {
+                {
+                    boost::unique_lock<boost::mutex> lock(m_mutex);
+                    while (m_pending == 0 && ! m_done)
+                        m_condition.wait(lock);
+                    if (m_done)
+                        return false;
+                    --m_pending;
+                }
+                // an index was pushed before m_pending was incremented
+                if (m_queues[worker_index]->pop_back(index))
+                    return true;
+                while (true)
+                {
+                    for (uint32_t i = 1; i < m_queues.size(); ++i)
+                    {
+                        uint32_t const steal_index =
+                            (worker_index + i) % m_queues.size();
+                        if (m_queues[steal_index]->pop_front(index))
+                            return true;
+                    }
+                    if (m_queues[worker_index]->pop_back(index))
+                        return true;
+                }
+            }
+
+            void done(int const result)
+            {
+                {
+                    boost::lock_guard<boost::mutex> lock(m_mutex);
+                    if (m_done)
+                        return;
+                    m_done = true;
+                    m_result = result;
+                }
+                m_condition.notify_all();
+                m_poller.wake();
+            }
+
+            void work(uint32_t const worker_index)
+            {
+                uint32_t index = 0;
+                while (pop(worker_index, index))
+                {
+                    cloudi_instance_t * p = m_instances[index];
+                    int const result = cloudi_poll(p, 0);
+                    if (result == cloudi_timeout)
+                    {
+                        if (! m_poller.arm(index, p->fd_in))
+                            done(cloudi_error_poll_unknown);
+                    }
+                    else if (p->terminate &&
+                             (result == cloudi_success ||
+                              result == cloudi_terminate))
+                    {
+                        bool terminated;
+                        {
+                            boost::lock_guard<boost::mutex> lock(m_mutex);
+                            terminated = (--m_active == 0);
+                        }
+                        if (terminated)
+                            done(cloudi_success);
+                    }
+                    else
+                    {
+                        done(result);
+                    }
+                }
+            }
+
+            cloudi_instance_t ** const m_instances;
+            uint32_t const m_instances_count;
+            poller m_poller;
+            std::vector< copy_ptr<worker_queue> > m_queues;
+            boost::mutex m_mutex;
+            boost::condition_variable m_condition;
+            uint32_t m_pending;
+            uint32_t m_active;
+            bool m_done;
+            int m_result;
+    };
+
+} // anonymous namespace
+
+extern "C" {
+
+int cloudi_poll_reactor(cloudi_instance_t ** instances,
+                        uint32_t const instances_count,
+                        uint32_t const worker_count)
+{
+    if (instances == 0 || instances_count == 0 || worker_count == 0)
+        return cloudi_error_function_parameter;
+    reactor object(instances, instances_count, worker_count);
+    return object.run();
+}
+
+} // extern C
+
@@ -123,6 +123,21 @@ public:
         return true;
     }
 
+    // exchange the allocations of two realloc_ptr objects
+    // that share the same size limits (avoids a copy)
+    void swap(realloc_ptr & other) throw()
+    {
+        assert(&other != this);
+        assert(m_initialSize == other.m_initialSize);
+        assert(m_maxSize == other.m_maxSize);
+        T * const p = m_p;
+        m_p = other.m_p;
+        other.m_p = p;
+        size_t const size = m_size;
+        m_size = other.m_size;
+        other.m_size = size;
+    }
+
     bool grow()
     {
         size_t const newSize = m_size << 1;
@@ -153,6 +168,25 @@ public:
         return true;
     }
 
+    // reduce the allocation to the smallest power of 2 that is greater
+    // than size (but not less than the initial size)
+    bool shrink(size_t size)
+    {
+        size_t newSize = m_initialSize;
+        while (size >= newSize)
+            newSize <<= 1;
+        if (newSize >= m_size)
+            return false;
+        T * tmp = reinterpret_cast<T *>(realloc(m_p, newSize * sizeof(T)));
+        if (! tmp)
+            return false;
+        m_p = tmp;
+        m_size = newSize;
+        return true;
+    }
+
+    size_t initial_size() const { return m_initialSize; }
+
 private:
     // find a value >= totalSize as a power of 2
     size_t greater_pow2(size_t n)
@@ -60,6 +60,28 @@ double timer::elapsed() const
             static_cast<double>(end.tv_nsec - m_start.tv_nsec) * 1.0e-9);
 }
 
+uint64_t timer::elapsed_nanoseconds() const
+{
+    struct timespec end;
+    ::clock_gettime(CLOCK_MONOTONIC, &end);
+    return (static_cast<int64_t>(end.tv_sec - m_start.tv_sec) * 1000000000 +
+            static_cast<int64_t>(end.tv_nsec - m_start.tv_nsec));
+}
+
+uint64_t clock_milliseconds()
+{
+    struct timespec now;
+#if defined(CLOCK_MONOTONIC_COARSE)
+    // the coarse clock avoids reading the clock source and its resolution
+    // (the scheduler tick) is sufficient for millisecond timeouts
+    ::clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+    return (static_cast<uint64_t>(now.tv_sec) * 1000 +
+            static_cast<uint64_t>(now.tv_nsec) / 1000000);
+}
+
 #else
 
 timer::timer()
@@ -80,5 +102,21 @@ double timer::elapsed() const
             static_cast<double>(end.tv_usec - m_start.tv_usec) * 1.0e-6);
 }
 
+uint64_t timer::elapsed_nanoseconds() const
+{
+    struct timeval end;
+    ::gettimeofday(&end, 0);
+    return (static_cast<int64_t>(end.tv_sec - m_start.tv_sec) * 1000000000 +
+            static_cast<int64_t>(end.tv_usec - m_start.tv_usec) * 1000);
+}
+
+uint64_t clock_milliseconds()
+{
+    struct timeval now;
+    ::gettimeofday(&now, 0);
+    return (static_cast<uint64_t>(now.tv_sec) * 1000 +
+            static_cast<uint64_t>(now.tv_usec) / 1000);
+}
+
 #endif
 
@@ -41,6 +41,7 @@
 #define TIMER_HPP
 
 #include "config.h"
+#include <stdint.h>
 #if HAVE_CLOCK_GETTIME_MONOTONIC
 #include <time.h>
 #else
@@ -54,6 +55,8 @@ class timer
         void restart();
         // get elapsed time in seconds
         double elapsed() const;
+        // get elapsed time in nanoseconds
+        uint64_t elapsed_nanoseconds() const;
     private:
 #if HAVE_CLOCK_GETTIME_MONOTONIC
         struct timespec m_start;
@@ -63,5 +66,9 @@ class timer
         
 };
 
+// the current time of a monotonic clock in milliseconds
+// (for absolute request deadlines)
+uint64_t clock_milliseconds();
+
 #endif // TIMER_HPP
 
@@ -46,18 +46,24 @@ __all__ = [
     'terminate_exception',
 ]
 
-import sys, os, socket
+import sys, os, socket, errno, traceback
 import libcloudi_py
 
 class API(object):
     ASYNC  =  1
     SYNC   = -1
 
-    def __init__(self, thread_index):
+    def __init__(self, thread_index, zero_copy=False):
+        # zero_copy provides request_info and request as read-only
+        # memoryview objects that are only valid during the callback
+        # (Python >= 3.3, otherwise bytes objects are provided),
+        # keeping a slice or buffer export of them after the callback
+        # raises invalid_input_exception in place of the callback result
+        # (a request not already returned then gets a null response)
         self.__timeout_terminate = 1000 # TIMEOUT_TERMINATE_MIN
         exception = None
         try:
-            self.__api = libcloudi_py.cloudi_c(thread_index)
+            self.__api = libcloudi_py.cloudi_c(thread_index, zero_copy)
         except Exception as e:
             exception = e
         if exception is not None:
@@ -71,9 +77,60 @@ class API(object):
             raise invalid_input_exception()
         return int(s)
 
+    @staticmethod
+    def thread_processes(target):
+        # run target(thread_index) for each thread_index in a separate
+        # forked OS process (with its own GIL), sharing the same
+        # service configuration, and return once all have exited
+        # (the return value is the number of processes that failed)
+        thread_count = API.thread_count()
+        pids = []
+        for thread_index in range(thread_count):
+            pid = os.fork()
+            if pid == 0:
+                for i in range(thread_count):
+                    if i != thread_index:
+                        os.close(i + 3)
+                # the child process never returns from this function
+                # (SystemExit and KeyboardInterrupt exit with a failure)
+                status = 1
+                try:
+                    target(thread_index)
+                    status = 0
+                except terminate_exception:
+                    status = 0
+                except Exception:
+                    traceback.print_exc(file=sys.stderr)
+                finally:
+                    sys.stdout.flush()
+                    sys.stderr.flush()
+                    os._exit(status)
+            pids.append(pid)
+        for i in range(thread_count):
+            os.close(i + 3)
+        failures = 0
+        for pid in pids:
+            while True:
+                try:
+                    status = os.waitpid(pid, 0)[1]
+                    break
+                except OSError as e:
+                    if e.errno != errno.EINTR:
+                        raise
+            if status != 0:
+                failures += 1
+        return failures
+
     def subscribe(self, pattern, Function):
         self.__api.subscribe(pattern, Function)
 
+    def subscribe_batch(self, pattern, Function, batch_max):
+        # Function is called with a list of the requests received together
+        # (up to batch_max), each a tuple of the subscribe Function
+        # arguments, and returns a list of the responses (or None after
+        # using return_batch)
+        self.__api.subscribe_batch(pattern, Function, batch_max)
+
     def subscribe_count(self, pattern):
         try:
             return self.__api.subscribe_count(pattern)
@@ -182,6 +239,9 @@ class API(object):
                                timeout, trans_id, pid)
         raise return_sync_exception()
 
+    def return_batch(self, responses):
+        self.__api.return_batch(responses)
+
     def recv_async(self, timeout=None, trans_id=None, consume=None):
         kwargs = {}
         if timeout is not None:
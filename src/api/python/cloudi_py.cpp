@@ -49,6 +49,7 @@
 #include "cloudi.hpp"
 #include <limits>
 #include <string>
+#include <vector>
 #include <cstring>
 
 static PyObject *python_cloudi_assert_exception;
@@ -69,10 +70,16 @@ static PyObject *python_cloudi_terminate_exception;
     }
 #endif
 
+class python_response;
+static python_response * python_response_new();
+static void python_response_delete(python_response * response);
+
 typedef struct {
     PyObject_HEAD;
     CloudI::API * api;
     PyThreadState * thread_state;
+    python_response * response;
+    bool zero_copy;
 } python_cloudi_instance_object;
 
 static void
@@ -91,6 +98,11 @@ python_cloudi_instance_object_dealloc(PyObject * self)
         PyEval_RestoreThread(object->thread_state);
         object->thread_state = 0;
     }
+    if (object->response != 0)
+    {
+        python_response_delete(object->response);
+        object->response = 0;
+    }
     PyObject_Del(self);
 }
 
@@ -103,6 +115,8 @@ python_cloudi_instance_object_new(PyTypeObject * type, PyObject *, PyObject *)
     {
         self->api = 0;
         self->thread_state = 0;
+        self->response = 0;
+        self->zero_copy = false;
     }
     return (PyObject *) self;
 }
@@ -113,7 +127,8 @@ python_cloudi_instance_object_init(PyObject * self, PyObject * args, PyObject *)
     python_cloudi_instance_object * object =
         (python_cloudi_instance_object *) self;
     unsigned int thread_index;
-    if (! PyArg_ParseTuple(args, "I:__init__()", &thread_index))
+    int zero_copy = 0;
+    if (! PyArg_ParseTuple(args, "I|i:__init__()", &thread_index, &zero_copy))
     {
         return -1;
     }
@@ -121,6 +136,11 @@ python_cloudi_instance_object_init(PyObject * self, PyObject * args, PyObject *)
     {
         object->api = new CloudI::API(thread_index);
         object->thread_state = 0;
+        if (object->response == 0)
+            object->response = python_response_new();
+        object->zero_copy = (zero_copy != 0);
+        // the callback releases python objects after the return
+        object->api->return_nothrow(true);
     }
     catch (CloudI::API::invalid_input_exception const & e)
     {
@@ -297,6 +317,8 @@ python_error(int value)
 static PyObject *
 python_cloudi_subscribe(PyObject * self, PyObject * args);
 static PyObject *
+python_cloudi_subscribe_batch(PyObject * self, PyObject * args);
+static PyObject *
 python_cloudi_subscribe_count(PyObject * self, PyObject * args);
 static PyObject *
 python_cloudi_unsubscribe(PyObject * self, PyObject * args);
@@ -315,6 +337,8 @@ python_cloudi_return_async(PyObject * self, PyObject * args);
 static PyObject *
 python_cloudi_return_sync(PyObject * self, PyObject * args);
 static PyObject *
+python_cloudi_return_batch(PyObject * self, PyObject * args);
+static PyObject *
 python_cloudi_recv_async(PyObject * self, PyObject * args, PyObject * kwargs);
 static PyObject *
 python_cloudi_process_index(PyObject * self, PyObject *);
@@ -341,6 +365,9 @@ static PyMethodDef python_cloudi_instance_object_methods[] = {
     {"subscribe",
      python_cloudi_subscribe, METH_VARARGS,
      "Subscribe to a service name with a callback function."},
+    {"subscribe_batch",
+     python_cloudi_subscribe_batch, METH_VARARGS,
+     "Subscribe to a service name with a batch function."},
     {"subscribe_count",
      python_cloudi_subscribe_count, METH_VARARGS,
      "Determine how may service name pattern subscriptions have occurred."},
@@ -368,6 +395,9 @@ static PyMethodDef python_cloudi_instance_object_methods[] = {
     {"return_sync",
      python_cloudi_return_sync, METH_VARARGS,
      "Return a response synchronously."},
+    {"return_batch",
+     python_cloudi_return_batch, METH_VARARGS,
+     "Return the responses of a batch function."},
     {"recv_async",
      (PyCFunction) python_cloudi_recv_async, METH_VARARGS | METH_KEYWORDS,
      "Receive an asynchronous response synchronously."},
@@ -462,6 +492,82 @@ static PyTypeObject python_cloudi_instance_type = {
 #endif 
 };
 
+#ifdef PYTHON_VERSION_3_3_COMPATIBLE
+// the exporter of request data for a zero_copy memoryview,
+// which counts the buffers that refer to the request data
+// (the memoryview, any slice of it and any export of either),
+// and refuses new exports after the callback function call
+typedef struct {
+    PyObject_HEAD;
+    char * data;
+    Py_ssize_t size;
+    Py_ssize_t exports;
+} python_request_data_object;
+
+static void
+python_request_data_object_dealloc(PyObject * self)
+{
+    PyObject_Del(self);
+}
+
+static int
+python_request_data_object_getbuffer(PyObject * self,
+                                     Py_buffer * view, int flags)
+{
+    python_request_data_object * object =
+        (python_request_data_object *) self;
+    if (object->data == 0)
+    {
+        view->obj = NULL;
+        PyErr_SetString(PyExc_BufferError,
+                        "request data is only valid during the callback");
+        return -1;
+    }
+    if (PyBuffer_FillInfo(view, self, object->data, object->size,
+                          1, flags) != 0)
+        return -1;
+    ++object->exports;
+    return 0;
+}
+
+static void
+python_request_data_object_releasebuffer(PyObject * self, Py_buffer *)
+{
+    python_request_data_object * object =
+        (python_request_data_object *) self;
+    --object->exports;
+}
+
+static PyBufferProcs python_request_data_object_buffer = {
+    python_request_data_object_getbuffer,    // bf_getbuffer
+    python_request_data_object_releasebuffer // bf_releasebuffer
+};
+
+static PyTypeObject python_request_data_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "libcloudi_py.request_data",             // tp_name
+    sizeof(python_request_data_object),      // tp_basicsize
+    0,                                       // tp_itemsize
+    python_request_data_object_dealloc,      // tp_dealloc
+    0,                                       // tp_print
+    0,                                       // tp_getattr
+    0,                                       // tp_setattr
+    0,                                       // tp_compare (now tp_reserved)
+    0,                                       // tp_repr
+    0,                                       // tp_as_number
+    0,                                       // tp_as_sequence
+    0,                                       // tp_as_mapping
+    0,                                       // tp_hash 
+    0,                                       // tp_call
+    0,                                       // tp_str
+    0,                                       // tp_getattro
+    0,                                       // tp_setattro
+    &python_request_data_object_buffer,      // tp_as_buffer
+    Py_TPFLAGS_DEFAULT,                      // tp_flags
+    "CloudI zero_copy request data",         // tp_doc
+};
+#endif
+
 static PyMethodDef python_cloudi_methods[] = {
     {NULL, NULL, 0, NULL} // Sentinel
 };
@@ -498,6 +604,10 @@ MODINIT_FUNC_DECLARE(libcloudi_py)
 
     if (PyType_Ready(&python_cloudi_instance_type) < 0)
         MODINIT_FUNC_RETURN_NULL;
+#ifdef PYTHON_VERSION_3_3_COMPATIBLE
+    if (PyType_Ready(&python_request_data_type) < 0)
+        MODINIT_FUNC_RETURN_NULL;
+#endif
 
     Py_INCREF(&python_cloudi_instance_type);
     PyModule_AddObject(m, "cloudi_c",
@@ -544,15 +654,19 @@ MODINIT_FUNC_DECLARE(libcloudi_py)
 // Py_BEGIN_ALLOW_THREADS
 // Py_END_ALLOW_THREADS
 
+// (the previous callback response is released after the GIL is acquired)
+
 // callback class
 #define THREADS_BLOCK       PyEval_RestoreThread(m_thread_state); \
-                            m_thread_state = 0
+                            m_thread_state = 0; \
+                            m_response.release()
 #define THREADS_UNBLOCK     m_thread_state = PyEval_SaveThread()
 
 // member functions
 #define THREADS_BEGIN       object->thread_state = PyEval_SaveThread()
 #define THREADS_END         PyEval_RestoreThread(object->thread_state); \
-                            object->thread_state = 0
+                            object->thread_state = 0; \
+                            object->response->release()
 
 #ifdef PYTHON_VERSION_3_COMPATIBLE
 #define BUILDVALUE_BYTES "y#"
@@ -560,11 +674,431 @@ MODINIT_FUNC_DECLARE(libcloudi_py)
 #define BUILDVALUE_BYTES "s#"
 #endif
 
+// payload data of any object that supports the buffer protocol
+// (bytes, bytearray, memoryview, mmap, numpy arrays, etc.) without a copy,
+// the buffer is released when the scope ends (while holding the GIL)
+class python_buffer
+{
+    public:
+        python_buffer()
+        {
+            ::memset(&m_view, 0, sizeof(m_view));
+        }
+        ~python_buffer()
+        {
+            release();
+        }
+
+        bool get(PyObject * object)
+        {
+            release();
+            if (PyObject_GetBuffer(object, &m_view, PyBUF_SIMPLE) != 0)
+            {
+                ::memset(&m_view, 0, sizeof(m_view));
+                return false;
+            }
+            if (static_cast<uint64_t>(m_view.len) >
+                std::numeric_limits<uint32_t>::max())
+            {
+                release();
+                PyErr_SetString(python_cloudi_invalid_input_exception,
+                                "buffer too large");
+                return false;
+            }
+            return true;
+        }
+
+        // unicode is provided as UTF-8 (for a callback function response)
+        bool get_response(PyObject * object)
+        {
+            if (! PyUnicode_Check(object))
+                return get(object);
+            PyObject * utf8 = PyUnicode_AsUTF8String(object);
+            if (utf8 == NULL)
+                return false;
+            bool const result = get(utf8);
+            Py_DECREF(utf8);
+            return result;
+        }
+
+        void release()
+        {
+            if (m_view.obj)
+            {
+                PyBuffer_Release(&m_view);
+                ::memset(&m_view, 0, sizeof(m_view));
+            }
+        }
+
+        char const * data() const
+        {
+            return reinterpret_cast<char const *>(m_view.buf);
+        }
+
+        uint32_t size() const
+        {
+            return static_cast<uint32_t>(m_view.len);
+        }
+
+    private:
+        python_buffer(python_buffer const &);
+        python_buffer & operator =(python_buffer const &);
+        Py_buffer m_view;
+};
+
+// PyArg_ParseTuple "O&" converter for python_buffer arguments
+static int
+python_buffer_converter(PyObject * object, void * buffer)
+{
+    return reinterpret_cast<python_buffer *>(buffer)->get(object) ? 1 : 0;
+}
+
+// the responses of a batch function, provided as a sequence of
+// response objects or (response_info, response) tuples
+class python_batch_responses
+{
+    public:
+        python_batch_responses(uint32_t const count) :
+            m_buffers(new python_buffer[count * 2]),
+            m_responses(count)
+        {
+        }
+        ~python_batch_responses()
+        {
+            delete [] m_buffers;
+        }
+
+        bool set(PyObject * object)
+        {
+            PyObject * sequence =
+                PySequence_Fast(object, "responses must be a sequence");
+            if (sequence == NULL)
+                return false;
+            bool result = true;
+            uint32_t const count = m_responses.size();
+            if (PySequence_Fast_GET_SIZE(sequence) !=
+                static_cast<Py_ssize_t>(count))
+            {
+                PyErr_SetString(python_cloudi_invalid_input_exception,
+                                "responses must match the requests");
+                result = false;
+            }
+            for (uint32_t i = 0; result && i < count; ++i)
+            {
+                PyObject * item = PySequence_Fast_GET_ITEM(sequence, i);
+                python_buffer & response_info = m_buffers[i * 2];
+                python_buffer & response = m_buffers[i * 2 + 1];
+                if (PyTuple_Check(item) && PyTuple_Size(item) == 2)
+                {
+                    result = response_info.get_response(
+                                 PyTuple_GET_ITEM(item, 0)) &&
+                             response.get_response(
+                                 PyTuple_GET_ITEM(item, 1));
+                }
+                else
+                {
+                    result = response.get_response(item);
+                }
+                cloudi_batch_response_t const value = {
+                    response_info.data(), response_info.size(),
+                    response.data(), response.size()};
+                m_responses[i] = value;
+            }
+            Py_DECREF(sequence);
+            return result;
+        }
+
+        cloudi_batch_response_t const * get() const
+        {
+            if (m_responses.empty())
+                return 0;
+            return &m_responses[0];
+        }
+
+    private:
+        python_batch_responses(python_batch_responses const &);
+        python_batch_responses & operator =(python_batch_responses const &);
+        python_buffer * m_buffers;
+        std::vector<cloudi_batch_response_t> m_responses;
+};
+
+// the python objects of the last callback function response, which are
+// used without a copy until the response is written after the GIL is
+// released, and then released the next time the GIL is acquired
+// (to avoid acquiring the GIL again only to release them)
+class python_response
+{
+    public:
+        python_response() :
+            m_result(0),
+            m_batch_responses(0)
+        {
+        }
+        ~python_response()
+        {
+            release();
+        }
+
+        python_buffer & response_info()
+        {
+            return m_response_info;
+        }
+
+        python_buffer & response()
+        {
+            return m_response;
+        }
+
+        // keeps the reference of the callback function result
+        void set(PyObject * result)
+        {
+            assert(m_result == 0);
+            m_result = result;
+        }
+
+        // keeps the batch function responses and the result reference
+        void set(python_batch_responses * batch_responses, PyObject * result)
+        {
+            assert(m_batch_responses == 0 && m_result == 0);
+            m_batch_responses = batch_responses;
+            m_result = result;
+        }
+
+        void release()
+        {
+            m_response_info.release();
+            m_response.release();
+            delete m_batch_responses;
+            m_batch_responses = 0;
+            Py_XDECREF(m_result);
+            m_result = 0;
+        }
+
+    private:
+        python_response(python_response const &);
+        python_response & operator =(python_response const &);
+        python_buffer m_response_info;
+        python_buffer m_response;
+        PyObject * m_result;
+        python_batch_responses * m_batch_responses;
+};
+
+static python_response *
+python_response_new()
+{
+    return new python_response();
+}
+
+static void
+python_response_delete(python_response * response)
+{
+    delete response;
+}
+
+#ifdef PYTHON_VERSION_3_3_COMPATIBLE
+// a read-only memoryview of request data that is only valid during
+// the callback function call (the memoryview is released afterwards,
+// so using it later raises an exception instead of reading stale data)
+static PyObject *
+python_memoryview(void const * const data, uint32_t const size)
+{
+    python_request_data_object * object =
+        PyObject_New(python_request_data_object, &python_request_data_type);
+    if (object == NULL)
+        return NULL;
+    object->data = const_cast<char *>(reinterpret_cast<char const *>(data));
+    object->size = size;
+    object->exports = 0;
+    PyObject * view = PyMemoryView_FromObject((PyObject *) object);
+    Py_DECREF(object);
+    return view;
+}
+
+// memoryview.release() fails if the memoryview is still exported
+static bool
+python_memoryview_release_call(PyObject * view)
+{
+    PyObject * result = PyObject_CallMethod(view, "release", NULL);
+    if (result == NULL)
+    {
+        PyErr_Clear();
+        return false;
+    }
+    Py_DECREF(result);
+    return true;
+}
+
+// clear the frames of a traceback, so the local variables of the
+// callback function (e.g., a slice of the request) are released
+static void
+python_traceback_clear_frames(PyObject * traceback)
+{
+    PyObject * module = PyImport_ImportModule("traceback");
+    if (module != NULL)
+    {
+        PyObject * result = PyObject_CallMethod(module, "clear_frames",
+                                                "O", traceback);
+        Py_XDECREF(result);
+        Py_DECREF(module);
+    }
+    PyErr_Clear();
+}
+
+// returns false (with an exception) if the request data is still
+// referenced after the memoryview is released, i.e., the memoryview
+// was exported or sliced and kept after the callback function call
+// (the request data memory is reused, so this is an error)
+static bool
+python_memoryview_release(PyObject * view)
+{
+    python_request_data_object * object =
+        (python_request_data_object *) PyMemoryView_GET_BUFFER(view)->obj;
+    Py_INCREF(object);
+    PyObject * type;
+    PyObject * value;
+    PyObject * traceback;
+    PyErr_Fetch(&type, &value, &traceback);
+    bool released = python_memoryview_release_call(view);
+    if ((! released || object->exports != 0) && traceback != NULL)
+    {
+        // the callback function exited with an exception
+        // (e.g., after calling return_ or forward_) and the traceback
+        // keeps the function frame with its local variables
+        python_traceback_clear_frames(traceback);
+        if (! released)
+            released = python_memoryview_release_call(view);
+    }
+    Py_DECREF(view);
+    bool const kept = (! released || object->exports != 0);
+    object->data = 0;
+    Py_DECREF(object);
+    if (kept)
+    {
+        Py_XDECREF(type);
+        Py_XDECREF(value);
+        Py_XDECREF(traceback);
+        PyErr_SetString(python_cloudi_invalid_input_exception,
+                        "zero_copy request data kept after the callback");
+        return false;
+    }
+    PyErr_Restore(type, value, traceback);
+    return true;
+}
+#endif
+
+// the arguments of a python function for a single request
+// (with zero_copy the request_info and request memoryview objects
+//  are released after the function call, and must not be kept,
+//  sliced or exported beyond the function call)
+class python_request
+{
+    public:
+        python_request() :
+            m_args(0),
+            m_request_info(0),
+            m_request(0),
+            m_zero_copy(false)
+        {
+        }
+        ~python_request()
+        {
+            release();
+        }
+
+        bool set(bool const zero_copy,
+                 int const command,
+                 char const * const name,
+                 char const * const pattern,
+                 void const * const request_info,
+                 uint32_t const request_info_size,
+                 void const * const request,
+                 uint32_t const request_size,
+                 uint32_t timeout,
+                 int8_t priority,
+                 char const * const trans_id,
+                 char const * const pid,
+                 uint32_t const pid_size)
+        {
+#ifdef PYTHON_VERSION_3_3_COMPATIBLE
+            m_zero_copy = zero_copy;
+            if (m_zero_copy)
+            {
+                m_request_info = python_memoryview(request_info,
+                                                   request_info_size);
+                m_request = python_memoryview(request, request_size);
+            }
+            else
+#endif
+            {
+                m_request_info = PyBytes_FromStringAndSize(
+                    reinterpret_cast<char const *>(request_info),
+                    request_info_size);
+                m_request = PyBytes_FromStringAndSize(
+                    reinterpret_cast<char const *>(request),
+                    request_size);
+            }
+            if (m_request_info && m_request)
+            {
+                m_args = Py_BuildValue("(i,s,s,O,O,I,i,N,N)",
+                                       command, name, pattern,
+                                       m_request_info, m_request,
+                                       timeout, static_cast<int>(priority),
+                                       PyBytes_FromStringAndSize(trans_id, 16),
+                                       PyBytes_FromStringAndSize(pid,
+                                                                 pid_size));
+            }
+            return (m_args != 0);
+        }
+
+        // provides a new reference
+        PyObject * args() const
+        {
+            Py_INCREF(m_args);
+            return m_args;
+        }
+
+        // returns false (with an exception) if the zero_copy
+        // request data was kept after the function call
+        bool release()
+        {
+            Py_XDECREF(m_args);
+            m_args = 0;
+#ifdef PYTHON_VERSION_3_3_COMPATIBLE
+            if (m_zero_copy)
+            {
+                bool result = true;
+                if (m_request_info &&
+                    ! python_memoryview_release(m_request_info))
+                    result = false;
+                if (m_request &&
+                    ! python_memoryview_release(m_request))
+                    result = false;
+                m_request_info = m_request = 0;
+                return result;
+            }
+#endif
+            Py_XDECREF(m_request_info);
+            Py_XDECREF(m_request);
+            m_request_info = m_request = 0;
+            return true;
+        }
+
+    private:
+        python_request(python_request const &);
+        python_request & operator =(python_request const &);
+        PyObject * m_args;
+        PyObject * m_request_info;
+        PyObject * m_request;
+        bool m_zero_copy;
+};
+
 class callback : public CloudI::API::function_object_c
 {
     public:
-        callback(PyObject * f, PyThreadState *& thread_state) :
-            m_f(f), m_thread_state(thread_state)
+        callback(PyObject * f, PyThreadState *& thread_state,
+                 python_response & response, bool const zero_copy) :
+            m_f(f), m_thread_state(thread_state), m_response(response),
+            m_zero_copy(zero_copy)
         {
             Py_INCREF(m_f);
         }
@@ -574,7 +1108,8 @@ class callback : public CloudI::API::function_object_c
         }
         callback(callback const & o) :
             CloudI::API::function_object_c(o),
-            m_f(o.m_f), m_thread_state(o.m_thread_state)
+            m_f(o.m_f), m_thread_state(o.m_thread_state),
+            m_response(o.m_response), m_zero_copy(o.m_zero_copy)
         {
             Py_INCREF(m_f);
         }
@@ -594,24 +1129,29 @@ class callback : public CloudI::API::function_object_c
                                   uint32_t const pid_size)
         {
             THREADS_BLOCK;
-            PyObject * args = Py_BuildValue("(i,s,s,"
-                                            BUILDVALUE_BYTES ","
-                                            BUILDVALUE_BYTES ",I,i,"
-                                            BUILDVALUE_BYTES ","
-                                            BUILDVALUE_BYTES ")",
-                                            command, name, pattern,
-                                            request_info, request_info_size,
-                                            request, request_size, timeout,
-                                            static_cast<int>(priority),
-                                            trans_id, 16, pid, pid_size);
-            if (! args)
+            PyObject * result;
             {
-                PyErr_Print();
-                THREADS_UNBLOCK;
-                return;
+                python_request args;
+                if (! args.set(m_zero_copy, command, name, pattern,
+                               request_info, request_info_size,
+                               request, request_size, timeout, priority,
+                               trans_id, pid, pid_size))
+                {
+                    PyErr_Print();
+                    args.release();
+                    THREADS_UNBLOCK;
+                    return;
+                }
+                PyObject * const args_tuple = args.args();
+                result = PyObject_CallObject(m_f, args_tuple);
+                Py_DECREF(args_tuple);
+                if (! args.release())
+                {
+                    // the exception replaces the function result
+                    Py_XDECREF(result);
+                    result = NULL;
+                }
             }
-            PyObject * result = PyObject_CallObject(m_f, args);
-            Py_DECREF(args);
             if (result == NULL)
             {
                 PyTypeObject * exception =
@@ -689,113 +1229,42 @@ class callback : public CloudI::API::function_object_c
             {
                 // data to return from the callback may have been
                 // returned by the python callback function
-                char * response_info = 0;
-                uint32_t response_info_size = 0;
-                char * response = 0;
-                uint32_t response_size = 0;
+                // (the data is used without a copy, so the result
+                //  is kept until the response is written)
+                python_buffer & response_info = m_response.response_info();
+                python_buffer & response = m_response.response();
+                m_response.set(result);
                 bool result_invalid = false;
                 if (PyTuple_Check(result) &&
                     PyTuple_Size(result) == 2)
                 {
-                    Py_ssize_t response_info_size_tmp = 0;
-                    Py_ssize_t response_size_tmp = 0;
-                    if (! PyArg_ParseTuple(result,
-                                           BUILDVALUE_BYTES
-                                           BUILDVALUE_BYTES,
+                    if (! PyArg_ParseTuple(result, "O&O&",
+                                           python_buffer_converter,
                                            &response_info,
-                                           &response_info_size_tmp,
-                                           &response,
-                                           &response_size_tmp))
+                                           python_buffer_converter,
+                                           &response))
                     {
                         PyErr_Print();
                         result_invalid = true;
                     }
-                    else if (response_info_size_tmp < 0 ||
-                             static_cast<uint32_t>(response_info_size_tmp) >
-                             std::numeric_limits<uint32_t>::max() ||
-                             response_size_tmp < 0 ||
-                             static_cast<uint32_t>(response_size_tmp) >
-                             std::numeric_limits<uint32_t>::max())
-                    {
-                        result_invalid = true;
-                    }
-                    else
-                    {
-                        response_info_size =
-                            static_cast<uint32_t>(response_info_size_tmp);
-                        response_size =
-                            static_cast<uint32_t>(response_size_tmp);
-                    }
                 }
-                else if (PyBytes_Check(result))
+                else if (PyUnicode_Check(result) ||
+                         PyObject_CheckBuffer(result))
                 {
-                    Py_ssize_t response_size_tmp = 0;
-                    if (PyBytes_AsStringAndSize(result,
-                                                &response,
-                                                &response_size_tmp))
-                    {
-                        PyErr_Print();
-                        result_invalid = true;
-                    }
-                    else if (response_size_tmp < 0 ||
-                             static_cast<uint32_t>(response_size_tmp) >
-                             std::numeric_limits<uint32_t>::max())
-                    {
-                        result_invalid = true;
-                    }
-                    else
-                    {
-                        response_size =
-                            static_cast<uint32_t>(response_size_tmp);
-                    }
-                }
-                else if (PyUnicode_Check(result))
-                {
-                    Py_ssize_t response_size_tmp = 0;
-#ifdef PYTHON_VERSION_3_3_COMPATIBLE
-                    response = PyUnicode_AsUTF8AndSize(result,
-                                                       &response_size_tmp);
-                    if (response == NULL)
-                    {
-                        PyErr_Print();
-                        result_invalid = true;
-                    }
-#else // before python 3.3
-                    PyObject * result_new = PyUnicode_AsUTF8String(result);
-                    if (result_new == NULL)
+                    if (! response.get_response(result))
                     {
                         PyErr_Print();
                         result_invalid = true;
                     }
-                    else
-                    {
-                        response_size_tmp =
-                            PyUnicode_GET_DATA_SIZE(result_new);
-                        response =
-                            const_cast<char *>(PyUnicode_AS_DATA(result_new));
-                        Py_DECREF(result_new);
-                    }
-#endif
-                    if (response_size_tmp < 0 ||
-                        static_cast<uint32_t>(response_size_tmp) >
-                        std::numeric_limits<uint32_t>::max())
-                    {
-                        result_invalid = true;
-                    }
-                    else
-                    {
-                        response_size =
-                            static_cast<uint32_t>(response_size_tmp);
-                    }
                 }
                 else
                 {
                     result_invalid = true;
                 }
-                Py_DECREF(result);
                 THREADS_UNBLOCK;
 
                 // return from the callback
+                // (the return does not throw, due to return_nothrow)
                 if (result_invalid)
                 {
                     // allow empty response to automatically be sent
@@ -803,15 +1272,17 @@ class callback : public CloudI::API::function_object_c
                 else if (command == CloudI::API::ASYNC)
                 {
                     api.return_async(name, pattern,
-                                     response_info, response_info_size,
-                                     response, response_size,
+                                     response_info.data(),
+                                     response_info.size(),
+                                     response.data(), response.size(),
                                      timeout, trans_id, pid, pid_size);
                 }
                 else if (command == CloudI::API::SYNC)
                 {
                     api.return_sync(name, pattern,
-                                    response_info, response_info_size,
-                                    response, response_size,
+                                    response_info.data(),
+                                    response_info.size(),
+                                    response.data(), response.size(),
                                     timeout, trans_id, pid, pid_size);
                 }
                 else
@@ -824,6 +1295,112 @@ class callback : public CloudI::API::function_object_c
     private:
         PyObject * const m_f;
         PyThreadState *& m_thread_state;
+        python_response & m_response;
+        bool const m_zero_copy;
+
+};
+
+// a batch function is called once (with a single GIL acquisition)
+// for all the requests received together, and the responses it returns
+// are written together after the GIL is released
+class batch_callback : public CloudI::API::batch_function_object_c
+{
+    public:
+        batch_callback(PyObject * f, PyThreadState *& thread_state,
+                       python_response & response, bool const zero_copy) :
+            m_f(f), m_thread_state(thread_state), m_response(response),
+            m_zero_copy(zero_copy)
+        {
+            Py_INCREF(m_f);
+        }
+        virtual ~batch_callback() throw()
+        {
+            Py_DECREF(m_f);
+        }
+
+        virtual void operator () (CloudI::API const & api,
+                                  cloudi_batch_request_t
+                                      const * const requests,
+                                  uint32_t const requests_count)
+        {
+            THREADS_BLOCK;
+            PyObject * result = NULL;
+            {
+                python_request * const args =
+                    new python_request[requests_count];
+                PyObject * list = PyList_New(requests_count);
+                for (uint32_t i = 0; list && i < requests_count; ++i)
+                {
+                    cloudi_batch_request_t const & request = requests[i];
+                    if (! args[i].set(m_zero_copy,
+                                      request.command,
+                                      request.name, request.pattern,
+                                      request.request_info,
+                                      request.request_info_size,
+                                      request.request,
+                                      request.request_size,
+                                      request.timeout, request.priority,
+                                      request.trans_id,
+                                      request.pid, request.pid_size))
+                    {
+                        Py_DECREF(list);
+                        list = NULL;
+                        break;
+                    }
+                    PyList_SET_ITEM(list, i, args[i].args());
+                }
+                if (list)
+                {
+                    result = PyObject_CallFunctionObjArgs(m_f, list, NULL);
+                    Py_DECREF(list);
+                }
+                bool released = true;
+                for (uint32_t i = 0; i < requests_count; ++i)
+                {
+                    if (! args[i].release())
+                        released = false;
+                }
+                if (! released)
+                {
+                    // the exception replaces the function result
+                    Py_XDECREF(result);
+                    result = NULL;
+                }
+                delete [] args;
+            }
+            if (result == NULL)
+            {
+                // empty responses are sent automatically
+                PyErr_Print();
+                THREADS_UNBLOCK;
+                return;
+            }
+            if (result == Py_None)
+            {
+                Py_DECREF(result);
+                THREADS_UNBLOCK;
+                return;
+            }
+            // the batch function provided the responses
+            // (instead of calling return_batch)
+            python_batch_responses * const responses =
+                new python_batch_responses(requests_count);
+            m_response.set(responses, result);
+            bool const result_valid = responses->set(result);
+            if (! result_valid)
+                PyErr_Print();
+            THREADS_UNBLOCK;
+            if (result_valid)
+                api.return_batch(responses->get(), requests_count);
+        }
+
+    private:
+        batch_callback(batch_callback const &);
+        batch_callback & operator =(batch_callback const &);
+        PyObject * const m_f;
+        PyThreadState *& m_thread_state;
+        python_response & m_response;
+        bool const m_zero_copy;
 
 };
 
@@ -847,7 +1424,45 @@ python_cloudi_subscribe(PyObject * self, PyObject * args)
     int result;
     THREADS_BEGIN;
     result = object->api->subscribe(pattern,
-                                    new callback(f, object->thread_state));
+                                    new callback(f, object->thread_state,
+                                                 *object->response,
+                                                 object->zero_copy));
+    THREADS_END;
+    if (result != 0)
+    {
+        python_error(result);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+python_cloudi_subscribe_batch(PyObject * self, PyObject * args)
+{
+    python_cloudi_instance_object * object =
+        (python_cloudi_instance_object *) self;
+    char const * pattern;
+    PyObject * f;
+    uint32_t batch_max;
+    if (! PyArg_ParseTuple(args, "sOI:subscribe_batch",
+                           &pattern, &f, &batch_max))
+    {
+        return NULL;
+    }
+    if (! f || ! PyCallable_Check(f))
+    {
+        PyErr_SetString(python_cloudi_message_decoding_exception,
+                        "subscribe_batch: not_callable");
+        return NULL;
+    }
+    int result;
+    THREADS_BEGIN;
+    result = object->api->subscribe_batch(pattern,
+                                          new batch_callback(
+                                              f, object->thread_state,
+                                              *object->response,
+                                              object->zero_copy),
+                                          batch_max);
     THREADS_END;
     if (result != 0)
     {
@@ -907,28 +1522,30 @@ python_cloudi_send_async(PyObject * self, PyObject * args, PyObject * kwargs)
     python_cloudi_instance_object * object =
         (python_cloudi_instance_object *) self;
     char const * name;
-    char const * request;
-    uint32_t request_size = 0;
+    python_buffer request;
     uint32_t timeout = object->api->timeout_async();
-    char const * request_info = NULL;
-    uint32_t request_info_size = 0;
+    python_buffer request_info;
     int8_t priority = object->api->priority_default();
     static char const * kwlist[] = {
         "timeout", "request_info", "priority", NULL};
     if (! PyArg_ParseTupleAndKeywords(args, kwargs,
-                                      "s" BUILDVALUE_BYTES "|I"
-                                      BUILDVALUE_BYTES "B:send_async",
+                                      "sO&|IO&B:send_async",
                                       const_cast<char**>(kwlist),
-                                      &name, &request, &request_size, &timeout,
-                                      &request_info, &request_info_size,
+                                      &name,
+                                      python_buffer_converter, &request,
+                                      &timeout,
+                                      python_buffer_converter, &request_info,
                                       &priority))
     {
         return NULL;
     }
     int result;
     THREADS_BEGIN;
-    result = object->api->send_async(name, request_info, request_info_size,
-                                     request, request_size, timeout, priority);
+    result = object->api->send_async(name,
+                                     request_info.data(),
+                                     request_info.size(),
+                                     request.data(), request.size(),
+                                     timeout, priority);
     THREADS_END;
     if (result != 0)
     {
@@ -949,28 +1566,30 @@ python_cloudi_send_sync(PyObject * self, PyObject * args, PyObject * kwargs)
     python_cloudi_instance_object * object =
         (python_cloudi_instance_object *) self;
     char const * name;
-    char const * request;
-    uint32_t request_size = 0;
+    python_buffer request;
     uint32_t timeout = object->api->timeout_sync();
-    char const * request_info = NULL;
-    uint32_t request_info_size = 0;
+    python_buffer request_info;
     int8_t priority = object->api->priority_default();
     static char const * kwlist[] = {
         "timeout", "request_info", "priority", NULL};
     if (! PyArg_ParseTupleAndKeywords(args, kwargs,
-                                      "s" BUILDVALUE_BYTES "|I"
-                                      BUILDVALUE_BYTES "B:send_sync",
+                                      "sO&|IO&B:send_sync",
                                       const_cast<char**>(kwlist),
-                                      &name, &request, &request_size, &timeout,
-                                      &request_info, &request_info_size,
+                                      &name,
+                                      python_buffer_converter, &request,
+                                      &timeout,
+                                      python_buffer_converter, &request_info,
                                       &priority))
     {
         return NULL;
     }
     int result;
     THREADS_BEGIN;
-    result = object->api->send_sync(name, request_info, request_info_size,
-                                    request, request_size, timeout, priority);
+    result = object->api->send_sync(name,
+                                    request_info.data(),
+                                    request_info.size(),
+                                    request.data(), request.size(),
+                                    timeout, priority);
     THREADS_END;
     if (result != 0)
     {
@@ -998,28 +1617,30 @@ python_cloudi_mcast_async(PyObject * self, PyObject * args, PyObject * kwargs)
     python_cloudi_instance_object * object =
         (python_cloudi_instance_object *) self;
     char const * name;
-    char const * request;
-    uint32_t request_size = 0;
+    python_buffer request;
     uint32_t timeout = object->api->timeout_async();
-    char const * request_info = NULL;
-    uint32_t request_info_size = 0;
+    python_buffer request_info;
     int8_t priority = object->api->priority_default();
     static char const * kwlist[] = {
         "timeout", "request_info", "priority", NULL};
     if (! PyArg_ParseTupleAndKeywords(args, kwargs,
-                                      "s" BUILDVALUE_BYTES "|I"
-                                      BUILDVALUE_BYTES "B:mcast_async",
+                                      "sO&|IO&B:mcast_async",
                                       const_cast<char**>(kwlist),
-                                      &name, &request, &request_size, &timeout,
-                                      &request_info, &request_info_size,
+                                      &name,
+                                      python_buffer_converter, &request,
+                                      &timeout,
+                                      python_buffer_converter, &request_info,
                                       &priority))
     {
         return NULL;
     }
     int result;
     THREADS_BEGIN;
-    result = object->api->mcast_async(name, request_info, request_info_size,
-                                      request, request_size, timeout, priority);
+    result = object->api->mcast_async(name,
+                                      request_info.data(),
+                                      request_info.size(),
+                                      request.data(), request.size(),
+                                      timeout, priority);
     THREADS_END;
     if (result != 0)
     {
@@ -1040,10 +1661,8 @@ python_cloudi_forward_async(PyObject * self, PyObject * args)
     python_cloudi_instance_object * object =
         (python_cloudi_instance_object *) self;
     char const * name;
-    char const * request_info;
-    uint32_t request_info_size = 0;
-    char const * request;
-    uint32_t request_size = 0;
+    python_buffer request_info;
+    python_buffer request;
     uint32_t timeout;
     int8_t priority;
     char const * trans_id;
@@ -1051,10 +1670,11 @@ python_cloudi_forward_async(PyObject * self, PyObject * args)
     char const * pid;
     uint32_t pid_size = 0;
     if (! PyArg_ParseTuple(args,
-                           "s" BUILDVALUE_BYTES BUILDVALUE_BYTES "IB"
+                           "sO&O&IB"
                            BUILDVALUE_BYTES BUILDVALUE_BYTES ":forward_async",
-                           &name, &request_info, &request_info_size,
-                           &request, &request_size, &timeout, &priority,
+                           &name, python_buffer_converter, &request_info,
+                           python_buffer_converter, &request,
+                           &timeout, &priority,
                            &trans_id, &trans_id_size, &pid, &pid_size))
     {
         return NULL;
@@ -1065,8 +1685,9 @@ python_cloudi_forward_async(PyObject * self, PyObject * args)
     try
     {
         result = object->api->forward_async(name,
-                                            request_info, request_info_size,
-                                            request, request_size,
+                                            request_info.data(),
+                                            request_info.size(),
+                                            request.data(), request.size(),
                                             timeout, priority,
                                             trans_id, pid, pid_size);
     }
@@ -1088,10 +1709,8 @@ python_cloudi_forward_sync(PyObject * self, PyObject * args)
     python_cloudi_instance_object * object =
         (python_cloudi_instance_object *) self;
     char const * name;
-    char const * request_info;
-    uint32_t request_info_size = 0;
-    char const * request;
-    uint32_t request_size = 0;
+    python_buffer request_info;
+    python_buffer request;
     uint32_t timeout;
     int8_t priority;
     char const * trans_id;
@@ -1099,10 +1718,11 @@ python_cloudi_forward_sync(PyObject * self, PyObject * args)
     char const * pid;
     uint32_t pid_size = 0;
     if (! PyArg_ParseTuple(args,
-                           "s" BUILDVALUE_BYTES BUILDVALUE_BYTES "IB"
+                           "sO&O&IB"
                            BUILDVALUE_BYTES BUILDVALUE_BYTES ":forward_sync",
-                           &name, &request_info, &request_info_size,
-                           &request, &request_size, &timeout, &priority,
+                           &name, python_buffer_converter, &request_info,
+                           python_buffer_converter, &request,
+                           &timeout, &priority,
                            &trans_id, &trans_id_size, &pid, &pid_size))
     {
         return NULL;
@@ -1113,8 +1733,9 @@ python_cloudi_forward_sync(PyObject * self, PyObject * args)
     try
     {
         result = object->api->forward_sync(name,
-                                           request_info, request_info_size,
-                                           request, request_size,
+                                           request_info.data(),
+                                           request_info.size(),
+                                           request.data(), request.size(),
                                            timeout, priority,
                                            trans_id, pid, pid_size);
     }
@@ -1137,20 +1758,20 @@ python_cloudi_return_async(PyObject * self, PyObject * args)
         (python_cloudi_instance_object *) self;
     char const * name;
     char const * pattern;
-    char const * response_info;
-    uint32_t response_info_size = 0;
-    char const * response;
-    uint32_t response_size = 0;
+    python_buffer response_info;
+    python_buffer response;
     uint32_t timeout;
     char const * trans_id;
     uint32_t trans_id_size = 0;
     char const * pid;
     uint32_t pid_size = 0;
     if (! PyArg_ParseTuple(args,
-                           "ss" BUILDVALUE_BYTES BUILDVALUE_BYTES "I"
+                           "ssO&O&I"
                            BUILDVALUE_BYTES BUILDVALUE_BYTES ":return_async",
-                           &name, &pattern, &response_info, &response_info_size,
-                           &response, &response_size, &timeout,
+                           &name, &pattern,
+                           python_buffer_converter, &response_info,
+                           python_buffer_converter, &response,
+                           &timeout,
                            &trans_id, &trans_id_size, &pid, &pid_size))
     {
         return NULL;
@@ -1161,9 +1782,10 @@ python_cloudi_return_async(PyObject * self, PyObject * args)
     try
     {
         result = object->api->return_async(name, pattern,
-                                           response_info,
-                                           response_info_size,
-                                           response, response_size, timeout,
+                                           response_info.data(),
+                                           response_info.size(),
+                                           response.data(), response.size(),
+                                           timeout,
                                            trans_id, pid, pid_size);
     }
     catch (CloudI::API::return_async_exception const &)
@@ -1185,20 +1807,20 @@ python_cloudi_return_sync(PyObject * self, PyObject * args)
         (python_cloudi_instance_object *) self;
     char const * name;
     char const * pattern;
-    char const * response_info;
-    uint32_t response_info_size = 0;
-    char const * response;
-    uint32_t response_size = 0;
+    python_buffer response_info;
+    python_buffer response;
     uint32_t timeout;
     char const * trans_id;
     uint32_t trans_id_size = 0;
     char const * pid;
     uint32_t pid_size = 0;
     if (! PyArg_ParseTuple(args,
-                           "ss" BUILDVALUE_BYTES BUILDVALUE_BYTES "I"
+                           "ssO&O&I"
                            BUILDVALUE_BYTES BUILDVALUE_BYTES ":return_sync",
-                           &name, &pattern, &response_info, &response_info_size,
-                           &response, &response_size, &timeout,
+                           &name, &pattern,
+                           python_buffer_converter, &response_info,
+                           python_buffer_converter, &response,
+                           &timeout,
                            &trans_id, &trans_id_size, &pid, &pid_size))
     {
         return NULL;
@@ -1209,9 +1831,10 @@ python_cloudi_return_sync(PyObject * self, PyObject * args)
     try
     {
         result = object->api->return_sync(name, pattern,
-                                          response_info,
-                                          response_info_size,
-                                          response, response_size, timeout,
+                                          response_info.data(),
+                                          response_info.size(),
+                                          response.data(), response.size(),
+                                          timeout,
                                           trans_id, pid, pid_size);
     }
     catch (CloudI::API::return_sync_exception const &)
@@ -1226,6 +1849,39 @@ python_cloudi_return_sync(PyObject * self, PyObject * args)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+python_cloudi_return_batch(PyObject * self, PyObject * args)
+{
+    python_cloudi_instance_object * object =
+        (python_cloudi_instance_object *) self;
+    PyObject * responses_object;
+    if (! PyArg_ParseTuple(args, "O:return_batch", &responses_object))
+    {
+        return NULL;
+    }
+    Py_ssize_t const count = PySequence_Size(responses_object);
+    if (count < 0)
+    {
+        return NULL;
+    }
+    python_batch_responses responses(static_cast<uint32_t>(count));
+    if (! responses.set(responses_object))
+    {
+        return NULL;
+    }
+    int result;
+    THREADS_BEGIN;
+    result = object->api->return_batch(responses.get(),
+                                       static_cast<uint32_t>(count));
+    THREADS_END;
+    if (result != 0)
+    {
+        python_error(result);
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject *
 python_cloudi_recv_async(PyObject * self, PyObject * args, PyObject * kwargs)
 {
@@ -43,11 +43,16 @@
 #include <sys/types.h>
 #include <sys/un.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <poll.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include "shm_ring.hpp"
 #include "assert.hpp"
 
 #define MAX_PENDING_SOCKETS 4096
@@ -87,6 +92,74 @@ class local_t
 static local_t local_queue[MAX_PENDING_SOCKETS];
 static size_t local_queue_size;
 
+// shm protocol shared memory, mapped for the lifetime of the resource
+static ErlNifResourceType * shm_resource_type = 0;
+class shm_t
+{
+    public:
+        void * mapping;
+        size_t mapping_size;
+        uint32_t size;
+};
+
+static void shm_destroy(ErlNifEnv * /*env*/, void * obj)
+{
+    shm_t * const p = reinterpret_cast<shm_t *>(obj);
+    if (p->mapping)
+        ::munmap(p->mapping, p->mapping_size);
+}
+
+static int shm_create_fd()
+{
+#if defined(SYS_memfd_create)
+    int const fd_memory = ::syscall(SYS_memfd_create, "cloudi_shm", 0);
+    if (fd_memory != -1 || errno != ENOSYS)
+        return fd_memory;
+#endif
+    // fallback to an unlinked temporary file
+    char const * directory = ::getenv("TMPDIR");
+    if (directory == 0)
+        directory = "/tmp";
+    char path[256];
+    if (::snprintf(path, sizeof(path),
+                   "%s/cloudi_shm_XXXXXX", directory) >=
+        static_cast<int>(sizeof(path)))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int const fd = ::mkstemp(path);
+    if (fd != -1)
+        ::unlink(path);
+    return fd;
+}
+
+static int shm_send_fd(int const fd_socket, int const fd)
+{
+    // the single byte of data is consumed by the service with the fd
+    char c = 0;
+    struct iovec iov = {&c, 1};
+    char control[CMSG_SPACE(sizeof(int))];
+    ::memset(control, 0, sizeof(control));
+    struct msghdr message;
+    ::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr * const header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    ::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    ssize_t result;
+    do
+    {
+        result = ::sendmsg(fd_socket, &message, 0);
+    } while (result == -1 && errno == EINTR);
+    return (result == 1) ? 0 : -1;
+}
+
 #if defined __cplusplus
 extern "C"
 {
@@ -249,25 +322,148 @@ NIF_FUNC(setsockopts)
     return ::enif_make_atom(env, "ok");
 }
 
+NIF_FUNC(shm)
+{
+    if (argc != 2)
+    {
+        return ::enif_make_badarg(env);
+    }
+    int fd_socket;
+    if (! ::enif_get_int(env, argv[0], &fd_socket))
+    {
+        return ::enif_make_badarg(env);
+    }
+    unsigned int size;
+    if (! ::enif_get_uint(env, argv[1], &size) ||
+        ! shm_ring::ring_size_valid(size))
+    {
+        return ::enif_make_badarg(env);
+    }
+    size_t const mapping_size = shm_ring::mapping_size(size);
+    int const fd = shm_create_fd();
+    if (fd == -1)
+    {
+        return ::enif_make_tuple2(env,
+                                  ::enif_make_atom(env, "error"),
+                                  ::enif_make_atom(env,
+                                                   ::erl_errno_id(errno)));
+    }
+    void * mapping = MAP_FAILED;
+    if (::ftruncate(fd, mapping_size) == -1 ||
+        (mapping = ::mmap(0, mapping_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0)) == MAP_FAILED ||
+        shm_send_fd(fd_socket, fd) == -1)
+    {
+        int const error = errno;
+        if (mapping != MAP_FAILED)
+            ::munmap(mapping, mapping_size);
+        ::close(fd);
+        return ::enif_make_tuple2(env,
+                                  ::enif_make_atom(env, "error"),
+                                  ::enif_make_atom(env,
+                                                   ::erl_errno_id(error)));
+    }
+    // the mapping remains after the file descriptor is closed
+    ::close(fd);
+    shm_t * const p = reinterpret_cast<shm_t *>(
+        ::enif_alloc_resource(shm_resource_type, sizeof(shm_t)));
+    p->mapping = mapping;
+    p->mapping_size = mapping_size;
+    p->size = size;
+    ERL_NIF_TERM const resource = ::enif_make_resource(env, p);
+    ::enif_release_resource(p);
+    return ::enif_make_tuple2(env,
+                              ::enif_make_atom(env, "ok"),
+                              resource);
+}
+
+NIF_FUNC(shm_read)
+{
+    if (argc != 1)
+    {
+        return ::enif_make_badarg(env);
+    }
+    shm_t * p;
+    if (! ::enif_get_resource(env, argv[0], shm_resource_type,
+                              reinterpret_cast<void **>(&p)))
+    {
+        return ::enif_make_badarg(env);
+    }
+    shm_ring ring(p->mapping, p->size, shm_ring::outgoing);
+    uint32_t length;
+    if (! ring.next(length) || length > p->size)
+    {
+        return ::enif_make_tuple2(env,
+                                  ::enif_make_atom(env, "error"),
+                                  ::enif_make_atom(env, "empty"));
+    }
+    ERL_NIF_TERM data;
+    ring.read(::enif_make_new_binary(env, length, &data), length);
+    return ::enif_make_tuple2(env,
+                              ::enif_make_atom(env, "ok"),
+                              data);
+}
+
+NIF_FUNC(shm_write)
+{
+    if (argc != 2)
+    {
+        return ::enif_make_badarg(env);
+    }
+    shm_t * p;
+    if (! ::enif_get_resource(env, argv[0], shm_resource_type,
+                              reinterpret_cast<void **>(&p)))
+    {
+        return ::enif_make_badarg(env);
+    }
+    ErlNifBinary data;
+    if (! ::enif_inspect_binary(env, argv[1], &data))
+    {
+        return ::enif_make_badarg(env);
+    }
+    shm_ring ring(p->mapping, p->size, shm_ring::incoming);
+    struct iovec iov = {data.data, data.size};
+    if (! ring.write(&iov, 1, static_cast<uint32_t>(data.size)))
+    {
+        return ::enif_make_tuple2(env,
+                                  ::enif_make_atom(env, "error"),
+                                  ::enif_make_atom(env, "full"));
+    }
+    return ::enif_make_atom(env, "ok");
+}
+
 static ErlNifFunc nif_funcs[] =
 {
 #if DIRTY_SCHEDULERS_VERSION == 0
     {         "local", 1, NIF_NAME(local)},
     {           "set", 2, NIF_NAME(set)},
-    {   "setsockopts", 3, NIF_NAME(setsockopts)}
+    {   "setsockopts", 3, NIF_NAME(setsockopts)},
+    {           "shm", 2, NIF_NAME(shm)},
+    {      "shm_read", 1, NIF_NAME(shm_read)},
+    {     "shm_write", 2, NIF_NAME(shm_write)}
 #else
     {         "local", 1, NIF_NAME(local),       0},
     {           "set", 2, NIF_NAME(set),         0},
-    {   "setsockopts", 3, NIF_NAME(setsockopts), 0}
+    {   "setsockopts", 3, NIF_NAME(setsockopts), 0},
+    {           "shm", 2, NIF_NAME(shm),         0},
+    {      "shm_read", 1, NIF_NAME(shm_read),    0},
+    {     "shm_write", 2, NIF_NAME(shm_write),   0}
 #endif
 };
 
 static void * local_thread(void * /*data*/);
 
-static int on_load(ErlNifEnv * /*env*/,
+static int on_load(ErlNifEnv * env,
                    void ** /*priv_data*/,
                    ERL_NIF_TERM /*load_info*/)
 {
+    shm_resource_type = ::enif_open_resource_type(env, 0, "shm",
+                                                  shm_destroy,
+                                                  ERL_NIF_RT_CREATE, 0);
+    if (shm_resource_type == 0)
+    {
+        return -1;
+    }
     local_thread_running = true;
     local_mutex = ::enif_mutex_create(const_cast<char *>("local_mutex"));
     if (::pipe(local_queue_event) == -1)
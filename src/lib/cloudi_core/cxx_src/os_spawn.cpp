@@ -658,8 +658,8 @@ namespace
     {
         public:
             process_data(unsigned long const pid,
-                         int const index_stdout,
-                         int const index_stderr) :
+                         nfds_t const index_stdout,
+                         nfds_t const index_stderr) :
                 m_pid(pid),
                 m_index_stdout(index_stdout),
                 m_index_stderr(index_stderr),
@@ -672,8 +672,6 @@ namespace
 
             ~process_data()
             {
-                GEPD::nfds -= 2;
-
                 // kills the pid if it isn't dead,
                 // to avoid blocking on a closed pipe
                 ::kill(m_pid, 9);
@@ -704,83 +702,91 @@ namespace
                 }
             }
 
-            void close()
+            nfds_t index_stdout() const
+            {
+                return m_index_stdout;
+            }
+
+            nfds_t index_stderr() const
             {
-                ::close(GEPD::fds[m_index_stdout].fd);
-                ::close(GEPD::fds[m_index_stderr].fd);
+                return m_index_stderr;
             }
 
-            void shift()
+            int close()
             {
-                int const old_index_stdout = m_index_stdout;
-                int const old_index_stderr = m_index_stderr;
-                m_index_stdout -= 2;
-                m_index_stderr -= 2;
-                GEPD::fds[m_index_stdout] = GEPD::fds[old_index_stdout];
-                GEPD::fds[m_index_stderr] = GEPD::fds[old_index_stderr];
+                int const fd_stdout = GEPD::fds[m_index_stdout].fd;
+                int const fd_stderr = GEPD::fds[m_index_stderr].fd;
+                int status;
+                if ((status = GEPD::fd_remove(m_index_stdout)))
+                    return status;
+                if ((status = GEPD::fd_remove(m_index_stderr)))
+                    return status;
+                ::close(fd_stdout);
+                ::close(fd_stderr);
+                return 0;
             }
 
-            int flush(int & count, realloc_ptr<unsigned char> & send_buffer)
+            int flush(realloc_ptr<unsigned char> & send_buffer)
             {
                 using namespace GEPD;
                 int status;
-                if (count > 0 && fds[m_index_stderr].revents != 0)
+                if (fds[m_index_stderr].revents != 0)
                 {
                     if ((status = flush_stream(fds[m_index_stderr].fd,
                                                fds[m_index_stderr].revents,
                                                "stderr", m_pid, send_buffer,
                                                m_stream2, m_index_stream2)))
                         return status;
-                    --count;
                 }
-                if (count > 0 && fds[m_index_stdout].revents != 0)
+                if (fds[m_index_stdout].revents != 0)
                 {
                     if ((status = flush_stream(fds[m_index_stdout].fd,
                                                fds[m_index_stdout].revents,
                                                "stdout", m_pid, send_buffer,
                                                m_stream1, m_index_stream1)))
                         return status;
-                    --count;
                 }
                 return 0;
             }
 
-            int check(int & count, realloc_ptr<unsigned char> & send_buffer)
+            int check(realloc_ptr<unsigned char> & send_buffer)
             {
                 using namespace GEPD;
                 int status;
-                if (count > 0 && fds[m_index_stderr].revents != 0)
+                if (fds[m_index_stderr].revents != 0)
                 {
                     if ((status = consume_stream(fds[m_index_stderr].fd,
                                                  fds[m_index_stderr].revents,
                                                  "stderr", m_pid, send_buffer,
                                                  m_stream2, m_index_stream2)))
                         return status;
-                    --count;
                 }
-                if (count > 0 && fds[m_index_stdout].revents != 0)
+                if (fds[m_index_stdout].revents != 0)
                 {
                     if ((status = consume_stream(fds[m_index_stdout].fd,
                                                  fds[m_index_stdout].revents,
                                                  "stdout", m_pid, send_buffer,
                                                  m_stream1, m_index_stream1)))
                         return status;
-                    --count;
                 }
                 return 0;
             }
     
         private:
             unsigned long const m_pid;
-            int m_index_stdout;
-            int m_index_stderr;
+            nfds_t const m_index_stdout;
+            nfds_t const m_index_stderr;
             size_t m_index_stream1;
             size_t m_index_stream2;
             realloc_ptr<unsigned char> m_stream1;
             realloc_ptr<unsigned char> m_stream2;
     };
 
+    // processes are stored at the GEPD::fds index of their stdout pipe
+    // and process_indexes provides that index for any GEPD::fds index
+    // (index 0 is never used by a process)
     std::vector< copy_ptr<process_data> > processes;
+    std::vector<nfds_t> process_indexes;
 }
 
 int32_t spawn(char protocol,
@@ -830,7 +836,7 @@ int32_t spawn(char protocol,
     {
         for (size_t i = 0; i < GEPD::nfds; ++i)
         {
-            if (::close(GEPD::fds[i].fd) == -1)
+            if (GEPD::fds[i].fd != -1 && ::close(GEPD::fds[i].fd) == -1)
                 ::_exit(spawn_status::errno_close());
         }
         if (::dup2(fds_stdout[1], 1) == -1)
@@ -999,22 +1005,22 @@ int32_t spawn(char protocol,
         if (::close(fds_stderr[1]) == -1)
             return spawn_status::errno_close();
 
-        if (GEPD::fds.reserve(GEPD::nfds + 2) == false)
-            ::exit(spawn_status::out_of_memory);
-        size_t const index_stdout = GEPD::nfds;
-        size_t const index_stderr = GEPD::nfds + 1;
-        GEPD::fds[index_stdout].fd = fds_stdout[0];
-        GEPD::fds[index_stdout].events = POLLIN | POLLPRI;
-        GEPD::fds[index_stdout].revents = 0;
-        GEPD::fds[index_stderr].fd = fds_stderr[0];
-        GEPD::fds[index_stderr].events = POLLIN | POLLPRI;
-        GEPD::fds[index_stderr].revents = 0;
-        GEPD::nfds += 2;
-
-        copy_ptr<process_data> P(new process_data(pid,
-                                                  index_stdout,
-                                                  index_stderr));
-        processes.push_back(P);
+        int status;
+        nfds_t index_stdout;
+        nfds_t index_stderr;
+        if ((status = GEPD::fd_add(fds_stdout[0], index_stdout)) ||
+            (status = GEPD::fd_add(fds_stderr[0], index_stderr)))
+            ::exit(status);
+        if (process_indexes.size() < GEPD::nfds)
+        {
+            processes.resize(GEPD::nfds);
+            process_indexes.resize(GEPD::nfds, 0);
+        }
+        processes[index_stdout].reset(new process_data(pid,
+                                                       index_stdout,
+                                                       index_stderr));
+        process_indexes[index_stdout] = index_stdout;
+        process_indexes[index_stderr] = index_stdout;
     }
     return pid;
 }
@@ -1023,7 +1029,6 @@ int32_t spawn(char protocol,
 int main()
 {
     ::signal(SIGPIPE, SIG_IGN); // write to a broken socket error
-    typedef std::vector< copy_ptr<process_data> >::iterator iterator;
     assert(spawn_status::last_value == GEPD::ExitStatus::min);
 
     int const timeout = -1; // milliseconds
@@ -1037,24 +1042,23 @@ int main()
     while ((status = GEPD::wait(count, timeout, erlang_buffer,
                                 stream1, stream2)) == GEPD::ExitStatus::ready)
     {
-        iterator itr = processes.begin();
-        while (itr != processes.end() && count > 0)
+        for (int i = 0; i < count; ++i)
         {
-            if ((status = (*itr)->check(count, erlang_buffer)))
+            nfds_t const index = process_indexes[GEPD::ready[i]];
+            copy_ptr<process_data> & P = processes[index];
+            if (! P) // removed after an earlier ready index
+                continue;
+            if ((status = P->check(erlang_buffer)))
             {
                 if (status != GEPD::ExitStatus::error_HUP)
                     return status;
-                if ((status = (*itr)->flush(count, erlang_buffer)))
+                if ((status = P->flush(erlang_buffer)))
                     return status;
-                iterator const dead = itr;
-                (*dead)->close();
-                for (++itr; itr != processes.end(); ++itr)
-                    (*itr)->shift();
-                itr = processes.erase(dead);
-            }
-            else
-            {
-                ++itr;
+                if ((status = P->close()))
+                    return status;
+                process_indexes[P->index_stdout()] = 0;
+                process_indexes[P->index_stderr()] = 0;
+                P.reset();
             }
         }
     }
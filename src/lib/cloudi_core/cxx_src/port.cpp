@@ -47,6 +47,10 @@
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/uio.h>
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#endif
 #include <ei.h>
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/repetition/enum.hpp>
@@ -545,36 +549,42 @@ namespace
         }
     }
 
-    int read_exact(unsigned char * const buffer,
-                   uint32_t const length)
+    int write_exact(unsigned char const * const buffer,
+                    uint32_t const length)
     {
         uint32_t total = 0;
         while (total < length)
         {
-            ssize_t const i = read(PORT_READ_FILE_DESCRIPTOR,
-                                   buffer + total, length - total);
+            ssize_t const i = write(PORT_WRITE_FILE_DESCRIPTOR,
+                                    buffer + total, length - total);
             if (i <= 0)
             {
                 if (i == -1)
-                    return errno_read();
+                    return errno_write();
                 else
-                    return GEPD::ExitStatus::read_null;
+                    return GEPD::ExitStatus::write_null;
             }
             total += i;
         }
         if (total > length)
-            return GEPD::ExitStatus::read_overflow;
+            return GEPD::ExitStatus::write_overflow;
         return GEPD::ExitStatus::success;
     }
     
-    int write_exact(unsigned char const * const buffer,
-                    uint32_t const length)
+    int write_cmd(realloc_ptr<unsigned char> & buffer, uint32_t length)
     {
-        uint32_t total = 0;
-        while (total < length)
+        buffer[0] = (length & 0xff000000) >> 24;
+        buffer[1] = (length & 0x00ff0000) >> 16;
+        buffer[2] = (length & 0x0000ff00) >> 8;
+        buffer[3] =  length & 0x000000ff;
+        return write_exact(buffer.get(), length + 4);
+    }
+
+    int writev_exact(struct iovec * iov, int iovcnt)
+    {
+        while (iovcnt > 0)
         {
-            ssize_t const i = write(PORT_WRITE_FILE_DESCRIPTOR,
-                                    buffer + total, length - total);
+            ssize_t i = writev(PORT_WRITE_FILE_DESCRIPTOR, iov, iovcnt);
             if (i <= 0)
             {
                 if (i == -1)
@@ -582,34 +592,82 @@ namespace
                 else
                     return GEPD::ExitStatus::write_null;
             }
-            total += i;
+            while (iovcnt > 0 && static_cast<size_t>(i) >= iov->iov_len)
+            {
+                i -= iov->iov_len;
+                ++iov;
+                --iovcnt;
+            }
+            if (iovcnt > 0)
+            {
+                iov->iov_base = reinterpret_cast<char *>(iov->iov_base) + i;
+                iov->iov_len -= i;
+            }
         }
-        if (total > length)
-            return GEPD::ExitStatus::write_overflow;
         return GEPD::ExitStatus::success;
     }
-    
-    int read_cmd(realloc_ptr<unsigned char> & buffer)
+
+    // {packet, 4} data read from Erlang that has not been consumed
+    // (all complete commands are consumed after each read)
+    realloc_ptr<unsigned char> input(32768, 8388608);
+    size_t input_index = 0; // start of the next command
+    size_t input_end = 0;   // end of the data read
+
+    // replies to the commands already consumed that are waiting for the
+    // reply to the last complete command, to be written together
+    realloc_ptr<unsigned char> output(32768, 8388608);
+    size_t output_length = 0;
+
+    // port functions are the only source of buffered stdout/stderr data
+    bool stdio_pending = false;
+
+    int read_cmds()
     {
-        unsigned char lengthData[4];
-        int const status = read_exact(lengthData, 4);
-        if (status)
-            return status;
-        uint32_t const length = (lengthData[0] << 24) |
-                                (lengthData[1] << 16) |
-                                (lengthData[2] <<  8) |
-                                 lengthData[3];
-        buffer.reserve(length);
-        return read_exact(buffer.get(), length);
+        if (input_end == input.size() && input.grow() == false)
+            return GEPD::ExitStatus::read_overflow;
+        ssize_t const i = read(PORT_READ_FILE_DESCRIPTOR,
+                               &input[input_end], input.size() - input_end);
+        if (i <= 0)
+        {
+            if (i == -1)
+                return errno_read();
+            else
+                return GEPD::ExitStatus::read_null;
+        }
+        input_end += i;
+        return GEPD::ExitStatus::success;
     }
-    
-    int write_cmd(realloc_ptr<unsigned char> & buffer, uint32_t length)
+
+    bool next_cmd(uint32_t & length)
+    {
+        size_t const available = input_end - input_index;
+        if (available < 4)
+            return false;
+        unsigned char const * const lengthData = &input[input_index];
+        length = (lengthData[0] << 24) |
+                 (lengthData[1] << 16) |
+                 (lengthData[2] <<  8) |
+                  lengthData[3];
+        return (available - 4 >= length);
+    }
+
+    int reply_cmd(realloc_ptr<unsigned char> & buffer, uint32_t length,
+                  bool const last)
     {
         buffer[0] = (length & 0xff000000) >> 24;
         buffer[1] = (length & 0x00ff0000) >> 16;
         buffer[2] = (length & 0x0000ff00) >> 8;
         buffer[3] =  length & 0x000000ff;
-        return write_exact(buffer.get(), length + 4);
+        if (last == false &&
+            output.copy(buffer, length + 4, output_length))
+        {
+            output_length += length + 4;
+            return GEPD::ExitStatus::success;
+        }
+        struct iovec iov[2] = {{output.get(), output_length},
+                               {buffer.get(), length + 4}};
+        output_length = 0;
+        return writev_exact(iov, 2);
     }
     
     int reply_error_string(realloc_ptr<unsigned char> & buffer,
@@ -691,11 +749,36 @@ case BOOST_PP_DEC(I):\
     ; \
     int index = BOOST_PP_SEQ_ELEM(1, OFFSETS); \
     STORE_RETURN_VALUE(GET_RETURN(FUNCTION), BOOST_PP_DEC(I)) \
-    if ((status = write_cmd(buffer, index - BOOST_PP_SEQ_ELEM(1, OFFSETS)))) \
+    if ((status = reply_cmd(buffer, \
+                            index - BOOST_PP_SEQ_ELEM(1, OFFSETS), \
+                            last))) \
         return status; \
     return GEPD::ExitStatus::success;\
 }
 
+    int call_function(realloc_ptr<unsigned char> & buffer, bool const last)
+    {
+        int status;
+        INPUT_PREFIX_TYPE cmd = *((INPUT_PREFIX_TYPE *) buffer.get());
+        switch (cmd)
+        {
+            BOOST_PP_SEQ_FOR_EACH(CREATE_FUNCTION,
+                                  (sizeof(INPUT_PREFIX_TYPE))
+                                  (sizeof(OUTPUT_PREFIX_TYPE)),
+                                  PORT_FUNCTIONS)
+
+            default:
+                int index = sizeof(OUTPUT_PREFIX_TYPE);
+                if ((status = reply_error_string(buffer, index, cmd, 
+                                                 Error::invalid_function)))
+                    return status;
+                if ((status = reply_cmd(buffer, index -
+                                        sizeof(OUTPUT_PREFIX_TYPE), last)))
+                    return status;
+                return GEPD::ExitStatus::success;
+        }
+    }
+
     int consume_erlang(short & revents, realloc_ptr<unsigned char> & buffer)
     {
         if (revents & POLLERR)
@@ -706,31 +789,38 @@ case BOOST_PP_DEC(I):\
             return GEPD::ExitStatus::poll_NVAL;
         revents = 0;
         int status;
-        if ((status = read_cmd(buffer)))
-        {
+        if ((status = read_cmds()))
             return status;
+
+        // call the functions for all the complete commands that were read
+        // so their replies can be written with a single writev
+        uint32_t length = 0;
+        bool more = next_cmd(length);
+        while (more)
+        {
+            if (buffer.copy(input, input_index + 4, length, 0) == false)
+                return GEPD::ExitStatus::read_overflow;
+            input_index += 4 + length;
+            more = next_cmd(length);
+            if ((status = call_function(buffer, more == false)))
+                return status;
+            stdio_pending = true;
         }
-        else
+
+        // keep an incomplete command at the start of the input buffer
+        if (input_index == input_end)
         {
-            INPUT_PREFIX_TYPE cmd = *((INPUT_PREFIX_TYPE *) buffer.get());
-            switch (cmd)
-            {
-                BOOST_PP_SEQ_FOR_EACH(CREATE_FUNCTION,
-                                      (sizeof(INPUT_PREFIX_TYPE))
-                                      (sizeof(OUTPUT_PREFIX_TYPE)),
-                                      PORT_FUNCTIONS)
-    
-                default:
-                    int index = sizeof(OUTPUT_PREFIX_TYPE);
-                    if ((status = reply_error_string(buffer, index, cmd, 
-                                                     Error::invalid_function)))
-                        return status;
-                    if ((status = write_cmd(buffer, index -
-                                            sizeof(OUTPUT_PREFIX_TYPE))))
-                        return status;
-                    return GEPD::ExitStatus::success;
-            }
+            input_index = input_end = 0;
+        }
+        else if (input_index > 0)
+        {
+            input.move(input_index, input_end - input_index, 0);
+            input_end -= input_index;
+            input_index = 0;
         }
+        if (input_end >= 4 && input.reserve(4 + length) == false)
+            return GEPD::ExitStatus::read_overflow;
+        return GEPD::ExitStatus::success;
     }
 
     int store_standard_fd(int in, int & out)
@@ -760,8 +850,85 @@ case BOOST_PP_DEC(I):\
     {
         INDEX_STDOUT = 0,
         INDEX_STDERR,
-        INDEX_ERLANG
+        INDEX_ERLANG,
+        INDEX_EXTERNAL
     };
+
+    // fds indexes that were removed and may be reused
+    realloc_ptr<nfds_t> fds_free(4, 65536);
+    nfds_t nfds_free = 0;
+
+#if defined(HAVE_SYS_EPOLL_H)
+    int epoll_fd = -1;
+    realloc_ptr<struct epoll_event> epoll_events(64, 65536);
+
+    int epoll_add(nfds_t const index)
+    {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLPRI;
+        event.data.u64 = index;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD,
+                      GEPD::fds[index].fd, &event) == -1)
+            return errno_poll();
+        return GEPD::ExitStatus::success;
+    }
+
+    short epoll_revents(uint32_t const events)
+    {
+        short revents = 0;
+        if (events & EPOLLIN)
+            revents |= POLLIN;
+        if (events & EPOLLPRI)
+            revents |= POLLPRI;
+        if (events & EPOLLERR)
+            revents |= POLLERR;
+        if (events & EPOLLHUP)
+            revents |= POLLHUP;
+        return revents;
+    }
+
+    // only the fds that have events are visited,
+    // so the cost does not depend on the number of fds
+    int wait_fds(int const timeout, nfds_t & nready)
+    {
+        int const count = epoll_wait(epoll_fd, epoll_events.get(),
+                                     epoll_events.size(), timeout);
+        nready = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            nfds_t const index = epoll_events[i].data.u64;
+            GEPD::fds[index].revents = epoll_revents(epoll_events[i].events);
+            if (index >= INDEX_EXTERNAL)
+                GEPD::ready[nready++] = index;
+        }
+        if (count > 0 && static_cast<size_t>(count) == epoll_events.size())
+            epoll_events.grow();
+        return count;
+    }
+#else
+    int wait_fds(int const timeout, nfds_t & nready)
+    {
+        using namespace GEPD;
+        int const count = poll(fds.get(), nfds, timeout);
+        nready = 0;
+        int external = count;
+        for (nfds_t index = 0; index < INDEX_EXTERNAL; ++index)
+        {
+            if (fds[index].revents != 0)
+                --external;
+        }
+        for (nfds_t index = INDEX_EXTERNAL;
+             external > 0 && index < nfds; ++index)
+        {
+            if (fds[index].revents != 0)
+            {
+                ready[nready++] = index;
+                --external;
+            }
+        }
+        return count;
+    }
+#endif
 }
 
 int GEPD::consume_stream(int fd, short & revents,
@@ -894,6 +1061,48 @@ int GEPD::flush_stream(int fd, short revents,
 
 realloc_ptr<struct pollfd> GEPD::fds(4, 65536);
 nfds_t GEPD::nfds = 0;
+realloc_ptr<nfds_t> GEPD::ready(4, 65536);
+
+int GEPD::fd_add(int const fd, nfds_t & index)
+{
+    if (nfds_free > 0)
+    {
+        index = fds_free[--nfds_free];
+    }
+    else
+    {
+        if (fds.reserve(nfds + 1) == false ||
+            ready.reserve(nfds + 1) == false)
+            return GEPD::ExitStatus::poll_ENOMEM;
+        index = nfds++;
+    }
+    fds[index].fd = fd;
+    fds[index].events = POLLIN | POLLPRI;
+    fds[index].revents = 0;
+#if defined(HAVE_SYS_EPOLL_H)
+    if (epoll_fd != -1)
+        return epoll_add(index);
+#endif
+    return GEPD::ExitStatus::success;
+}
+
+int GEPD::fd_remove(nfds_t const index)
+{
+    assert(index >= INDEX_EXTERNAL && index < nfds && fds[index].fd != -1);
+#if defined(HAVE_SYS_EPOLL_H)
+    struct epoll_event event;
+    if (epoll_fd != -1 &&
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fds[index].fd, &event) == -1)
+        return errno_poll();
+#endif
+    fds[index].fd = -1;
+    fds[index].events = 0;
+    fds[index].revents = 0;
+    if (fds_free.reserve(nfds_free + 1) == false)
+        return GEPD::ExitStatus::poll_ENOMEM;
+    fds_free[nfds_free++] = index;
+    return GEPD::ExitStatus::success;
+}
 
 // main loop for handling inherently synchronous function calls
 // (a linked-in Erlang port driver that makes synchronous calls with
@@ -918,7 +1127,11 @@ int GEPD::default_main()
 int GEPD::init()
 {
     if (nfds > 0)
-        fds.move(0, nfds, 3);
+    {
+        fds.move(0, nfds, INDEX_EXTERNAL);
+        for (nfds_t i = 0; i < nfds_free; ++i)
+            fds_free[i] += INDEX_EXTERNAL;
+    }
 
     int status;
     if ((status = store_standard_fd(1, fds[INDEX_STDOUT].fd)))
@@ -932,7 +1145,18 @@ int GEPD::init()
     fds[INDEX_ERLANG].fd = PORT_READ_FILE_DESCRIPTOR;
     fds[INDEX_ERLANG].events = POLLIN | POLLPRI;
     fds[INDEX_ERLANG].revents = 0;
-    nfds += 3;
+    nfds += INDEX_EXTERNAL;
+    if (ready.reserve(nfds) == false)
+        return GEPD::ExitStatus::poll_ENOMEM;
+#if defined(HAVE_SYS_EPOLL_H)
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+        return errno_poll();
+    for (nfds_t index = 0; index < nfds; ++index)
+    {
+        if (fds[index].fd != -1 && (status = epoll_add(index)))
+            return status;
+    }
+#endif
     return GEPD::ExitStatus::success;
 }
 
@@ -944,37 +1168,42 @@ int GEPD::wait(int & count, int const timeout,
     static unsigned long const pid = getpid();
     static size_t index_stream1 = 0;
     static size_t index_stream2 = 0;
-    while ((count = poll(fds.get(), nfds, timeout)) > 0)
+    nfds_t nready;
+    while ((count = wait_fds(timeout, nready)) > 0)
     {
         int status;
-        if (count > 0 && fds[INDEX_ERLANG].revents != 0)
+        if (fds[INDEX_ERLANG].revents != 0)
         {
             if ((status = consume_erlang(fds[INDEX_ERLANG].revents, buffer)))
                 return status;
-            --count;
         }
-        fflush(stdout);
-        fflush(stderr);
-        if (count > 0 && fds[INDEX_STDERR].revents != 0)
+        if (stdio_pending)
+        {
+            fflush(stdout);
+            fflush(stderr);
+            stdio_pending = false;
+        }
+        if (fds[INDEX_STDERR].revents != 0)
         {
             if ((status = consume_stream(fds[INDEX_STDERR].fd, 
                                          fds[INDEX_STDERR].revents,
                                          "stderr", pid, buffer,
                                          stream2, index_stream2)))
                 return status;
-            --count;
         }
-        if (count > 0 && fds[INDEX_STDOUT].revents != 0)
+        if (fds[INDEX_STDOUT].revents != 0)
         {
             if ((status = consume_stream(fds[INDEX_STDOUT].fd, 
                                          fds[INDEX_STDOUT].revents,
                                          "stdout", pid, buffer,
                                          stream1, index_stream1)))
                 return status;
-            --count;
         }
-        if (count > 0)
+        if (nready > 0)
+        {
+            count = nready;
             return GEPD::ExitStatus::ready;
+        }
     }
     if (count == 0)
         return GEPD::ExitStatus::timeout;
@@ -119,8 +119,16 @@ namespace GEPD
                      realloc_ptr<unsigned char> & send_buffer,
                      realloc_ptr<unsigned char> & stream, size_t & i);
 
+    // file descriptors are kept at a stable index until they are removed
+    // (a removed index has fd == -1 and is reused by fd_add)
     extern realloc_ptr<struct pollfd> fds;
     extern nfds_t nfds;
+    // the fds indexes of external file descriptors with revents set
+    // (count entries, after wait returns ExitStatus::ready)
+    extern realloc_ptr<nfds_t> ready;
+
+    int fd_add(int const fd, nfds_t & index);
+    int fd_remove(nfds_t const index);
 
     int default_main();
     int init();
@@ -0,0 +1,170 @@
+//-*-Mode:C++;coding:utf-8;tab-width:4;c-basic-offset:4;indent-tabs-mode:()-*-
+// ex: set ft=cpp fenc=utf-8 sts=4 ts=4 sw=4 et:
+//
+// BSD LICENSE
+// 
+// Copyright (c) 2015, Michael Truog
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// 
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+//     * All advertising materials mentioning features or use of this
+//       software must display the following acknowledgment:
+//         This product includes software developed by Michael Truog
+//     * The name of the author may not be used to endorse or promote
+//       products derived from this software without specific prior
+//       written permission
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+#ifndef SHM_RING_HPP
+#define SHM_RING_HPP
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <cstring>
+#include <algorithm>
+
+// a single producer, single consumer ring buffer of frames within
+// shared memory used by the shm protocol.  the shared memory contains
+// 2 rings, the first for frames sent from cloudi_core to the service and
+// the second for frames sent from the service to cloudi_core.
+// each frame stored in a ring is announced with a 0 length packet on the
+// stream socket, so the socket provides the wakeup and frame ordering
+// (the ring only removes the payload from the socket).
+class shm_ring
+{
+public:
+    enum
+    {
+        incoming = 0, // cloudi_core -> service
+        outgoing = 1  // service -> cloudi_core
+    };
+
+    // frames smaller than this are written to the socket directly
+    static uint32_t const frame_size_min = 4096;
+
+    static size_t mapping_size(uint32_t const size)
+    {
+        return 2 * (sizeof(header_t) + size);
+    }
+
+    static uint32_t ring_size(size_t const mapping_size)
+    {
+        return static_cast<uint32_t>(mapping_size / 2 - sizeof(header_t));
+    }
+
+    static bool ring_size_valid(uint32_t const size)
+    {
+        // power of 2 less than 2GB so the offsets may wrap with a mask
+        return size >= frame_size_min && size <= 1073741824 &&
+               (size & (size - 1)) == 0;
+    }
+
+    shm_ring(void * const mapping, uint32_t const size,
+             unsigned int const direction) :
+        m_header(reinterpret_cast<header_t *>(
+            reinterpret_cast<char *>(mapping) +
+            direction * (sizeof(header_t) + size))),
+        m_data(reinterpret_cast<char *>(m_header + 1)),
+        m_mask(size - 1)
+    {
+    }
+
+    // store a frame if the ring has enough space for the whole frame
+    bool write(struct iovec const * iov, int iovcnt,
+               uint32_t const length)
+    {
+        uint32_t const tail = m_header->tail;
+        uint32_t const used = tail - m_header->head;
+        if (static_cast<uint64_t>(used) + sizeof(uint32_t) + length >
+            static_cast<uint64_t>(m_mask) + 1)
+            return false;
+        uint32_t offset = tail;
+        copy_in(offset, &length, sizeof(uint32_t));
+        for (; iovcnt > 0; ++iov, --iovcnt)
+            copy_in(offset, iov->iov_base, iov->iov_len);
+        __sync_synchronize();
+        m_header->tail = offset;
+        return true;
+    }
+
+    // provide the size of the next frame if a frame is available
+    bool next(uint32_t & length) const
+    {
+        uint32_t const head = m_header->head;
+        if (m_header->tail == head)
+            return false;
+        __sync_synchronize();
+        uint32_t offset = head;
+        copy_out(offset, &length, sizeof(uint32_t));
+        return true;
+    }
+
+    // consume the next frame after next() provided its length
+    void read(void * const buffer, uint32_t const length)
+    {
+        uint32_t offset = m_header->head + sizeof(uint32_t);
+        copy_out(offset, buffer, length);
+        __sync_synchronize();
+        m_header->head = offset;
+    }
+
+private:
+    // head and tail are free running byte counts,
+    // kept on separate cache lines to avoid false sharing
+    struct header_t
+    {
+        volatile uint32_t head; // only modified by the consumer
+        char head_padding[60];
+        volatile uint32_t tail; // only modified by the producer
+        char tail_padding[60];
+    };
+
+    void copy_in(uint32_t & offset, void const * const p, size_t const size)
+    {
+        size_t const index = offset & m_mask;
+        size_t const first = std::min(size, m_mask + 1 - index);
+        ::memcpy(&m_data[index], p, first);
+        if (first < size)
+            ::memcpy(m_data, reinterpret_cast<char const *>(p) + first,
+                     size - first);
+        offset += size;
+    }
+
+    void copy_out(uint32_t & offset, void * const p, size_t const size) const
+    {
+        size_t const index = offset & m_mask;
+        size_t const first = std::min(size, m_mask + 1 - index);
+        ::memcpy(p, &m_data[index], first);
+        if (first < size)
+            ::memcpy(reinterpret_cast<char *>(p) + first, m_data,
+                     size - first);
+        offset += size;
+    }
+
+    header_t * const m_header;
+    char * const m_data;
+    size_t const m_mask;
+};
+
+#endif // SHM_RING_HPP
@@ -269,7 +269,7 @@
         args               :: string(),
         env                :: list({string(), string()}),
         dest_refresh       :: cloudi_service_api:dest_refresh(),
-        protocol           :: 'default' | 'local' | 'tcp' | 'udp',
+        protocol           :: 'default' | 'local' | 'shm' | 'tcp' | 'udp',
         buffer_size        :: 'default' | pos_integer(),
         timeout_init       :: cloudi_service_api:timeout_milliseconds(),
         timeout_async      :: cloudi_service_api:timeout_milliseconds(),
@@ -994,7 +994,16 @@ services_format_options_external(Options) ->
         true ->
             OptionsList19
     end,
-    lists:reverse(OptionsList20).
+    OptionsList21 = if
+        Options#config_service_options.affinity /=
+        Defaults#config_service_options.affinity ->
+            [{affinity,
+              Options#config_service_options.affinity} |
+             OptionsList20];
+        true ->
+            OptionsList20
+    end,
+    lists:reverse(OptionsList21).
 
 %%-------------------------------------------------------------------------
 %% @doc
@@ -1841,7 +1850,8 @@ services_validate([#external{protocol = Protocol} | _], _, _, _)
     when not ((Protocol =:= default) orelse
               (Protocol =:= tcp) orelse
               (Protocol =:= udp) orelse
-              (Protocol =:= local)) ->
+              (Protocol =:= local) orelse
+              (Protocol =:= shm)) ->
     {error, {service_external_protocol_invalid, Protocol}};
 services_validate([#external{buffer_size = BufferSize} | _], _, _, _)
     when not ((BufferSize =:= default) orelse
@@ -1924,7 +1934,9 @@ services_validate([#external{
                 NewProtocol =:= udp ->
                     16384; % Linux localhost (inet) MTU
                 NewProtocol =:= local ->
-                    16384  % Linux localhost (inet) MTU for testing/comparison
+                    16384; % Linux localhost (inet) MTU for testing/comparison
+                NewProtocol =:= shm ->
+                    16384  % only small frames use the local socket
             end;
         true ->
             BufferSize
@@ -2543,6 +2555,7 @@ services_validate_options_internal_checks(CountProcessDynamic,
       service_options_aspects_request_invalid |
       service_options_aspects_terminate_invalid |
       service_options_limit_invalid |
+      service_options_affinity_invalid |
       service_options_invalid, any()}}.
 
 services_validate_options_external(OptionsList, CountProcess) ->
@@ -2587,109 +2600,118 @@ services_validate_options_external(OptionsList, CountProcess) ->
         {aspects_terminate_before,
          Options#config_service_options.aspects_terminate_before},
         {limit,
-         Options#config_service_options.limit}],
+         Options#config_service_options.limit},
+        {affinity,
+         Options#config_service_options.affinity}],
     case cloudi_proplists:take_values(Defaults, OptionsList) of
         [PriorityDefault, _, _, _, _, _, _, _, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not ((PriorityDefault >= ?PRIORITY_HIGH) andalso
                   (PriorityDefault =< ?PRIORITY_LOW)) ->
             {error, {service_options_priority_default_invalid,
                      PriorityDefault}};
         [_, QueueLimit, _, _, _, _, _, _, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not ((QueueLimit =:= undefined) orelse
                   (is_integer(QueueLimit) andalso
                    (QueueLimit >= 0))) ->
             {error, {service_options_queue_limit_invalid,
                      QueueLimit}};
         [_, _, QueueSize, _, _, _, _, _, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not ((QueueSize =:= undefined) orelse
                   (is_integer(QueueSize) andalso
                    (QueueSize >= 1))) ->
             {error, {service_options_queue_size_invalid,
                      QueueSize}};
         [_, _, _, DestRefreshStart, _, _, _, _, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not (is_integer(DestRefreshStart) andalso
                   (DestRefreshStart > ?TIMEOUT_DELTA) andalso
                   (DestRefreshStart =< ?TIMEOUT_MAX_ERLANG)) ->
             {error, {service_options_dest_refresh_start_invalid,
                      DestRefreshStart}};
         [_, _, _, _, DestRefreshDelay, _, _, _, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not (is_integer(DestRefreshDelay) andalso
                   (DestRefreshDelay > ?TIMEOUT_DELTA) andalso
                   (DestRefreshDelay =< ?TIMEOUT_MAX_ERLANG)) ->
             {error, {service_options_dest_refresh_delay_invalid,
                      DestRefreshDelay}};
         [_, _, _, _, _, RequestNameLookup, _, _, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not ((RequestNameLookup =:= sync) orelse
                   (RequestNameLookup =:= async)) ->
             {error, {service_options_request_name_lookup_invalid,
                      RequestNameLookup}};
         [_, _, _, _, _, _, RequestTimeoutAdjustment, _, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not is_boolean(RequestTimeoutAdjustment) ->
             {error, {service_options_request_timeout_adjustment_invalid,
                      RequestTimeoutAdjustment}};
         [_, _, _, _, _, _, _, RequestTimeoutImmediateMax, _, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not (is_integer(RequestTimeoutImmediateMax) andalso
                   (RequestTimeoutImmediateMax >= 0) andalso
                   (RequestTimeoutImmediateMax =< ?TIMEOUT_MAX_ERLANG)) ->
             {error, {service_options_request_timeout_immediate_max_invalid,
                      RequestTimeoutImmediateMax}};
         [_, _, _, _, _, _, _, _, ResponseTimeoutAdjustment, _, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not is_boolean(ResponseTimeoutAdjustment) ->
             {error, {service_options_response_timeout_adjustment_invalid,
                      ResponseTimeoutAdjustment}};
         [_, _, _, _, _, _, _, _, _, ResponseTimeoutImmediateMax, _, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not (is_integer(ResponseTimeoutImmediateMax) andalso
                   (ResponseTimeoutImmediateMax >= 0) andalso
                   (ResponseTimeoutImmediateMax =< ?TIMEOUT_MAX_ERLANG)) ->
             {error, {service_options_response_timeout_immediate_max_invalid,
                      ResponseTimeoutImmediateMax}};
         [_, _, _, _, _, _, _, _, _, _, CountProcessDynamic, _,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not ((CountProcessDynamic =:= false) orelse
                   is_list(CountProcessDynamic)) ->
             {error, {service_options_count_process_dynamic_invalid,
                      CountProcessDynamic}};
         [_, _, _, _, _, _, _, _, _, _, _, Scope,
-         _, _, _, _, _, _, _, _]
+         _, _, _, _, _, _, _, _, _]
         when not is_atom(Scope) ->
             {error, {service_options_scope_invalid,
                      Scope}};
         [_, _, _, _, _, _, _, _, _, _, _, _,
-         MonkeyLatency, _, _, _, _, _, _, _]
+         MonkeyLatency, _, _, _, _, _, _, _, _]
         when not ((MonkeyLatency =:= false) orelse
                   (MonkeyLatency =:= system) orelse
                   is_list(MonkeyLatency)) ->
             {error, {service_options_monkey_latency_invalid,
                      MonkeyLatency}};
         [_, _, _, _, _, _, _, _, _, _, _, _,
-         _, MonkeyChaos, _, _, _, _, _, _]
+         _, MonkeyChaos, _, _, _, _, _, _, _]
         when not ((MonkeyChaos =:= false) orelse
                   (MonkeyChaos =:= system) orelse
                   is_list(MonkeyChaos)) ->
             {error, {service_options_monkey_chaos_invalid,
                      MonkeyChaos}};
         [_, _, _, _, _, _, _, _, _, _, _, _,
-         _, _, AutomaticLoading, _, _, _, _, _]
+         _, _, AutomaticLoading, _, _, _, _, _, _]
         when not is_boolean(AutomaticLoading) ->
             {error, {service_options_automatic_loading_invalid,
                      AutomaticLoading}};
+        [_, _, _, _, _, _, _, _, _, _, _, _,
+         _, _, _, _, _, _, _, _, Affinity]
+        when not ((Affinity =:= undefined) orelse
+                  (Affinity =:= spread) orelse
+                  (is_list(Affinity) andalso (Affinity /= []))) ->
+            {error, {service_options_affinity_invalid,
+                     Affinity}};
         [PriorityDefault, QueueLimit, QueueSize,
          DestRefreshStart, DestRefreshDelay, RequestNameLookup,
          RequestTimeoutAdjustment, RequestTimeoutImmediateMax,
          ResponseTimeoutAdjustment, ResponseTimeoutImmediateMax,
          CountProcessDynamic, Scope, MonkeyLatency, MonkeyChaos,
          AutomaticLoading, AspectsInitAfter, AspectsRequestBefore,
-         AspectsRequestAfter, AspectsTerminateBefore, Limit] ->
+         AspectsRequestAfter, AspectsTerminateBefore, Limit, Affinity] ->
             NewQueueSize = if
                 QueueSize =:= undefined ->
                     undefined;
@@ -2700,7 +2722,8 @@ services_validate_options_external(OptionsList, CountProcess) ->
                                                            MonkeyLatency,
                                                            MonkeyChaos,
                                                            CountProcess,
-                                                           Limit) of
+                                                           Limit,
+                                                           Affinity) of
                 {ok,
                  NewCountProcessDynamic,
                  NewMonkeyLatency,
@@ -2770,7 +2793,8 @@ services_validate_options_external_checks(CountProcessDynamic,
                                           MonkeyLatency,
                                           MonkeyChaos,
                                           CountProcess,
-                                          Limit) ->
+                                          Limit,
+                                          Affinity) ->
     case services_validate_options_common_checks(CountProcessDynamic,
                                                  MonkeyLatency,
                                                  MonkeyChaos,
@@ -2781,11 +2805,16 @@ services_validate_options_external_checks(CountProcessDynamic,
          NewMonkeyChaos} ->
             case cloudi_core_i_os_rlimit:limit_validate(Limit) of
                 {ok, NewLimit} ->
-                    {ok,
-                     NewCountProcessDynamic,
-                     NewMonkeyLatency,
-                     NewMonkeyChaos,
-                     NewLimit};
+                    case services_validate_option_affinity(Affinity) of
+                        ok ->
+                            {ok,
+                             NewCountProcessDynamic,
+                             NewMonkeyLatency,
+                             NewMonkeyChaos,
+                             NewLimit};
+                        {error, _} = Error ->
+                            Error
+                    end;
                 {error, _} = Error ->
                     Error
             end;
@@ -2793,6 +2822,18 @@ services_validate_options_external_checks(CountProcessDynamic,
             Error
     end.
 
+services_validate_option_affinity(Affinity)
+    when is_list(Affinity) ->
+    case lists:all(fun(Id) -> is_integer(Id) andalso (Id >= 0) end,
+                   Affinity) of
+        true ->
+            ok;
+        false ->
+            {error, {service_options_affinity_invalid, Affinity}}
+    end;
+services_validate_option_affinity(_) ->
+    ok.
+
 services_validate_options_common_checks(CountProcessDynamic,
                                         MonkeyLatency,
                                         MonkeyChaos,
@@ -77,18 +77,7 @@
 -include("cloudi_core_i_configuration.hrl").
 -include("cloudi_core_i_constants.hrl").
 
-% message type enumeration
--define(MESSAGE_INIT,                1).
--define(MESSAGE_SEND_ASYNC,          2).
--define(MESSAGE_SEND_SYNC,           3).
--define(MESSAGE_RECV_ASYNC,          4).
--define(MESSAGE_RETURN_ASYNC,        5).
--define(MESSAGE_RETURN_SYNC,         6).
--define(MESSAGE_RETURNS_ASYNC,       7).
--define(MESSAGE_KEEPALIVE,           8).
--define(MESSAGE_REINIT,              9).
--define(MESSAGE_SUBSCRIBE_COUNT,    10).
--define(MESSAGE_TERM,               11).
+-include("cloudi_core_i_protocol.hrl").
 
 -record(state,
     {
@@ -103,7 +92,7 @@
         % unique state elements
         queued_size = 0,               % queued size in bytes
         queued_word_size,              % erlang:system_info(wordsize)
-        protocol,                      % tcp, udp, or local
+        protocol,                      % tcp, udp, local, or shm
         port,                          % port number used
         initialize = false,            % ready to send init
         incoming_port,                 % udp incoming port
@@ -112,6 +101,8 @@
         socket_path,                   % local socket filesystem path
         socket_options,                % common socket options
         socket = undefined,            % data socket
+        shm = undefined,               % shm protocol shared memory
+        framing = term,                % term or binary incoming framing
         service_state = undefined,     % service state for aspects
         aspects_request_after_f = undefined, % pending aspects_request_after
         process_index,                 % 0-based index of the Erlang process
@@ -124,6 +115,8 @@
         timeout_term,                  % post-poll() timeout
         os_pid = undefined,            % os_pid reported by the socket
         keepalive = undefined,         % stores if a keepalive succeeded
+        async_futures = dict:new(),    % async responses to send when received
+        callback_ids = dict:new(),     % subscribed pattern to callback id
         init_timer,                    % init timeout handler
         uuid_generator,                % transaction id generator
         dest_refresh,                  % immediate_closest | lazy_closest |
@@ -161,7 +154,8 @@ start_link(Protocol, SocketPath,
          is_integer(TimeoutTerm) ->
     true = (Protocol =:= tcp) orelse
            (Protocol =:= udp) orelse
-           (Protocol =:= local),
+           (Protocol =:= local) orelse
+           (Protocol =:= shm),
     true = (DestRefresh =:= immediate_closest) orelse
            (DestRefresh =:= lazy_closest) orelse
            (DestRefresh =:= immediate_furthest) orelse
@@ -223,7 +217,8 @@ init([Protocol, SocketPath,
       DestRefresh, DestDeny, DestAllow, ConfigOptions])
     when Protocol =:= tcp;
          Protocol =:= udp;
-         Protocol =:= local ->
+         Protocol =:= local;
+         Protocol =:= shm ->
     Dispatcher = self(),
     InitTimer = erlang:send_after(Timeout, Dispatcher,
                                   'cloudi_service_init_timeout'),
@@ -292,6 +287,12 @@ init([Protocol, SocketPath,
     ?LOG_INFO("OS pid ~w connected", [OsPid]),
     {next_state, 'CONNECT', State#state{os_pid = OsPid}};
 
+'CONNECT'({'init', Framing}, State)
+    when Framing =:= binary ->
+    % the external service sends the send, forward and return
+    % commands with the binary framing instead of the external term format
+    'CONNECT'('init', State#state{framing = Framing});
+
 'CONNECT'('init', #state{initialize = Ready} = State) ->
     if
         Ready =:= true ->
@@ -393,6 +394,17 @@ init([Protocol, SocketPath,
     end,
     {next_state, 'HANDLE', State};
 
+'HANDLE'({'subscribe', Pattern, CallbackId},
+         #state{prefix = Prefix,
+                callback_ids = CallbackIds} = State)
+    when is_integer(CallbackId), CallbackId >= 0 ->
+    % the external service dispatches requests for the pattern
+    % with the callback id instead of the pattern
+    'HANDLE'({'subscribe', Pattern},
+             State#state{callback_ids = dict:store(Prefix ++ Pattern,
+                                                   CallbackId,
+                                                   CallbackIds)});
+
 'HANDLE'({'subscribe_count', Pattern},
          #state{dispatcher = Dispatcher,
                 prefix = Prefix,
@@ -482,6 +494,12 @@ init([Protocol, SocketPath,
             {next_state, 'HANDLE', State}
     end;
 
+'HANDLE'({'send_async_batch', Requests}, State) ->
+    true = is_list(Requests),
+    {TransIdList, NewState} = handle_send_async_batch(Requests, [], State),
+    ok = send('returns_async_out'(TransIdList), NewState),
+    {next_state, 'HANDLE', NewState};
+
 'HANDLE'({'forward_async', Name, RequestInfo, Request,
           Timeout, Priority, TransId, Source},
          #state{dispatcher = Dispatcher,
@@ -744,6 +762,34 @@ init([Protocol, SocketPath,
             end
     end;
 
+'HANDLE'({'recv_async_future', TransId},
+         #state{send_timeouts = SendTimeouts,
+                async_responses = AsyncResponses,
+                async_futures = AsyncFutures} = State) ->
+    <<_:48, 0:1, 0:1, 0:1, 1:1, _:12, 1:1, 0:1, _:62>> = TransId, % v1 UUID
+    % the async response is sent to the external service when it is
+    % received, without the external service blocking in recv_async
+    case dict:find(TransId, AsyncResponses) of
+        {ok, {ResponseInfo, Response}} ->
+            ok = send('recv_async_future_out'(ResponseInfo, Response,
+                                              TransId),
+                      State),
+            {next_state, 'HANDLE',
+             State#state{async_responses = dict:erase(TransId,
+                                                      AsyncResponses)}};
+        error ->
+            case dict:is_key(TransId, SendTimeouts) of
+                true ->
+                    {next_state, 'HANDLE',
+                     State#state{async_futures = dict:store(TransId, true,
+                                                            AsyncFutures)}};
+                false ->
+                    ok = send('recv_async_future_out'(timeout, TransId),
+                              State),
+                    {next_state, 'HANDLE', State}
+            end
+    end;
+
 'HANDLE'('keepalive', State) ->
     {next_state, 'HANDLE', State#state{keepalive = received}};
 
@@ -880,13 +926,13 @@ handle_info({SendType, Name, Pattern, RequestInfo, Request,
                     ok = send('send_async_out'(Name, Pattern,
                                                RequestInfo, Request,
                                                NextTimeout, Priority,
-                                               TransId, Source),
+                                               TransId, Source, State),
                               State);
                 SendType =:= 'cloudi_service_send_sync' ->
                     ok = send('send_sync_out'(Name, Pattern,
                                               RequestInfo, Request,
                                               NextTimeout, Priority,
-                                              TransId, Source),
+                                              TransId, Source, State),
                               State)
             end,
             AspectsRequestAfterF = fun(AspectsAfter, NewTimeout, Result, S) ->
@@ -975,6 +1021,7 @@ handle_info({'cloudi_service_return_async', _Name, _Pattern,
              ResponseInfo, Response, OldTimeout, TransId, Source}, StateName,
             #state{dispatcher = Dispatcher,
                    send_timeouts = SendTimeouts,
+                   async_futures = AsyncFutures,
                    options = #config_service_options{
                        request_timeout_immediate_max =
                            RequestTimeoutImmediateMax,
@@ -996,7 +1043,8 @@ handle_info({'cloudi_service_return_async', _Name, _Pattern,
                     ok
             end,
             {next_state, StateName,
-             send_timeout_end(TransId, Pid, State)};
+             send_timeout_end(TransId, Pid,
+                              async_future_end(TransId, State))};
         {ok, {passive, Pid, Tref}} ->
             Timeout = if
                 ResponseTimeoutAdjustment;
@@ -1014,10 +1062,17 @@ handle_info({'cloudi_service_return_async', _Name, _Pattern,
             NewState = if
                 is_binary(ResponseInfo) =:= false;
                 is_binary(Response) =:= false ->
-                    State;
+                    async_future_end(TransId, State);
                 true ->
-                    async_response_timeout_start(ResponseInfo, Response,
-                                                 Timeout, TransId, State)
+                    case dict:is_key(TransId, AsyncFutures) of
+                        true ->
+                            async_future_end(ResponseInfo, Response,
+                                             TransId, State);
+                        false ->
+                            async_response_timeout_start(ResponseInfo,
+                                                         Response, Timeout,
+                                                         TransId, State)
+                    end
             end,
             {next_state, StateName,
              send_timeout_end(TransId, Pid, NewState)}
@@ -1067,7 +1122,8 @@ handle_info({'cloudi_service_send_async_timeout', TransId}, StateName,
             {next_state, StateName, State};
         {ok, {_, Pid, _}} ->
             {next_state, StateName,
-             send_timeout_end(TransId, Pid, State)}
+             send_timeout_end(TransId, Pid,
+                              async_future_end(TransId, State))}
     end;
 
 handle_info({'cloudi_service_send_sync_timeout', TransId}, StateName,
@@ -1091,7 +1147,7 @@ handle_info({udp, Socket, _, Port, Data}, StateName,
                    incoming_port = Port,
                    socket = Socket} = State) ->
     inet:setopts(Socket, [{active, once}]),
-    try ?MODULE:StateName(erlang:binary_to_term(Data, [safe]), State)
+    try ?MODULE:StateName(recv(Data, State), State)
     catch
         error:badarg ->
             ?LOG_ERROR("Protocol Error ~p", [Data]),
@@ -1102,7 +1158,7 @@ handle_info({udp, Socket, _, Port, Data}, StateName,
             #state{protocol = udp,
                    socket = Socket} = State) ->
     inet:setopts(Socket, [{active, once}]),
-    try ?MODULE:StateName(erlang:binary_to_term(Data, [safe]),
+    try ?MODULE:StateName(recv(Data, State),
                           State#state{incoming_port = Port})
     catch
         error:badarg ->
@@ -1110,12 +1166,26 @@ handle_info({udp, Socket, _, Port, Data}, StateName,
             {stop, {error, protocol}, State}
     end;
 
+handle_info({tcp, Socket, <<>>}, StateName,
+            #state{protocol = shm,
+                   socket = Socket,
+                   shm = Shm} = State) ->
+    % the frame was stored in the shared memory ring
+    inet:setopts(Socket, [{active, once}]),
+    {ok, Data} = cloudi_core_i_socket:shm_read(Shm),
+    try ?MODULE:StateName(recv(Data, State), State)
+    catch
+        error:badarg ->
+            ?LOG_ERROR("Protocol Error ~p", [Data]),
+            {stop, {error, protocol}, State}
+    end;
+
 handle_info({tcp, Socket, Data}, StateName,
             #state{protocol = Protocol,
                    socket = Socket} = State)
-    when Protocol =:= tcp; Protocol =:= local ->
+    when Protocol =:= tcp; Protocol =:= local; Protocol =:= shm ->
     inet:setopts(Socket, [{active, once}]),
-    try ?MODULE:StateName(erlang:binary_to_term(Data, [safe]), State)
+    try ?MODULE:StateName(recv(Data, State), State)
     catch
         error:badarg ->
             ?LOG_ERROR("Protocol Error ~p", [Data]),
@@ -1151,13 +1221,13 @@ handle_info({udp_closed, Socket}, _,
 handle_info({tcp_closed, Socket}, _,
             #state{protocol = Protocol,
                    socket = Socket} = State)
-    when Protocol =:= tcp; Protocol =:= local ->
+    when Protocol =:= tcp; Protocol =:= local; Protocol =:= shm ->
     {stop, socket_closed, State};
 
 handle_info({tcp_error, Socket, Reason}, _,
             #state{protocol = Protocol,
                    socket = Socket} = State)
-    when Protocol =:= tcp; Protocol =:= local ->
+    when Protocol =:= tcp; Protocol =:= local; Protocol =:= shm ->
     {stop, Reason, State};
 
 handle_info({inet_async, Listener, Acceptor, {ok, Socket}}, StateName,
@@ -1173,21 +1243,32 @@ handle_info({inet_async, Listener, Acceptor, {ok, Socket}}, StateName,
                                         socket = Socket}};
 
 handle_info({inet_async, undefined, undefined, {ok, FileDescriptor}}, StateName,
-            #state{protocol = local,
-                   socket_options = SocketOptions} = State) ->
+            #state{protocol = Protocol,
+                   socket_options = SocketOptions} = State)
+    when Protocol =:= local; Protocol =:= shm ->
+    Shm = if
+        Protocol =:= shm ->
+            % provide the shared memory before the socket is non-blocking
+            {ok, ShmNew} = cloudi_core_i_socket:shm(FileDescriptor,
+                                                    ?SHM_RING_SIZE),
+            ShmNew;
+        true ->
+            undefined
+    end,
     {recbuf, ReceiveBufferSize} = lists:keyfind(recbuf, 1, SocketOptions),
     {sndbuf, SendBufferSize} = lists:keyfind(sndbuf, 1, SocketOptions),
     ok = cloudi_core_i_socket:setsockopts(FileDescriptor,
                                           ReceiveBufferSize, SendBufferSize),
     {ok, Socket} = cloudi_socket_set(FileDescriptor, SocketOptions),
     ok = inet:setopts(Socket, [{active, once}]),
-    {next_state, StateName, State#state{socket = Socket}};
+    {next_state, StateName, State#state{socket = Socket,
+                                        shm = Shm}};
 
 handle_info({inet_async, Listener, Acceptor, Error}, StateName,
             #state{protocol = Protocol,
                    listener = Listener,
                    acceptor = Acceptor} = State)
-    when Protocol =:= tcp; Protocol =:= local ->
+    when Protocol =:= tcp; Protocol =:= local; Protocol =:= shm ->
     {stop, {StateName, inet_async, Error}, State};
 
 handle_info(initialize, StateName, State) ->
@@ -1283,6 +1364,7 @@ format_status(_Opt,
                       send_timeout_monitors = SendTimeoutMonitors,
                       recv_timeouts = RecvTimeouts,
                       async_responses = AsyncResponses,
+                      async_futures = AsyncFutures,
                       queued = Queue,
                       cpg_data = Groups,
                       dest_deny = DestDeny,
@@ -1326,6 +1408,7 @@ format_status(_Opt,
                     send_timeout_monitors = dict:to_list(SendTimeoutMonitors),
                     recv_timeouts = NewRecvTimeouts,
                     async_responses = dict:to_list(AsyncResponses),
+                    async_futures = dict:fetch_keys(AsyncFutures),
                     queued = NewQueue,
                     cpg_data = NewGroups,
                     dest_deny = NewDestDeny,
@@ -1391,6 +1474,51 @@ handle_send_async(Name, RequestInfo, Request, Timeout, Priority, StateName,
              send_async_timeout_start(Timeout, TransId, Pid, State)}
     end.
 
+% a batch of send_async requests is only given a single response,
+% so a destination lookup failure is not retried
+% (the request gets a null TransId, as with request_name_lookup async)
+handle_send_async_batch([], TransIdList, State) ->
+    {lists:reverse(TransIdList), State};
+handle_send_async_batch([{Name, RequestInfo, Request, Timeout, Priority} |
+                         Requests], TransIdList,
+                        #state{dispatcher = Dispatcher,
+                               uuid_generator = UUID,
+                               dest_refresh = DestRefresh,
+                               cpg_data = Groups,
+                               dest_deny = DestDeny,
+                               dest_allow = DestAllow,
+                               options = #config_service_options{
+                                   scope = Scope}} = State) ->
+    true = is_list(Name) andalso is_integer(hd(Name)),
+    true = is_integer(Timeout),
+    true = (Timeout >= 0) andalso
+           (Timeout =< ?TIMEOUT_MAX_ERLANG),
+    true = is_integer(Priority),
+    true = (Priority >= ?PRIORITY_HIGH) andalso
+           (Priority =< ?PRIORITY_LOW),
+    Destination = case destination_allowed(Name, DestDeny, DestAllow) of
+        true ->
+            destination_get(DestRefresh, Scope, Name, Dispatcher,
+                            Groups, Timeout);
+        false ->
+            {error, not_allowed}
+    end,
+    case Destination of
+        {ok, Pattern, Pid} ->
+            TransId = cloudi_x_uuid:get_v1(UUID),
+            Pid ! {'cloudi_service_send_async',
+                   Name, Pattern, RequestInfo, Request,
+                   Timeout, Priority, TransId, Dispatcher},
+            handle_send_async_batch(Requests, [TransId | TransIdList],
+                                    send_async_timeout_start(Timeout,
+                                                             TransId,
+                                                             Pid,
+                                                             State));
+        {error, _} ->
+            handle_send_async_batch(Requests, [<<0:128>> | TransIdList],
+                                    State)
+    end.
+
 handle_send_sync(Name, RequestInfo, Request, Timeout, Priority, StateName,
                  #state{dispatcher = Dispatcher,
                         uuid_generator = UUID,
@@ -1529,41 +1657,33 @@ handle_mcast_async(Name, RequestInfo, Request, Timeout, Priority, StateName,
     <<?MESSAGE_KEEPALIVE:32/unsigned-integer-native>>.
 
 'send_async_out'(Name, Pattern, RequestInfo, Request,
-                 Timeout, Priority, TransId, Source)
-    when is_list(Name), is_list(Pattern),
-         is_binary(RequestInfo), is_binary(Request),
-         is_integer(Timeout), is_integer(Priority),
-         is_binary(TransId), is_pid(Source) ->
-    NameBin = erlang:list_to_binary(Name),
-    NameSize = erlang:byte_size(NameBin) + 1,
-    true = NameSize < 4294967296,
-    PatternBin = erlang:list_to_binary(Pattern),
-    PatternSize = erlang:byte_size(PatternBin) + 1,
-    true = PatternSize < 4294967296,
-    RequestInfoSize = erlang:byte_size(RequestInfo),
-    true = RequestInfoSize < 4294967296,
-    RequestSize = erlang:byte_size(Request),
-    true = RequestSize < 4294967296,
-    SourceBin = erlang:term_to_binary(Source),
-    SourceSize = erlang:byte_size(SourceBin),
-    true = SourceSize < 4294967296,
-    <<?MESSAGE_SEND_ASYNC:32/unsigned-integer-native,
-      NameSize:32/unsigned-integer-native,
-      NameBin/binary, 0:8,
-      PatternSize:32/unsigned-integer-native,
-      PatternBin/binary, 0:8,
-      RequestInfoSize:32/unsigned-integer-native,
-      RequestInfo/binary, 0:8,
-      RequestSize:32/unsigned-integer-native,
-      Request/binary, 0:8,
-      Timeout:32/unsigned-integer-native,
-      Priority:8/signed-integer-native,
-      TransId/binary,             % 128 bits
-      SourceSize:32/unsigned-integer-native,
-      SourceBin/binary>>.
+                 Timeout, Priority, TransId, Source,
+                 #state{callback_ids = CallbackIds}) ->
+    Header = case dict:find(Pattern, CallbackIds) of
+        {ok, CallbackId} ->
+            <<?MESSAGE_SEND_ASYNC_ID:32/unsigned-integer-native,
+              CallbackId:32/unsigned-integer-native>>;
+        error ->
+            <<?MESSAGE_SEND_ASYNC:32/unsigned-integer-native>>
+    end,
+    'send_out'(Header, Name, Pattern, RequestInfo, Request,
+               Timeout, Priority, TransId, Source).
 
 'send_sync_out'(Name, Pattern, RequestInfo, Request,
-                Timeout, Priority, TransId, Source)
+                Timeout, Priority, TransId, Source,
+                #state{callback_ids = CallbackIds}) ->
+    Header = case dict:find(Pattern, CallbackIds) of
+        {ok, CallbackId} ->
+            <<?MESSAGE_SEND_SYNC_ID:32/unsigned-integer-native,
+              CallbackId:32/unsigned-integer-native>>;
+        error ->
+            <<?MESSAGE_SEND_SYNC:32/unsigned-integer-native>>
+    end,
+    'send_out'(Header, Name, Pattern, RequestInfo, Request,
+               Timeout, Priority, TransId, Source).
+
+'send_out'(Header, Name, Pattern, RequestInfo, Request,
+           Timeout, Priority, TransId, Source)
     when is_list(Name), is_list(Pattern),
          is_binary(RequestInfo), is_binary(Request),
          is_integer(Timeout), is_integer(Priority),
@@ -1581,7 +1701,7 @@ handle_mcast_async(Name, RequestInfo, Request, Timeout, Priority, StateName,
     SourceBin = erlang:term_to_binary(Source),
     SourceSize = erlang:byte_size(SourceBin),
     true = SourceSize < 4294967296,
-    <<?MESSAGE_SEND_SYNC:32/unsigned-integer-native,
+    <<Header/binary,
       NameSize:32/unsigned-integer-native,
       NameBin/binary, 0:8,
       PatternSize:32/unsigned-integer-native,
@@ -1664,17 +1784,140 @@ handle_mcast_async(Name, RequestInfo, Request, Timeout, Priority, StateName,
       Response/binary, 0:8,
       TransId/binary>>.           % 128 bits
 
+'recv_async_future_out'(timeout, TransId)
+    when is_binary(TransId) ->
+    <<?MESSAGE_RECV_ASYNC_FUTURE:32/unsigned-integer-native,
+      0:32, 0:8,
+      0:32, 0:8,
+      TransId/binary>>.           % 128 bits
+
+'recv_async_future_out'(ResponseInfo, Response, TransId)
+    when is_binary(ResponseInfo), is_binary(Response), is_binary(TransId) ->
+    ResponseInfoSize = erlang:byte_size(ResponseInfo),
+    true = ResponseInfoSize < 4294967296,
+    ResponseSize = erlang:byte_size(Response),
+    true = ResponseSize < 4294967296,
+    <<?MESSAGE_RECV_ASYNC_FUTURE:32/unsigned-integer-native,
+      ResponseInfoSize:32/unsigned-integer-native,
+      ResponseInfo/binary, 0:8,
+      ResponseSize:32/unsigned-integer-native,
+      Response/binary, 0:8,
+      TransId/binary>>.           % 128 bits
+
 'subscribe_count_out'(Count)
     when is_integer(Count), Count >= 0, Count < 4294967296 ->
     <<?MESSAGE_SUBSCRIBE_COUNT:32/unsigned-integer-native,
       Count:32/unsigned-integer-native>>.
 
+% incoming data uses the external term format unless the
+% binary framing was requested during initialization
+% (the binary framing never starts with the version byte 131)
+recv(<<131:8, _/binary>> = Data, _) ->
+    erlang:binary_to_term(Data, [safe]);
+recv(<<Command:8,
+       Timeout:32/unsigned-integer-native,
+       Priority:8/signed-integer-native,
+       NameSize:32/unsigned-integer-native,
+       RequestInfoSize:32/unsigned-integer-native,
+       RequestSize:32/unsigned-integer-native,
+       Name:NameSize/binary,
+       RequestInfo:RequestInfoSize/binary,
+       Request:RequestSize/binary>>,
+     #state{framing = binary})
+    when Command =:= ?COMMAND_SEND_ASYNC;
+         Command =:= ?COMMAND_SEND_SYNC;
+         Command =:= ?COMMAND_MCAST_ASYNC ->
+    {recv_command(Command), erlang:binary_to_list(Name),
+     RequestInfo, Request, Timeout, Priority};
+recv(<<Command:8,
+       Timeout:32/unsigned-integer-native,
+       Priority:8/signed-integer-native,
+       TransId:16/binary,
+       NameSize:32/unsigned-integer-native,
+       RequestInfoSize:32/unsigned-integer-native,
+       RequestSize:32/unsigned-integer-native,
+       SourceSize:32/unsigned-integer-native,
+       Name:NameSize/binary,
+       RequestInfo:RequestInfoSize/binary,
+       Request:RequestSize/binary,
+       SourceBin:SourceSize/binary>>,
+     #state{framing = binary})
+    when Command =:= ?COMMAND_FORWARD_ASYNC;
+         Command =:= ?COMMAND_FORWARD_SYNC ->
+    {recv_command(Command), erlang:binary_to_list(Name),
+     RequestInfo, Request, Timeout, Priority, TransId,
+     erlang:binary_to_term(SourceBin, [safe])};
+recv(<<Command:8,
+       Timeout:32/unsigned-integer-native,
+       TransId:16/binary,
+       NameSize:32/unsigned-integer-native,
+       PatternSize:32/unsigned-integer-native,
+       ResponseInfoSize:32/unsigned-integer-native,
+       ResponseSize:32/unsigned-integer-native,
+       SourceSize:32/unsigned-integer-native,
+       Name:NameSize/binary,
+       Pattern:PatternSize/binary,
+       ResponseInfo:ResponseInfoSize/binary,
+       Response:ResponseSize/binary,
+       SourceBin:SourceSize/binary>>,
+     #state{framing = binary})
+    when Command =:= ?COMMAND_RETURN_ASYNC;
+         Command =:= ?COMMAND_RETURN_SYNC ->
+    {recv_command(Command), erlang:binary_to_list(Name),
+     erlang:binary_to_list(Pattern), ResponseInfo, Response,
+     Timeout, TransId, erlang:binary_to_term(SourceBin, [safe])};
+recv(_, _) ->
+    erlang:error(badarg).
+
+recv_command(?COMMAND_SEND_ASYNC) ->
+    'send_async';
+recv_command(?COMMAND_SEND_SYNC) ->
+    'send_sync';
+recv_command(?COMMAND_MCAST_ASYNC) ->
+    'mcast_async';
+recv_command(?COMMAND_FORWARD_ASYNC) ->
+    'forward_async';
+recv_command(?COMMAND_FORWARD_SYNC) ->
+    'forward_sync';
+recv_command(?COMMAND_RETURN_ASYNC) ->
+    'return_async';
+recv_command(?COMMAND_RETURN_SYNC) ->
+    'return_sync'.
+
+% a future is provided with a timeout (an empty response) if the
+% async response is not available
+async_future_end(TransId, State) ->
+    async_future_end(<<>>, <<>>, TransId, State).
+
+async_future_end(ResponseInfo, Response, TransId,
+                 #state{async_futures = AsyncFutures} = State) ->
+    case dict:is_key(TransId, AsyncFutures) of
+        true ->
+            ok = send('recv_async_future_out'(ResponseInfo, Response,
+                                              TransId),
+                      State),
+            State#state{async_futures = dict:erase(TransId, AsyncFutures)};
+        false ->
+            State
+    end.
+
 send(Data, #state{protocol = Protocol,
                   incoming_port = Port,
-                  socket = Socket}) when is_binary(Data) ->
+                  socket = Socket,
+                  shm = Shm}) when is_binary(Data) ->
     if
         Protocol =:= tcp; Protocol =:= local ->
             gen_tcp:send(Socket, Data);
+        Protocol =:= shm ->
+            ShmStored = (byte_size(Data) >= ?SHM_FRAME_SIZE_MIN) andalso
+                        (cloudi_core_i_socket:shm_write(Shm, Data) =:= ok),
+            if
+                ShmStored =:= true ->
+                    % the 0 length packet provides the frame in the ring
+                    gen_tcp:send(Socket, <<>>);
+                ShmStored =:= false ->
+                    gen_tcp:send(Socket, Data)
+            end;
         Protocol =:= udp ->
             gen_udp:send(Socket, {127,0,0,1}, Port, Data)
     end.
@@ -1731,7 +1974,7 @@ process_queue(#state{dispatcher = Dispatcher,
                     ok = send('send_async_out'(Name, Pattern,
                                                RequestInfo, Request,
                                                Timeout, Priority, TransId,
-                                               Source),
+                                               Source, State),
                               State),
                     AspectsRequestAfterF = fun(AspectsAfter, NewTimeout,
                                                Result, S) ->
@@ -1789,7 +2032,7 @@ process_queue(#state{dispatcher = Dispatcher,
                     ok = send('send_sync_out'(Name, Pattern,
                                               RequestInfo, Request,
                                               Timeout, Priority, TransId,
-                                              Source),
+                                              Source, State),
                               State),
                     AspectsRequestAfterF = fun(AspectsAfter, NewTimeout,
                                                Result, S) ->
@@ -1864,7 +2107,12 @@ socket_open(local, SocketPath, ThreadIndex, BufferSize) ->
     {ok, #state{protocol = local,
                 port = ThreadIndex,
                 socket_path = ThreadSocketPath,
-                socket_options = SocketOptions}}.
+                socket_options = SocketOptions}};
+
+socket_open(shm, SocketPath, ThreadIndex, BufferSize) ->
+    % the local socket is used for the shared memory frame notification
+    {ok, State} = socket_open(local, SocketPath, ThreadIndex, BufferSize),
+    {ok, State#state{protocol = shm}}.
 
 socket_close(Reason, #state{protocol = Protocol,
                             listener = Listener,
@@ -1872,7 +2120,7 @@ socket_close(Reason, #state{protocol = Protocol,
                             socket = Socket,
                             timeout_term = TimeoutTerm,
                             os_pid = OsPid} = State)
-    when Protocol =:= tcp; Protocol =:= local ->
+    when Protocol =:= tcp; Protocol =:= local; Protocol =:= shm ->
     if
         Reason =:= socket_closed;
         Socket =:= undefined ->
@@ -1896,7 +2144,7 @@ socket_close(Reason, #state{protocol = Protocol,
     end,
     catch gen_tcp:close(Listener),
     if
-        Protocol =:= local ->
+        Protocol =:= local; Protocol =:= shm ->
             catch file:delete(SocketPath);
         true ->
             ok
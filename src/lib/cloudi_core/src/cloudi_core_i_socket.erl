@@ -54,7 +54,10 @@
 %% external interface
 -export([local/1,
          set/2,
-         setsockopts/3]).
+         setsockopts/3,
+         shm/2,
+         shm_read/1,
+         shm_write/2]).
 
 -include("cloudi_core_i_constants.hrl").
 
@@ -100,6 +103,26 @@ set(_FileDescriptorOld, _FileDescriptorNew) ->
 setsockopts(_FileDescriptor, _RecBufSize, _SndBufSize) ->
     erlang:nif_error(not_loaded).
 
+-spec shm(_FileDescriptor :: integer(),
+          _RingSize :: pos_integer()) ->
+    {ok, any()} | {error, atom()}.
+
+shm(_FileDescriptor, _RingSize) ->
+    erlang:nif_error(not_loaded).
+
+-spec shm_read(_Shm :: any()) ->
+    {ok, binary()} | {error, empty}.
+
+shm_read(_Shm) ->
+    erlang:nif_error(not_loaded).
+
+-spec shm_write(_Shm :: any(),
+                _Data :: binary()) ->
+    ok | {error, full}.
+
+shm_write(_Shm, _Data) ->
+    erlang:nif_error(not_loaded).
+
 %%%------------------------------------------------------------------------
 %%% Private functions
 %%%------------------------------------------------------------------------
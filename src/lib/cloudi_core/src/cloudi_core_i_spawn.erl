@@ -67,6 +67,7 @@
 -define(ENVIRONMENT_THREAD_COUNT,  "CLOUDI_API_INIT_THREAD_COUNT").
 -define(ENVIRONMENT_PROTOCOL,      "CLOUDI_API_INIT_PROTOCOL").
 -define(ENVIRONMENT_BUFFER_SIZE,   "CLOUDI_API_INIT_BUFFER_SIZE").
+-define(ENVIRONMENT_AFFINITY,      "CLOUDI_API_INIT_AFFINITY").
 
 %%%------------------------------------------------------------------------
 %%% External interface
@@ -153,7 +154,8 @@ start_external(ProcessIndex, ProcessCount, ThreadsPerProcess,
          is_binary(UUID) ->
     true = (Protocol =:= tcp) orelse
            (Protocol =:= udp) orelse
-           (Protocol =:= local),
+           (Protocol =:= local) orelse
+           (Protocol =:= shm),
     true = (DestRefresh =:= immediate_closest) orelse
            (DestRefresh =:= lazy_closest) orelse
            (DestRefresh =:= immediate_furthest) orelse
@@ -214,19 +216,26 @@ start_external(ProcessIndex, ProcessCount, ThreadsPerProcess,
                                         Protocol =:= udp ->
                                             $u; % inet
                                         Protocol =:= local ->
+                                            $l; % tcp local (unix domain socket)
+                                        Protocol =:= shm ->
                                             $l  % tcp local (unix domain socket)
                                     end,
+                                    Affinity = ConfigOptions#
+                                               config_service_options.
+                                               affinity,
                                     start_external_spawn(SpawnProcess,
                                                          SpawnProtocol,
                                                          SocketPath,
                                                          Pids, Ports,
+                                                         ProcessIndex,
                                                          ThreadsPerProcess,
                                                          CommandLine,
                                                          NewFilename,
                                                          NewArguments,
                                                          Environment,
                                                          EnvironmentLookup,
-                                                         Protocol, BufferSize);
+                                                         Protocol, BufferSize,
+                                                         Affinity);
                                 {error, _} = Error ->
                                     Error
                             end;
@@ -295,11 +304,14 @@ start_external_threads(ThreadsPerProcess,
                           ConfigOptions).
 
 start_external_spawn(SpawnProcess, SpawnProtocol, SocketPath, Pids, Ports,
-                     ThreadsPerProcess, CommandLine,
+                     ProcessIndex, ThreadsPerProcess, CommandLine,
                      Filename, Arguments, Environment,
-                     EnvironmentLookup, Protocol, BufferSize) ->
+                     EnvironmentLookup, Protocol, BufferSize, Affinity) ->
     SpawnEnvironment = environment_parse(Environment, ThreadsPerProcess,
                                          Protocol, BufferSize,
+                                         affinity_plan(Affinity,
+                                                       ProcessIndex,
+                                                       ThreadsPerProcess),
                                          EnvironmentLookup),
     case cloudi_core_i_os_spawn:spawn(SpawnProcess,
                                       SpawnProtocol,
@@ -421,7 +433,7 @@ arguments_parse(Output, Delim, [H | T]) ->
 % add CloudI API environmental variables and format into a single
 % string that is easy to use in C/C++
 environment_parse(Environment0, ThreadsPerProcess0,
-                  Protocol0, BufferSize0, EnvironmentLookup0) ->
+                  Protocol0, BufferSize0, Affinity, EnvironmentLookup0) ->
     ThreadsPerProcess1 = erlang:integer_to_list(ThreadsPerProcess0),
     Protocol1 = erlang:atom_to_list(Protocol0),
     BufferSize1 = erlang:integer_to_list(BufferSize0),
@@ -443,7 +455,52 @@ environment_parse(Environment0, ThreadsPerProcess0,
     EnvironmentLookup3 = cloudi_x_trie:store(?ENVIRONMENT_BUFFER_SIZE,
                                              BufferSize1,
                                              EnvironmentLookup2),
-    environment_format(Environment3, EnvironmentLookup3).
+    if
+        Affinity == [] ->
+            environment_format(Environment3, EnvironmentLookup3);
+        true ->
+            Environment4 = lists:keystore(?ENVIRONMENT_AFFINITY, 1,
+                                          Environment3,
+                                          {?ENVIRONMENT_AFFINITY,
+                                           Affinity}),
+            EnvironmentLookup4 = cloudi_x_trie:store(?ENVIRONMENT_AFFINITY,
+                                                     Affinity,
+                                                     EnvironmentLookup3),
+            environment_format(Environment4, EnvironmentLookup4)
+    end.
+
+% the logical processor for each thread of the OS process, as a comma
+% separated list indexed by the CloudI API thread_index
+% (the OS processes of the service use consecutive logical processors
+%  so that all the threads of an OS process are likely on the same
+%  NUMA node, with the thread's memory allocated on that node)
+affinity_plan(undefined, _, _) ->
+    [];
+affinity_plan(spread, ProcessIndex, ThreadsPerProcess) ->
+    affinity_plan(affinity_logical(erlang:system_info(cpu_topology)),
+                  ProcessIndex, ThreadsPerProcess);
+affinity_plan([], _, _) ->
+    [];
+affinity_plan([_ | _] = Logical, ProcessIndex, ThreadsPerProcess) ->
+    LogicalCount = erlang:length(Logical),
+    Offset = ProcessIndex * ThreadsPerProcess,
+    string:join([erlang:integer_to_list(
+                     lists:nth(((Offset + I) rem LogicalCount) + 1, Logical))
+                 || I <- lists:seq(0, ThreadsPerProcess - 1)], ",").
+
+% logical processor ids in the order of the Erlang VM cpu_topology
+% (grouped by node, processor and core)
+affinity_logical(undefined) ->
+    [];
+affinity_logical({logical, Id}) ->
+    [Id];
+affinity_logical({_, SubLevel}) ->
+    affinity_logical(SubLevel);
+affinity_logical({_, _, SubLevel}) ->
+    affinity_logical(SubLevel);
+affinity_logical(Levels)
+    when is_list(Levels) ->
+    lists:flatmap(fun affinity_logical/1, Levels).
 
 environment_format_value([], _) ->
     [];
@@ -293,6 +293,12 @@
               limit_external_value/0,
               limit_external/0]).
 
+-type affinity_external() ::
+    undefined |
+    spread |
+    nonempty_list(non_neg_integer()). % logical processor ids
+-export_type([affinity_external/0]).
+
 -type service_options_internal() ::
     list({priority_default, priority()} |
          {queue_limit, undefined | non_neg_integer()} |
@@ -377,7 +383,8 @@
          {aspects_request_before, list(aspect_request_before_external())} |
          {aspects_request_after, list(aspect_request_after_external())} |
          {aspects_terminate_before, list(aspect_terminate_before_external())} |
-         {limit, limit_external()}).
+         {limit, limit_external()} |
+         {affinity, affinity_external()}).
 -export_type([service_options_internal/0,
               service_options_external/0]).
 
@@ -392,7 +399,7 @@
          {args, list()} |
          {env, list({string(), string()})} |
          {dest_refresh, dest_refresh()} |
-         {protocol, 'default' | 'local' | 'tcp' | 'udp'} |
+         {protocol, 'default' | 'local' | 'shm' | 'tcp' | 'udp'} |
          {buffer_size, 'default' | pos_integer()} |
          {timeout_init, timeout_milliseconds()} |
          {timeout_async, timeout_milliseconds()} |
@@ -0,0 +1,166 @@
+/* -*- coding: utf-8; Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*-
+ * ex: set softtabstop=4 tabstop=4 shiftwidth=4 expandtab fileencoding=utf-8:
+ *
+ * BSD LICENSE
+ * 
+ * Copyright (c) 2015, Michael Truog <mjtruog at gmail dot com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * All advertising materials mentioning features or use of this
+ *       software must display the following acknowledgment:
+ *         This product includes software developed by Michael Truog
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+
+// compare the datagram reading done by the CloudI C/C++ API udp protocol:
+//  previous: read buffer_size with a separate 0 timeout poll
+//            after each datagram of buffer_size
+//  current:  recv with MSG_TRUNC, with each datagram after
+//            a datagram of buffer_size read with MSG_DONTWAIT
+
+#define BUFFER_SIZE 16384 // CLOUDI_API_INIT_BUFFER_SIZE udp default
+#define DATAGRAM_SIZE_MAX 65536
+#define CHUNKS 4
+#define ITERATIONS 100000
+
+static unsigned long syscalls = 0;
+
+static double now()
+{
+    struct timespec value;
+    ::clock_gettime(CLOCK_MONOTONIC, &value);
+    return value.tv_sec + value.tv_nsec * 1.0e-9;
+}
+
+static void write_message(int const fd, char const * const data)
+{
+    for (size_t i = 0; i < CHUNKS; ++i)
+    {
+        ssize_t const count = ::write(fd, data, BUFFER_SIZE);
+        assert(count == BUFFER_SIZE);
+    }
+}
+
+static size_t read_previous(int const fd, std::vector<char> & buffer)
+{
+    size_t total = 0;
+    bool ready = true;
+    while (ready)
+    {
+        if (buffer.size() < total + BUFFER_SIZE)
+            buffer.resize(total + BUFFER_SIZE);
+        ssize_t const i = ::read(fd, &buffer[total], BUFFER_SIZE);
+        ++syscalls;
+        assert(i >= 0);
+        total += i;
+        ready = (i == BUFFER_SIZE);
+        if (ready)
+        {
+            struct pollfd fds[1] = {{fd, POLLIN | POLLPRI, 0}};
+            int const count = ::poll(fds, 1, 0);
+            ++syscalls;
+            assert(count >= 0);
+            ready = (count == 1);
+        }
+    }
+    return total;
+}
+
+static size_t read_current(int const fd, std::vector<char> & buffer)
+{
+    size_t total = 0;
+    int flags = MSG_TRUNC;
+    while (true)
+    {
+        if (buffer.size() < total + DATAGRAM_SIZE_MAX)
+            buffer.resize(total + DATAGRAM_SIZE_MAX);
+        ssize_t const i = ::recv(fd, &buffer[total], DATAGRAM_SIZE_MAX, flags);
+        ++syscalls;
+        if (i < 0)
+        {
+            assert(errno == EAGAIN || errno == EWOULDBLOCK);
+            break;
+        }
+        total += i;
+        if (i != BUFFER_SIZE)
+            break;
+        flags = MSG_TRUNC | MSG_DONTWAIT;
+    }
+    return total;
+}
+
+static void benchmark(char const * const name,
+                      size_t (*read_message)(int const,
+                                             std::vector<char> &))
+{
+    int fds[2];
+    int const status = ::socketpair(AF_UNIX, SOCK_DGRAM, 0, fds);
+    assert(status == 0);
+    int const socket_buffer_size = CHUNKS * BUFFER_SIZE * 4;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF,
+                 &socket_buffer_size, sizeof(socket_buffer_size));
+    ::setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF,
+                 &socket_buffer_size, sizeof(socket_buffer_size));
+    std::vector<char> data(BUFFER_SIZE, 'x');
+    std::vector<char> buffer;
+    syscalls = 0;
+    double elapsed = 0.0;
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+        write_message(fds[0], &data[0]);
+        double const start = now();
+        size_t const total = read_message(fds[1], buffer);
+        elapsed += now() - start;
+        assert(total == CHUNKS * BUFFER_SIZE);
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+    std::cout << name << ": " <<
+        static_cast<double>(syscalls) / ITERATIONS << " syscalls, " <<
+        elapsed * 1.0e6 / ITERATIONS << " us per " <<
+        CHUNKS * BUFFER_SIZE << " byte message" << std::endl;
+}
+
+int main(int, char **)
+{
+    benchmark("previous (read, poll)", &read_previous);
+    benchmark("current (recv MSG_DONTWAIT)", &read_current);
+    return 0;
+}
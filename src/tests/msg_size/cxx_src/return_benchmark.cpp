@@ -0,0 +1,287 @@
+/* -*- coding: utf-8; Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*-
+ * ex: set softtabstop=4 tabstop=4 shiftwidth=4 expandtab fileencoding=utf-8:
+ *
+ * BSD LICENSE
+ * 
+ * Copyright (c) 2015, Michael Truog <mjtruog at gmail dot com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in
+ *       the documentation and/or other materials provided with the
+ *       distribution.
+ *     * All advertising materials mentioning features or use of this
+ *       software must display the following acknowledgment:
+ *         This product includes software developed by Michael Truog
+ *     * The name of the author may not be used to endorse or promote
+ *       products derived from this software without specific prior
+ *       written permission
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+ * CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include "cloudi.h"
+#include "cloudi_protocol.h"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+// compare the callback return paths of the CloudI C/C++ API:
+//  exception: cloudi_return ends the callback with an exception (default)
+//  nothrow:   cloudi_return_nothrow is enabled and the callback returns
+// each thread uses a separate CloudI API instance (tcp protocol framing)
+// connected to a thread that provides the cloudi_core service requests
+
+#define MESSAGE_TYPE(NAME, TYPE, LAYOUT) MESSAGE_##NAME = TYPE,
+enum
+{
+    CLOUDI_PROTOCOL_MESSAGES(MESSAGE_TYPE)
+};
+#undef MESSAGE_TYPE
+
+#define THREADS_MAX 8
+#define REQUESTS 200000 // for each thread
+#define WINDOW 64       // outstanding requests
+
+static double now()
+{
+    struct timespec value;
+    ::clock_gettime(CLOCK_MONOTONIC, &value);
+    return value.tv_sec + value.tv_nsec * 1.0e-9;
+}
+
+template <typename T>
+static void put(std::string & message, T const value)
+{
+    message.append(reinterpret_cast<char const *>(&value), sizeof(T));
+}
+
+static void put_string(std::string & message, std::string const & data)
+{
+    put<uint32_t>(message, data.size() + 1);
+    message.append(data);
+    message.push_back('\0');
+}
+
+static void put_binary(std::string & message, std::string const & data)
+{
+    put<uint32_t>(message, data.size());
+    message.append(data);
+    message.push_back('\0');
+}
+
+static std::string frame(std::string const & message)
+{
+    uint32_t const size = message.size();
+    char const header[4] = {static_cast<char>((size >> 24) & 0xff),
+                            static_cast<char>((size >> 16) & 0xff),
+                            static_cast<char>((size >> 8) & 0xff),
+                            static_cast<char>(size & 0xff)};
+    return std::string(header, 4) + message;
+}
+
+static void read_frame(int const fd, std::vector<char> & buffer)
+{
+    unsigned char header[4];
+    size_t total = 0;
+    while (total < 4)
+    {
+        ssize_t const i = ::read(fd, &header[total], 4 - total);
+        assert(i > 0);
+        total += i;
+    }
+    size_t const size = (header[0] << 24) | (header[1] << 16) |
+                        (header[2] << 8) | header[3];
+    buffer.resize(size);
+    total = 0;
+    while (total < size)
+    {
+        ssize_t const i = ::read(fd, &buffer[total], size - total);
+        assert(i > 0);
+        total += i;
+    }
+}
+
+static void write_all(int const fd, std::string const & data)
+{
+    size_t total = 0;
+    while (total < data.size())
+    {
+        ssize_t const i = ::write(fd, data.data() + total,
+                                  data.size() - total);
+        assert(i > 0);
+        total += i;
+    }
+}
+
+static void request(cloudi_instance_t * api,
+                    int const command,
+                    char const * const name,
+                    char const * const pattern,
+                    void const * const /*request_info*/,
+                    uint32_t const /*request_info_size*/,
+                    void const * const request,
+                    uint32_t const request_size,
+                    uint32_t timeout,
+                    int8_t /*priority*/,
+                    char const * const trans_id,
+                    char const * const pid,
+                    uint32_t const pid_size)
+{
+    // the same code is used for both return paths
+    cloudi_return(api, command, name, pattern,
+                  "", 0, request, request_size,
+                  timeout, trans_id, pid, pid_size);
+}
+
+struct service_thread
+{
+    unsigned int thread_index;
+    int nothrow;
+    int fd; // the cloudi_core side of the socket
+};
+
+static void * service(void * p)
+{
+    service_thread const & thread = *reinterpret_cast<service_thread *>(p);
+    cloudi_instance_t api;
+    int result = cloudi_initialize(&api, thread.thread_index);
+    assert(result == cloudi_success);
+    result = cloudi_return_nothrow(&api, thread.nothrow);
+    assert(result == cloudi_success);
+    result = cloudi_subscribe(&api, "return", &request);
+    assert(result == cloudi_success);
+    result = cloudi_poll(&api, -1);
+    assert(result == cloudi_success || result == cloudi_terminate);
+    cloudi_destroy(&api);
+    return 0;
+}
+
+static void * core(void * p)
+{
+    service_thread const & thread = *reinterpret_cast<service_thread *>(p);
+    std::vector<char> buffer;
+    read_frame(thread.fd, buffer); // init
+    std::string init;
+    put<uint32_t>(init, MESSAGE_INIT);
+    put<uint32_t>(init, thread.thread_index); // process_index
+    put<uint32_t>(init, THREADS_MAX); // process_count
+    put<uint32_t>(init, THREADS_MAX); // process_count_max
+    put<uint32_t>(init, THREADS_MAX); // process_count_min
+    put_string(init, std::string("/benchmark/"));
+    put<uint32_t>(init, 5000); // timeout_initialize
+    put<uint32_t>(init, 5000); // timeout_async
+    put<uint32_t>(init, 5000); // timeout_sync
+    put<uint32_t>(init, 1000); // timeout_terminate
+    put<int8_t>(init, 0); // priority_default
+    put<uint8_t>(init, 0); // request_timeout_adjustment
+    write_all(thread.fd, frame(init));
+    read_frame(thread.fd, buffer); // subscribe
+    read_frame(thread.fd, buffer); // polling
+
+    std::string send;
+    put<uint32_t>(send, MESSAGE_SEND_ASYNC);
+    put_string(send, std::string("/benchmark/return")); // name
+    put_string(send, std::string("/benchmark/return")); // pattern
+    put_binary(send, std::string("")); // request_info
+    put_binary(send, std::string("request"));
+    put<uint32_t>(send, 5000); // timeout
+    put<int8_t>(send, 0); // priority
+    send.append(16, 't'); // trans_id
+    char const pid[] = {131, 100, 0, 3, 'p', 'i', 'd'}; // 'pid'
+    put<uint32_t>(send, sizeof(pid));
+    send.append(pid, sizeof(pid));
+    std::string window;
+    for (size_t i = 0; i < WINDOW; ++i)
+        window += frame(send);
+    for (size_t i = 0; i < REQUESTS; i += WINDOW)
+    {
+        write_all(thread.fd, window);
+        for (size_t j = 0; j < WINDOW; ++j)
+            read_frame(thread.fd, buffer); // return_async
+    }
+    std::string term;
+    put<uint32_t>(term, MESSAGE_TERM);
+    write_all(thread.fd, frame(term));
+    return 0;
+}
+
+static void benchmark(char const * const name,
+                      int const nothrow,
+                      unsigned int const threads)
+{
+    service_thread thread[THREADS_MAX];
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        int fds[2];
+        int const status = ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        assert(status == 0);
+        // the CloudI API uses the file descriptor thread_index + 3
+        int const fd = ::fcntl(fds[1], F_DUPFD, 3 + THREADS_MAX);
+        ::close(fds[1]);
+        thread[i].thread_index = i;
+        thread[i].nothrow = nothrow;
+        thread[i].fd = ::fcntl(fds[0], F_DUPFD, 3 + THREADS_MAX);
+        ::close(fds[0]);
+        ::dup2(fd, 3 + i);
+        ::close(fd);
+    }
+    double const start = now();
+    pthread_t core_threads[THREADS_MAX];
+    pthread_t service_threads[THREADS_MAX];
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        ::pthread_create(&core_threads[i], 0, &core, &thread[i]);
+        ::pthread_create(&service_threads[i], 0, &service, &thread[i]);
+    }
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        ::pthread_join(service_threads[i], 0);
+        ::pthread_join(core_threads[i], 0);
+        ::close(thread[i].fd);
+    }
+    double const elapsed = now() - start;
+    std::cout << name << ", " << threads << " thread(s): " <<
+        static_cast<unsigned long>(threads * REQUESTS / elapsed) <<
+        " requests/second" << std::endl;
+}
+
+int main(int, char **)
+{
+    ::setenv("CLOUDI_API_INIT_PROTOCOL", "tcp", 1);
+    ::setenv("CLOUDI_API_INIT_BUFFER_SIZE", "65536", 1);
+    ::setenv("CLOUDI_API_INIT_THREAD_COUNT", "8", 1); // THREADS_MAX
+    for (unsigned int threads = 1; threads <= THREADS_MAX; threads *= 2)
+    {
+        benchmark("exception", 0, threads);
+        benchmark("nothrow", 1, threads);
+    }
+    return 0;
+}